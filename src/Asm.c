@@ -0,0 +1,781 @@
+/********************************************************************************
+*********************************************************************************
+**  Assembler for the simulator's instruction set                              **
+**  Mnemonics as in Instruction.c, labels, constants, .org and data blocks;    **
+**  writes the text format or a binary image, and optionally a symbol table    **
+**  for the profiler and tracedump. Two passes over the source in memory:      **
+**  the first places labels, the second emits words                            **
+**                                                                             **
+**  Usage: ./asm [-b] [-m size,system] [-o output] [-s symbols] program.asm    **
+**         -b: binary image instead of the text format                         **
+**         -m: memory layout, must match the simulator's -m                    **
+**         -o: output file, default program.txt or program.img                 **
+**         -s: write "address label" lines, sorted by address                  **
+**  Source, one statement per line, ';' or "//" starts a comment:              **
+**         loop:   LoadAddr count      instruction, operand is an expression   **
+**         count = 10                  constant, also .equ count, 10           **
+**                 .org 1000           or .1000, continue at an address        **
+**         table:  .word 1, 'A', loop+2                                        **
+**         text:   .ascii "Hi\n"       one word per character                  **
+**                 .space 16           skip words, they stay 0                 **
+**         Expressions: numbers, 0x hex, 'c', labels, constants, $ for the     **
+**         current address, + - and parentheses                                **
+**  Build: gcc -O2 -o asm Asm.c Image.c Page.c Instruction.c Symbol.c          **
+**  Function:                                                                  **
+**    - Internal:                                                              **
+**       int assemble(Assembler*, int);   // One pass over the source          **
+**       void statement(Assembler*, char*, char*); // One line                 **
+**       int expression(Assembler*, char**, char*, long long*); // Evaluate    **
+**       int term(Assembler*, char**, char*, long long*); // Operand of + -    **
+**       Entry *lookup(Assembler*, char*, int); // Symbol by name              **
+**       Entry *define(Assembler*, char*, int, int, int); // New symbol        **
+**       void emit(Assembler*, int, char*, int, char*, int); // Store a word   **
+**       void error(Assembler*, char*, ...); // Report at the current line     **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include "Image.h"
+#include "Memory.h"
+#include "Instruction.h"
+#include "Symbol.h"
+
+
+#define SYMBOL_LABEL	0
+#define SYMBOL_CONST	1
+
+// One symbol, the name points into the source
+typedef struct
+{
+	const char *name;			// NULL for an empty slot
+	int length;
+	int value;
+	int kind;					// SYMBOL_*
+} Entry;
+
+// State of the assembly
+typedef struct
+{
+	const char *path;
+	char *source;				// Whole file, NUL terminated
+	int line;					// Line being assembled
+	int pass;					// 1: place labels, 2: emit
+	int address;				// Where the next word goes
+	int errors;
+
+	Entry *table;				// Open addressing, power of two slots
+	int slots, used;
+
+	PageTable *memory;			// Pass 2 output
+	unsigned char *loaded;
+	FILE *text;					// Text format output, NULL for a binary image
+	int textNext;				// Address the text output continues at
+} Assembler;
+
+
+// Function declare
+static int assemble(Assembler *a, int pass);
+static void statement(Assembler *a, char *p, char *end);
+static int expression(Assembler *a, char **p, char *end, long long *value);
+static int term(Assembler *a, char **p, char *end, long long *value);
+static Entry *lookup(Assembler *a, const char *name, int length);
+static Entry *define(Assembler *a, const char *name, int length, int value, int kind);
+static void emit(Assembler *a, int word, const char *label, int labelLength, const char *note, int noteLength);
+static void error(Assembler *a, const char *format, ...);
+
+
+#define MAX_ERRORS		20
+#define USAGE			"Usage: %s [-b] [-m size,system] [-o output] [-s symbols] program.asm\n"
+
+#define IS_NAME_START(c) (isalpha((unsigned char)(c)) || (c) == '_')
+#define IS_NAME(c)       (isalnum((unsigned char)(c)) || (c) == '_')
+#define SKIP_SPACE(p, end) while((p) < (end) && (*(p) == ' ' || *(p) == '\t' || *(p) == '\r')) (p)++
+
+// Value of an expression that names a symbol not defined yet, pass 1 only
+#define UNRESOLVED		LLONG_MIN
+
+
+int main(int argc, char *argv[])
+{
+	int size = MEMORY_SIZE, system = SYSTEM_ADDRESS;
+	int binary = 0;
+	const char *output = NULL, *symbols = NULL;
+	int opt;
+
+	while((opt = getopt(argc, argv, "bm:o:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b':
+				binary = 1;
+				break;
+
+			case 'm':
+				if(sscanf(optarg, "%d,%d", &size, &system) != 2 || size <= 0
+				   || size > MEMORY_MAX_SIZE || system <= 0 || system >= size)
+				{
+					printf("Invalid memory layout: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case 'o':
+				output = optarg;
+				break;
+
+			case 's':
+				symbols = optarg;
+				break;
+
+			default:
+				printf(USAGE, argv[0]);
+				exit(1);
+		}
+	}
+	if(argc - optind != 1)
+	{
+		printf(USAGE, argv[0]);
+		exit(1);
+	}
+
+	Assembler a;
+	memset(&a, 0, sizeof(a));
+	a.path = argv[optind];
+
+	// Default output: the source name with .txt or .img
+	char name[512];
+	if(output == NULL)
+	{
+		const char *dot = strrchr(a.path, '.');
+		int stem = (dot != NULL && strchr(dot, '/') == NULL) ? (int)(dot - a.path) : (int)strlen(a.path);
+		snprintf(name, sizeof(name), "%.*s%s", stem, a.path, binary ? ".img" : ".txt");
+		output = name;
+	}
+
+	// Whole source in memory, names in the symbol table point into it
+	FILE *fp = fopen(a.path, "rb");
+	if(fp == NULL)
+	{
+		printf("Error! File does not exist: %s\n", a.path);
+		exit(1);
+	}
+	fseek(fp, 0, SEEK_END);
+	long length = ftell(fp);
+	rewind(fp);
+	a.source = malloc(length + 1);
+	a.slots = 1024;
+	a.table = calloc(a.slots, sizeof(Entry));
+	a.memory = pageCreate(size, 0);
+	a.loaded = calloc(size, 1);
+	if(a.source == NULL || a.table == NULL || a.memory == NULL || a.loaded == NULL)
+	{
+		printf("Out of memory\n");
+		exit(1);
+	}
+	if(fread(a.source, 1, length, fp) != (size_t)length)
+	{
+		printf("Error! Can not read %s\n", a.path);
+		exit(1);
+	}
+	a.source[length] = '\0';
+	fclose(fp);
+
+	if(!binary && (a.text = fopen(output, "w")) == NULL)
+	{
+		printf("Error! Can not write %s\n", output);
+		exit(1);
+	}
+	if(assemble(&a, 1) != 0 || assemble(&a, 2) != 0)
+	{
+		if(a.text != NULL)
+			fclose(a.text);
+		remove(output);
+		exit(1);
+	}
+
+	int segments = 0;
+	if(binary)
+		segments = imageWrite(a.memory, a.loaded, system, output);
+	else if(fclose(a.text) != 0)
+		segments = -1;
+	if(segments < 0)
+	{
+		printf("Error! Can not write %s\n", output);
+		remove(output);
+		exit(1);
+	}
+
+	// Labels only, constants are not addresses
+	int i, count = 0, words = 0;
+	Symbol *list = malloc((a.used + 1) * sizeof(Symbol));
+	if(list == NULL)
+	{
+		printf("Out of memory\n");
+		exit(1);
+	}
+	for(i = 0; i < a.slots; i++)
+	{
+		Entry *e = &a.table[i];
+		if(e->name == NULL || e->kind != SYMBOL_LABEL)
+			continue;
+		list[count].address = e->value;
+		list[count++].name = strndup(e->name, e->length);
+	}
+	if(symbols != NULL)
+	{
+		FILE *sp = fopen(symbols, "w");
+		if(sp == NULL || symbolWrite(sp, list, count) != 0 || fclose(sp) != 0)
+		{
+			printf("Error! Can not write %s\n", symbols);
+			exit(1);
+		}
+	}
+
+	for(i = 0; i < size; i++)
+		words += a.loaded[i];
+	printf("%s: %d words, %d labels\n", output, words, count);
+	exit(0);
+}
+
+
+/****************************************************************
+* Func:   Run one pass over the source                          *
+* Param:  Assembler *a: the assembly                            *
+*         int pass: 1 places labels, 2 emits words              *
+* Return: int: 0 on success, -1 if any line had an error        *
+*****************************************************************/
+int assemble(Assembler *a, int pass)
+{
+	char *p = a->source;
+
+	a->pass = pass;
+	a->line = 0;
+	a->address = 0;
+	a->textNext = 0;
+	while(*p != '\0' && a->errors < MAX_ERRORS)
+	{
+		char *end = strchr(p, '\n');
+		if(end == NULL)
+			end = p + strlen(p);
+		a->line++;
+		statement(a, p, end);
+		p = (*end == '\n') ? end + 1 : end;
+	}
+	if(a->errors >= MAX_ERRORS)
+		printf("%s: too many errors\n", a->path);
+	return (a->errors > 0) ? -1 : 0;
+}
+
+/****************************************************************
+* Func:   Assemble one line: labels, then a constant, directive *
+*         or instruction, then a comment                        *
+* Param:  Assembler *a: the assembly                            *
+*         char *p: start of the line                            *
+*         char *end: end of the line, '\n' or NUL               *
+* Return: none, errors are reported and counted                 *
+*****************************************************************/
+void statement(Assembler *a, char *p, char *end)
+{
+	const char *label = NULL;
+	int labelLength = 0;
+	long long value;
+
+	while(1)
+	{
+		SKIP_SPACE(p, end);
+		if(p == end || *p == ';' || (*p == '/' && p + 1 < end && p[1] == '/'))
+			return;					// Empty, or only labels and a comment
+
+		if(*p == '.')
+		{
+			// Directive
+			char *name = ++p;
+			while(p < end && IS_NAME(*p))
+				p++;
+			int length = p - name;
+			SKIP_SPACE(p, end);
+
+			if(length > 0 && isdigit((unsigned char)*name))
+			{
+				// .NNN, as in the text format
+				p = name;
+				if(expression(a, &p, end, &value) != 0)
+					return;
+				a->address = value;
+			}
+			else if(length == 3 && strncasecmp(name, "org", 3) == 0)
+			{
+				if(expression(a, &p, end, &value) != 0)
+					return;
+				if(value == UNRESOLVED)
+				{
+					error(a, ".org needs symbols defined above it");
+					return;
+				}
+				a->address = value;
+			}
+			else if(length == 3 && strncasecmp(name, "equ", 3) == 0)
+			{
+				char *constant = p;
+				while(p < end && IS_NAME(*p))
+					p++;
+				int constantLength = p - constant;
+				SKIP_SPACE(p, end);
+				if(constantLength == 0 || !IS_NAME_START(*constant) || p == end || *p != ',')
+				{
+					error(a, ".equ needs a name and a value");
+					return;
+				}
+				p++;
+				if(expression(a, &p, end, &value) != 0)
+					return;
+				if(value == UNRESOLVED)
+				{
+					error(a, "constant needs symbols defined above it");
+					return;
+				}
+				if(a->pass == 1)
+					define(a, constant, constantLength, value, SYMBOL_CONST);
+			}
+			else if(length == 4 && strncasecmp(name, "word", 4) == 0)
+			{
+				do{
+					SKIP_SPACE(p, end);
+					char *item = p;
+					if(expression(a, &p, end, &value) != 0)
+						return;
+					char *itemEnd = p;
+					while(itemEnd > item && (itemEnd[-1] == ' ' || itemEnd[-1] == '\t'))
+						itemEnd--;
+					emit(a, value, label, labelLength, item, itemEnd - item);
+					label = NULL;
+					SKIP_SPACE(p, end);
+				}while(p < end && *p == ',' && p++);
+			}
+			else if(length == 5 && strncasecmp(name, "ascii", 5) == 0)
+			{
+				if(p == end || *p != '"')
+				{
+					error(a, ".ascii needs a string in double quotes");
+					return;
+				}
+				for(p++; p < end && *p != '"'; p++)
+				{
+					int c = (unsigned char)*p;
+					if(c == '\\' && p + 1 < end)
+					{
+						switch(*++p)
+						{
+							case 'n': c = '\n'; break;
+							case 't': c = '\t'; break;
+							case 'r': c = '\r'; break;
+							case '0': c = '\0'; break;
+							default:  c = (unsigned char)*p; break;
+						}
+					}
+					emit(a, c, label, labelLength, p, 1);
+					label = NULL;
+				}
+				if(p == end)
+				{
+					error(a, "string is not closed");
+					return;
+				}
+				p++;
+			}
+			else if(length == 5 && strncasecmp(name, "space", 5) == 0)
+			{
+				if(expression(a, &p, end, &value) != 0)
+					return;
+				if(value == UNRESOLVED || value < 0)
+				{
+					error(a, ".space needs a count of 0 or more, defined above it");
+					return;
+				}
+				a->address += value;
+			}
+			else
+			{
+				error(a, "unknown directive .%.*s", length, name);
+				return;
+			}
+			break;
+		}
+
+		if(!IS_NAME_START(*p))
+		{
+			error(a, "unexpected '%c'", *p);
+			return;
+		}
+		char *name = p;
+		while(p < end && IS_NAME(*p))
+			p++;
+		int length = p - name;
+		char *after = p;
+		SKIP_SPACE(p, end);
+
+		if(p < end && *p == ':')
+		{
+			// Label, a statement may follow on the same line
+			if(a->pass == 1)
+				define(a, name, length, a->address, SYMBOL_LABEL);
+			label = name;
+			labelLength = length;
+			p++;
+			continue;
+		}
+		if(p < end && *p == '=')
+		{
+			// Constant
+			p++;
+			if(expression(a, &p, end, &value) != 0)
+				return;
+			if(value == UNRESOLVED)
+			{
+				error(a, "constant needs symbols defined above it");
+				return;
+			}
+			if(a->pass == 1)
+				define(a, name, length, value, SYMBOL_CONST);
+			break;
+		}
+
+		// Instruction: names of Instruction.c, any case
+		int opcode;
+		for(opcode = 1; opcode <= END; opcode++)
+		{
+			const char *mnemonic = instructionName(opcode);
+			if(mnemonic != NULL && (int)strlen(mnemonic) == length && strncasecmp(mnemonic, name, length) == 0)
+				break;
+		}
+		if(opcode > END)
+		{
+			error(a, "unknown instruction %.*s", length, name);
+			return;
+		}
+		if(!HAS_OPERAND(opcode))
+		{
+			emit(a, opcode, label, labelLength, name, after - name);
+			break;
+		}
+		char *operand = p;
+		if(expression(a, &p, end, &value) != 0)
+			return;
+		char *operandEnd = p;
+		while(operandEnd > operand && (operandEnd[-1] == ' ' || operandEnd[-1] == '\t'))
+			operandEnd--;
+		emit(a, opcode, label, labelLength, name, operandEnd - name);
+		emit(a, value, NULL, 0, NULL, 0);
+		break;
+	}
+
+	SKIP_SPACE(p, end);
+	if(p < end && *p != ';' && !(*p == '/' && p + 1 < end && p[1] == '/'))
+		error(a, "unexpected text after the statement: %.*s", (int)(end - p), p);
+}
+
+/****************************************************************
+* Func:   Evaluate an expression: terms joined by + and -       *
+* Param:  Assembler *a: the assembly                            *
+*         char **p: cursor, moved past the expression           *
+*         char *end: end of the line                            *
+*         long long *value: the value, UNRESOLVED in pass 1 if  *
+*                           a symbol is not defined yet         *
+* Return: int: 0 on success, -1 after reporting an error        *
+*****************************************************************/
+int expression(Assembler *a, char **p, char *end, long long *value)
+{
+	long long sum, next;
+	int sign = 1;
+
+	SKIP_SPACE(*p, end);
+	if(*p < end && (**p == '-' || **p == '+'))
+	{
+		sign = (**p == '-') ? -1 : 1;
+		(*p)++;
+	}
+	if(term(a, p, end, &sum) != 0)
+		return -1;
+	if(sum != UNRESOLVED)
+		sum *= sign;
+
+	while(1)
+	{
+		SKIP_SPACE(*p, end);
+		if(*p == end || (**p != '+' && **p != '-'))
+			break;
+		sign = (**p == '-') ? -1 : 1;
+		(*p)++;
+		if(term(a, p, end, &next) != 0)
+			return -1;
+		if(sum == UNRESOLVED || next == UNRESOLVED)
+			sum = UNRESOLVED;
+		else
+			sum += sign * next;
+		if(sum != UNRESOLVED && (sum > INT_MAX || sum < INT_MIN))
+		{
+			error(a, "value out of range");
+			return -1;
+		}
+	}
+	*value = sum;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Evaluate one term: number, 'c', symbol, $ or a        *
+*         parenthesised expression                              *
+* Param:  Assembler *a: the assembly                            *
+*         char **p: cursor, moved past the term                 *
+*         char *end: end of the line                            *
+*         long long *value: the value, or UNRESOLVED            *
+* Return: int: 0 on success, -1 after reporting an error        *
+*****************************************************************/
+int term(Assembler *a, char **p, char *end, long long *value)
+{
+	char *s = *p;
+
+	SKIP_SPACE(s, end);
+	if(s == end)
+	{
+		error(a, "missing value");
+		return -1;
+	}
+	if(isdigit((unsigned char)*s))
+	{
+		int base = 10;
+		long long v = 0;
+		if(s[0] == '0' && s + 1 < end && (s[1] == 'x' || s[1] == 'X'))
+		{
+			base = 16;
+			s += 2;
+		}
+		char *start = s;
+		while(s < end && isxdigit((unsigned char)*s) && (base == 16 || isdigit((unsigned char)*s)))
+		{
+			v = v * base + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+			if(v > (long long)INT_MAX + 1)
+			{
+				error(a, "number too large");
+				return -1;
+			}
+			s++;
+		}
+		if(s == start || (s < end && IS_NAME(*s)))
+		{
+			error(a, "bad number");
+			return -1;
+		}
+		*value = v;
+	}
+	else if(*s == '\'')
+	{
+		if(s + 2 < end && s[1] == '\\' && s + 3 < end && s[3] == '\'')
+		{
+			switch(s[2])
+			{
+				case 'n': *value = '\n'; break;
+				case 't': *value = '\t'; break;
+				case 'r': *value = '\r'; break;
+				case '0': *value = '\0'; break;
+				default:  *value = (unsigned char)s[2]; break;
+			}
+			s += 4;
+		}
+		else if(s + 2 < end && s[2] == '\'')
+		{
+			*value = (unsigned char)s[1];
+			s += 3;
+		}
+		else
+		{
+			error(a, "bad character constant");
+			return -1;
+		}
+	}
+	else if(*s == '$')
+	{
+		*value = a->address;
+		s++;
+	}
+	else if(*s == '(')
+	{
+		s++;
+		if(expression(a, &s, end, value) != 0)
+			return -1;
+		SKIP_SPACE(s, end);
+		if(s == end || *s != ')')
+		{
+			error(a, "missing ')'");
+			return -1;
+		}
+		s++;
+	}
+	else if(IS_NAME_START(*s))
+	{
+		char *name = s;
+		while(s < end && IS_NAME(*s))
+			s++;
+		Entry *e = lookup(a, name, s - name);
+		if(e != NULL)
+			*value = e->value;
+		else if(a->pass == 1)
+			*value = UNRESOLVED;	// Maybe defined further down
+		else
+		{
+			error(a, "undefined symbol %.*s", (int)(s - name), name);
+			return -1;
+		}
+	}
+	else
+	{
+		error(a, "unexpected '%c'", *s);
+		return -1;
+	}
+	*p = s;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Find a symbol                                         *
+* Param:  Assembler *a: the assembly                            *
+*         char *name: the name, not NUL terminated              *
+*         int length: length of the name                        *
+* Return: Entry*: the symbol, NULL if not defined               *
+*****************************************************************/
+Entry *lookup(Assembler *a, const char *name, int length)
+{
+	unsigned hash = 2166136261u;	// FNV-1a
+	int i;
+
+	for(i = 0; i < length; i++)
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	for(i = hash & (a->slots - 1); a->table[i].name != NULL; i = (i + 1) & (a->slots - 1))
+		if(a->table[i].length == length && memcmp(a->table[i].name, name, length) == 0)
+			return &a->table[i];
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Define a symbol in pass 1                             *
+* Param:  Assembler *a: the assembly                            *
+*         char *name: the name, not NUL terminated              *
+*         int length: length of the name                        *
+*         int value: address or constant                        *
+*         int kind: SYMBOL_*                                    *
+* Return: Entry*: the symbol, NULL after reporting an error     *
+*****************************************************************/
+Entry *define(Assembler *a, const char *name, int length, int value, int kind)
+{
+	int i;
+
+	if(lookup(a, name, length) != NULL)
+	{
+		error(a, "%.*s is defined twice", length, name);
+		return NULL;
+	}
+
+	// Grow at half full so probes stay short
+	if(2 * (a->used + 1) > a->slots)
+	{
+		Entry *old = a->table;
+		int slots = a->slots;
+		a->slots *= 2;
+		a->table = calloc(a->slots, sizeof(Entry));
+		if(a->table == NULL)
+		{
+			printf("Out of memory\n");
+			exit(1);
+		}
+		a->used = 0;
+		for(i = 0; i < slots; i++)
+			if(old[i].name != NULL)
+				define(a, old[i].name, old[i].length, old[i].value, old[i].kind);
+		free(old);
+	}
+
+	unsigned hash = 2166136261u;
+	for(i = 0; i < length; i++)
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	for(i = hash & (a->slots - 1); a->table[i].name != NULL; i = (i + 1) & (a->slots - 1));
+	Entry *e = &a->table[i];
+	e->name = name;
+	e->length = length;
+	e->value = value;
+	e->kind = kind;
+	a->used++;
+	return e;
+}
+
+/****************************************************************
+* Func:   Place one word at the current address; pass 2 stores  *
+*         it and writes it to the text output                   *
+* Param:  Assembler *a: the assembly                            *
+*         int word: the word                                    *
+*         char *label: label of the statement, or NULL          *
+*         int labelLength: length of the label                  *
+*         char *note: source text for the comment, or NULL      *
+*         int noteLength: length of the note                    *
+* Return: none, errors are reported and counted                 *
+*****************************************************************/
+void emit(Assembler *a, int word, const char *label, int labelLength, const char *note, int noteLength)
+{
+	int addr = a->address++;
+
+	if(a->pass == 1)
+		return;
+	if(addr < 0 || addr >= a->memory->size)
+	{
+		error(a, "address %d outside memory", addr);
+		return;
+	}
+	if(a->loaded[addr])
+	{
+		error(a, "address %d is written twice", addr);
+		return;
+	}
+	PAGE_STORE(a->memory, addr, word);
+	a->loaded[addr] = 1;
+	if(a->text == NULL)
+		return;
+
+	if(word < 0)
+	{
+		error(a, "%d can not be written in the text format, use -b", word);
+		return;
+	}
+	if(addr != a->textNext)
+		fprintf(a->text, ".%d\n", addr);
+	a->textNext = addr + 1;
+	if(note == NULL)
+		fprintf(a->text, "%d\n", word);
+	else if(label != NULL)
+		fprintf(a->text, "%-8d// %.*s: %.*s\n", word, labelLength, label, noteLength, note);
+	else
+		fprintf(a->text, "%-8d// %.*s\n", word, noteLength, note);
+}
+
+/****************************************************************
+* Func:   Report an error at the current line                   *
+* Param:  Assembler *a: the assembly                            *
+*         char *format: printf() format of the message          *
+* Return: none                                                  *
+*****************************************************************/
+void error(Assembler *a, const char *format, ...)
+{
+	va_list args;
+
+	printf("%s:%d: ", a->path, a->line);
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+	a->errors++;
+}
@@ -0,0 +1,331 @@
+/********************************************************************************
+*********************************************************************************
+**  Run many programs in parallel                                              **
+**  Jobs of a manifest are split over per-thread queues; a thread that runs    **
+**  out of work steals from the tail of another queue. Each job gets its own   **
+**  Machine and its own output buffer, so threads share nothing mutable        **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int runBatch(char*, int, int, char*, Layout*); // Run manifest        **
+**    - Internal:                                                              **
+**       int readManifest(char*, Job**);  // Parse manifest into jobs          **
+**       void *worker(void*);             // Thread: take or steal jobs        **
+**       int takeJob(Pool*, int);         // Next job of own queue, or steal   **
+**       void runJob(Job*, Pool*);        // Run one program to End            **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "Batch.h"
+#include "CPU.h"
+#include "Output.h"
+
+
+// One program of the manifest
+typedef struct
+{
+	char file[256];			// Program file
+	int timer;				// Timer period, 0 for default
+	unsigned long long seed;	// Seed of the Get device
+	char *output;			// Everything the program printed
+	size_t length;
+	int status;				// MACHINE_*, -1 if the file could not be loaded
+	long long instructions;	// Instructions executed
+} Job;
+
+// Jobs [head, tail) of one thread, the owner takes from head, thieves from tail
+typedef struct
+{
+	pthread_mutex_t lock;
+	int head, tail;
+} Queue;
+
+// Shared by all threads, read-only while they run except for the queues
+typedef struct
+{
+	Job *jobs;
+	Queue *queues;
+	int threads;
+	int engine;
+	Layout layout;			// Memory layout of every machine
+} Pool;
+
+// Argument of one worker thread
+typedef struct
+{
+	Pool *pool;
+	int self;				// Index of own queue
+} Worker;
+
+
+// Function declare
+static int readManifest(const char *manifest, Job **jobs);
+static void *worker(void *arg);
+static int takeJob(Pool *pool, int self);
+static void runJob(Job *job, const Pool *pool);
+
+
+#define LINE_BUFFER_SIZE 512   // Max size for each line of the manifest
+
+
+/****************************************************************
+* Func:   Run all jobs of a manifest, write their output, print *
+*         a throughput summary to stderr                        *
+* Param:  char *manifest: the manifest file                     *
+*         int threads: worker threads                           *
+*         int engine: ENGINE_SWITCH, ENGINE_THREADED or         *
+*                     ENGINE_BLOCK                              *
+*         char *outDir: directory for <n>.out files, NULL to    *
+*                       print every output to stdout in order   *
+*         Layout *layout: memory layout, NULL for the default   *
+* Return: int: 0 if every job reached End, 1 otherwise          *
+*****************************************************************/
+int runBatch(const char *manifest, int threads, int engine, const char *outDir, const Layout *layout)
+{
+	Job *jobs;
+	int count = readManifest(manifest, &jobs);
+	if(count == -2)
+	{
+		printf("Out of memory\n");
+		return 1;
+	}
+	if(count < 0)
+	{
+		printf("Error! Can not read manifest %s\n", manifest);
+		return 1;
+	}
+	if(threads < 1)
+		threads = 1;
+	if(threads > BATCH_MAX_THREADS)
+		threads = BATCH_MAX_THREADS;
+
+	// Split jobs into contiguous ranges, one per thread
+	Pool pool = {jobs, calloc(threads, sizeof(Queue)), threads, engine};
+	if(layout != NULL)
+		pool.layout = *layout;
+	else
+		layoutInit(&pool.layout, MEMORY_SIZE, SYSTEM_ADDRESS, INT_ADDRESS);
+	pthread_t tid[BATCH_MAX_THREADS];
+	Worker args[BATCH_MAX_THREADS];
+	int i;
+	for(i = 0; i < threads; i++)
+	{
+		pthread_mutex_init(&pool.queues[i].lock, NULL);
+		pool.queues[i].head = (long)count * i / threads;
+		pool.queues[i].tail = (long)count * (i + 1) / threads;
+	}
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < threads; i++)
+	{
+		args[i].pool = &pool;
+		args[i].self = i;
+		pthread_create(&tid[i], NULL, worker, &args[i]);
+	}
+	for(i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	// Output of every job, in manifest order
+	long long instructions = 0;
+	int failed = 0;
+	for(i = 0; i < count; i++)
+	{
+		Job *job = &jobs[i];
+		instructions += job->instructions;
+		if(job->status != MACHINE_END)
+			failed++;
+
+		if(outDir == NULL)
+		{
+			printf("==> %d: %s <==\n", i, job->file);
+			fwrite(job->output, 1, job->length, stdout);
+			printf("\n");
+			continue;
+		}
+
+		char name[LINE_BUFFER_SIZE];
+		snprintf(name, sizeof(name), "%s/%d.out", outDir, i);
+		FILE *fp = fopen(name, "w");
+		if(fp == NULL)
+		{
+			printf("Error! Can not write %s\n", name);
+			failed += (job->status == MACHINE_END);	// A job fails once
+			continue;
+		}
+		fwrite(job->output, 1, job->length, fp);
+		fclose(fp);
+	}
+	fflush(stdout);
+
+	double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	if(seconds <= 0)
+		seconds = 1e-9;
+	fprintf(stderr, "\nBatch: %d jobs, %d failed, %d threads, %.3f s\n", count, failed, threads, seconds);
+	fprintf(stderr, "  %.1f jobs/s, %lld instructions, %.2f MIPS\n",
+	        count / seconds, instructions, instructions / seconds / 1e6);
+
+	for(i = 0; i < count; i++)
+		free(jobs[i].output);
+	for(i = 0; i < threads; i++)
+		pthread_mutex_destroy(&pool.queues[i].lock);
+	free(pool.queues);
+	free(jobs);
+
+	return failed > 0;
+}
+
+
+/****************************************************************
+* Func:   Parse the manifest                                    *
+* Param:  char *manifest: the manifest file                     *
+*         Job **jobs: set to a new array of jobs                *
+* Return: int: number of jobs, -1 if the file can not be read,  *
+*              -2 if out of memory                              *
+*****************************************************************/
+int readManifest(const char *manifest, Job **jobs)
+{
+	FILE *fp = fopen(manifest, "r");
+	if(fp == NULL)
+		return -1;
+
+	int count = 0, capacity = 16;
+	*jobs = malloc(capacity * sizeof(Job));
+	if(*jobs == NULL)
+	{
+		fclose(fp);
+		return -2;
+	}
+
+	char buff[LINE_BUFFER_SIZE];
+	while(fgets(buff, sizeof(buff), fp) != NULL)
+	{
+		char *comment = strchr(buff, '#');
+		if(comment != NULL)
+			*comment = '\0';
+
+		Job job;
+		memset(&job, 0, sizeof(job));
+		if(sscanf(buff, "%255s %d %llu", job.file, &job.timer, &job.seed) < 1)
+			continue;           // Blank line
+
+		if(count == capacity)
+		{
+			Job *more = realloc(*jobs, capacity * 2 * sizeof(Job));
+			if(more == NULL)
+			{
+				free(*jobs);
+				fclose(fp);
+				return -2;
+			}
+			capacity *= 2;
+			*jobs = more;
+		}
+		(*jobs)[count++] = job;
+	}
+	fclose(fp);
+	return count;
+}
+
+/****************************************************************
+* Func:   Worker thread: run jobs until every queue is empty    *
+* Param:  void *arg: Worker*                                    *
+* Return: void*: NULL                                           *
+*****************************************************************/
+void *worker(void *arg)
+{
+	Worker *w = arg;
+	int job;
+
+	while((job = takeJob(w->pool, w->self)) >= 0)
+		runJob(&w->pool->jobs[job], w->pool);
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Take the next job of the own queue, steal from the    *
+*         tail of another queue when it is empty                *
+* Param:  Pool *pool: the thread pool                           *
+*         int self: index of own queue                          *
+* Return: int: index of the job, -1 if no work is left          *
+*****************************************************************/
+int takeJob(Pool *pool, int self)
+{
+	int job = -1;
+	int i;
+
+	Queue *q = &pool->queues[self];
+	pthread_mutex_lock(&q->lock);
+	if(q->head < q->tail)
+		job = q->head++;
+	pthread_mutex_unlock(&q->lock);
+	if(job >= 0)
+		return job;
+
+	for(i = 1; i < pool->threads && job < 0; i++)
+	{
+		q = &pool->queues[(self + i) % pool->threads];
+		pthread_mutex_lock(&q->lock);
+		if(q->head < q->tail)
+			job = --q->tail;
+		pthread_mutex_unlock(&q->lock);
+	}
+	return job;
+}
+
+/****************************************************************
+* Func:   Run one program in its own Machine until it finishes  *
+* Param:  Job *job: the job, output and result are stored here  *
+*         Pool *pool: engine and memory layout                  *
+* Return: none                                                  *
+*****************************************************************/
+void runJob(Job *job, const Pool *pool)
+{
+	char text[LINE_BUFFER_SIZE] = "";
+
+	Machine *m = machineCreateLayout(TRANSPORT_LOCAL, &pool->layout);
+	if(m == NULL || machineSetOutput(m, OUTPUT_CAPTURE, NULL) != 0)
+	{
+		job->status = -1;       // Out of memory
+		machineDestroy(m);
+		return;
+	}
+
+	int result = machineLoadFile(m, job->file);
+	if(result != IMAGE_OK)
+	{
+		job->status = -1;
+		if(result == IMAGE_NO_FILE)
+			snprintf(text, sizeof(text), "Error! File does not exist\n");
+		else
+			snprintf(text, sizeof(text), "Error! %s: %s\n", job->file, m->loadError);
+	}
+	else
+	{
+		machineSetTimer(m, job->timer);
+		machineSetEngine(m, pool->engine);
+		machineSetSeed(m, job->seed);
+
+		job->status = machineRun(m);
+		job->instructions = m->instructions;
+
+		// Same messages as the interactive simulator
+		machineStatusText(m, text, sizeof(text));
+	}
+	outputWrite(m->output, text, strlen(text));
+
+	// Keep the text, the capture goes away with the machine
+	const char *captured = outputCaptured(m->output, &job->length);
+	job->output = malloc(job->length);
+	if(job->output == NULL)
+		job->length = 0;
+	else if(job->length > 0)
+		memcpy(job->output, captured, job->length);
+
+	machineDestroy(m);
+}
@@ -0,0 +1,15 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "Machine.h"
+
+// Batch mode: run every job of a manifest on a pool of threads, one
+// in-process Machine per job, nothing mutable is shared between jobs
+//
+// Manifest: one job per line, "file [timer [seed]]", '#' starts a comment
+
+#define BATCH_MAX_THREADS 256
+
+int runBatch(const char *manifest, int threads, int engine, const char *outDir, const Layout *layout);
+
+#endif
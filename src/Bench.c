@@ -0,0 +1,533 @@
+/********************************************************************************
+*********************************************************************************
+**  Benchmark harness                                                          **
+**  Runs every workload of a suite on every execution engine and transport,    **
+**  with warm-up runs and repetitions, and reports MIPS with its spread,       **
+**  system calls per instruction and memory footprint. Each run happens in a   **
+**  fresh child process, so runs do not share caches, pages or engine state    **
+**                                                                             **
+**  Usage: ./simbench [-e engines] [-t transports] [-w warmup] [-r repeat]     **
+**                    [-n instructions] [-l label] [-o results.csv] suite      **
+**         ./simbench -d every [-e engines] [-n instructions] suite            **
+**    -e: comma separated switch,threaded,block, default all                   **
+**    -t: comma separated local,shm,pipe, default all                          **
+**    -w: runs thrown away before measuring, default 1                         **
+**    -r: measured runs, default 5                                             **
+**    -n: instructions per run at most, default 2000000                        **
+**    -l: label of the results, eg a git revision                              **
+**    -o: append one CSV row per workload, engine and transport                **
+**    -d: validate instead of timing: every engine runs beside the generic     **
+**        switch loop and is compared every `every` instructions, see Diff.h   **
+**    suite: one workload per line, "program [timer]", '#' starts a comment;   **
+**           paths are relative to the suite file                              **
+**  Build: make simbench, or gcc -pthread -o simbench Bench.c and every        **
+**         simulator file but Simulator.c, with -lm                            **
+**  Function:                                                                  **
+**    - Internal:                                                              **
+**       int readSuite(char*, Workload**); // Parse the suite                  **
+**       int runOnce(Workload*, int, int, long, Sample*); // One measured run  **
+**       void measure(Workload*, int, int, long, Sample*); // Run in a child   **
+**       long long systemCalls(void);     // Read/write calls so far           **
+**       long statusKb(char*);            // A field of /proc/self/status      **
+**       int parseList(char*, char**, int, int*); // Engine/transport names    **
+**       int validate(Workload*, int, int*, long, long); // Differential runs  **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include "CPU.h"
+#include "Memory.h"
+#include "Output.h"
+#include "Diff.h"
+
+
+// One line of the suite
+typedef struct
+{
+	char file[512];				// Program, relative to the working directory
+	char name[256];				// As written in the suite
+	int timer;
+} Workload;
+
+// Result of one run
+typedef struct
+{
+	int status;					// MACHINE_*, MACHINE_RUNNING if the budget ran out, -1 on failure
+	long long instructions;
+	double seconds;
+	long long calls;			// Read/write system calls of the CPU process
+	long footprint;				// KiB the CPU process grew by
+} Sample;
+
+
+// Function declare
+static int readSuite(const char *suite, Workload **workloads);
+static int runOnce(const Workload *w, int engine, int transport, long budget, Sample *s);
+static void measure(const Workload *w, int engine, int transport, long budget, Sample *s);
+static long long systemCalls(void);
+static long statusKb(const char *field);
+static int parseList(const char *text, const char *const *names, int count, int *chosen);
+static int validate(const Workload *workloads, int count, const int *engines, long every, long budget);
+
+
+#define LINE_BUFFER_SIZE 512
+#define MAX_REPEAT 1000
+
+static const char *const engineName[] = {"switch", "threaded", "block"};
+static const char *const transportName[] = {"local", "shm", "pipe"};
+static const int transportOf[] = {TRANSPORT_LOCAL, TRANSPORT_SHM, TRANSPORT_PIPE};
+
+
+int main(int argc, char *argv[])
+{
+	int engines[3] = {1, 1, 1}, transports[3] = {1, 1, 1};
+	int warmup = 1, repeat = 5;
+	long budget = 2000000;
+	long every = 0;
+	const char *label = "", *csv = NULL;
+	int opt;
+
+	while((opt = getopt(argc, argv, "e:t:w:r:n:l:o:d:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'e':
+				if(parseList(optarg, engineName, 3, engines) != 0)
+				{
+					printf("Unknown engine in: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case 't':
+				if(parseList(optarg, transportName, 3, transports) != 0)
+				{
+					printf("Unknown transport in: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case 'w':
+				warmup = atoi(optarg);
+				break;
+
+			case 'r':
+				repeat = atoi(optarg);
+				break;
+
+			case 'n':
+				budget = atol(optarg);
+				break;
+
+			case 'l':
+				label = optarg;
+				break;
+
+			case 'o':
+				csv = optarg;
+				break;
+
+			case 'd':
+				every = atol(optarg);
+				if(every <= 0)
+				{
+					printf("Invalid comparison step: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			default:
+				printf("Usage: %s [-e engines] [-t transports] [-w warmup] [-r repeat] [-n instructions] [-l label] [-o results.csv] suite\n", argv[0]);
+				printf("       %s -d every [-e engines] [-n instructions] suite\n", argv[0]);
+				exit(1);
+		}
+	}
+	if(argc - optind != 1 || warmup < 0 || repeat < 1 || repeat > MAX_REPEAT || budget <= 0)
+	{
+		printf("Usage: %s [-e engines] [-t transports] [-w warmup] [-r repeat] [-n instructions] [-l label] [-o results.csv] suite\n", argv[0]);
+		exit(1);
+	}
+
+	Workload *workloads;
+	int count = readSuite(argv[optind], &workloads);
+	if(count < 0)
+	{
+		printf("Error! Can not read suite %s\n", argv[optind]);
+		exit(1);
+	}
+	if(every > 0)
+	{
+		int failed = validate(workloads, count, engines, every, budget);
+		free(workloads);
+		exit(failed > 0);
+	}
+
+	// CSV rows are appended, the header only goes into a new file
+	FILE *out = NULL;
+	if(csv != NULL)
+	{
+		struct stat st;
+		int fresh = stat(csv, &st) != 0 || st.st_size == 0;
+		if((out = fopen(csv, "a")) == NULL)
+		{
+			printf("Error! Can not write %s\n", csv);
+			exit(1);
+		}
+		if(fresh)
+			fprintf(out, "label,date,workload,timer,engine,transport,runs,instructions,"
+			        "mips_mean,mips_stddev,mips_min,mips_max,syscalls_per_instruction,footprint_kb,status\n");
+	}
+	char date[32];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	printf("%-16s %7s %-8s %-5s %12s %9s %7s %9s %9s %10s %6s\n", "workload", "timer", "engine",
+	       "mode", "instructions", "MIPS", "+-%", "min", "max", "calls/ins", "KiB");
+	int w, e, t, i, failed = 0;
+	for(w = 0; w < count; w++)
+	for(e = 0; e < 3; e++)
+	for(t = 0; t < 3; t++)
+	{
+		if(!engines[e] || !transports[t])
+			continue;
+
+		Sample s;
+		double mips[MAX_REPEAT], sum = 0, low = 0, high = 0;
+		for(i = 0; i < warmup; i++)
+			measure(&workloads[w], e, transportOf[t], budget, &s);
+		for(i = 0; i < repeat; i++)
+		{
+			measure(&workloads[w], e, transportOf[t], budget, &s);
+			if(s.status < 0)
+				break;
+			mips[i] = s.instructions / s.seconds / 1e6;
+			sum += mips[i];
+			low = (i == 0 || mips[i] < low) ? mips[i] : low;
+			high = (i == 0 || mips[i] > high) ? mips[i] : high;
+		}
+		if(s.status < 0)
+		{
+			printf("%-16s %7d %-8s %-5s failed to run\n", workloads[w].name, workloads[w].timer,
+			       engineName[e], transportName[t]);
+			failed++;
+			continue;
+		}
+
+		// Mean and sample standard deviation over the measured runs
+		double mean = sum / repeat, var = 0;
+		for(i = 0; i < repeat; i++)
+			var += (mips[i] - mean) * (mips[i] - mean);
+		double stddev = (repeat > 1) ? sqrt(var / (repeat - 1)) : 0;
+		double calls = (double)s.calls / s.instructions;
+		const char *status = (s.status == MACHINE_END) ? "end"
+		                     : (s.status == MACHINE_RUNNING) ? "budget"
+		                     : (s.status == MACHINE_FAULT) ? "fault" : "invalid";
+
+		printf("%-16s %7d %-8s %-5s %12lld %9.2f %7.1f %9.2f %9.2f %10.5f %6ld\n", workloads[w].name,
+		       workloads[w].timer, engineName[e], transportName[t], s.instructions, mean,
+		       mean > 0 ? 100 * stddev / mean : 0, low, high, calls, s.footprint);
+		fflush(stdout);
+		if(out != NULL)
+			fprintf(out, "%s,%s,%s,%d,%s,%s,%d,%lld,%.3f,%.3f,%.3f,%.3f,%.6f,%ld,%s\n", label, date,
+			        workloads[w].name, workloads[w].timer, engineName[e], transportName[t], repeat,
+			        s.instructions, mean, stddev, low, high, calls, s.footprint, status);
+	}
+
+	if(out != NULL)
+		fclose(out);
+	free(workloads);
+	exit(failed > 0);
+}
+
+
+/****************************************************************
+* Func:   Parse a suite into workloads                          *
+* Param:  char *suite: the suite file                           *
+*         Workload **workloads: where to store the array        *
+* Return: int: number of workloads, -1 if the file can not be   *
+*              read                                             *
+*****************************************************************/
+int readSuite(const char *suite, Workload **workloads)
+{
+	FILE *fp = fopen(suite, "r");
+	if(fp == NULL)
+		return -1;
+
+	// Programs are relative to the directory of the suite
+	char dir[LINE_BUFFER_SIZE];
+	snprintf(dir, sizeof(dir), "%s", suite);
+	char *slash = strrchr(dir, '/');
+	if(slash != NULL)
+		slash[1] = '\0';
+	else
+		dir[0] = '\0';
+
+	char buff[LINE_BUFFER_SIZE];
+	int count = 0, capacity = 16;
+	Workload *list = malloc(capacity * sizeof(Workload));
+	while(list != NULL && fgets(buff, sizeof(buff), fp) != NULL)
+	{
+		char *comment = strchr(buff, '#');
+		if(comment != NULL)
+			*comment = '\0';
+
+		Workload w;
+		w.timer = 1000;
+		if(sscanf(buff, "%255s %d", w.name, &w.timer) < 1)
+			continue;			// Blank line
+		if(w.name[0] == '/')
+			snprintf(w.file, sizeof(w.file), "%s", w.name);
+		else
+			snprintf(w.file, sizeof(w.file), "%s%s", dir, w.name);
+
+		if(count == capacity)
+		{
+			Workload *bigger = realloc(list, 2 * capacity * sizeof(Workload));
+			if(bigger == NULL)
+				break;
+			list = bigger;
+			capacity *= 2;
+		}
+		list[count++] = w;
+	}
+	fclose(fp);
+
+	*workloads = list;
+	return (list == NULL) ? -1 : count;
+}
+
+/****************************************************************
+* Func:   Run one workload in a child process and collect its   *
+*         sample                                                *
+* Param:  Workload *w: the workload                             *
+*         int engine: ENGINE_*                                  *
+*         int transport: TRANSPORT_*                            *
+*         long budget: instructions at most                     *
+*         Sample *s: where to store the result                  *
+* Return: none, s->status is -1 if the run failed               *
+*****************************************************************/
+void measure(const Workload *w, int engine, int transport, long budget, Sample *s)
+{
+	int fd[2];
+
+	s->status = -1;
+	if(pipe(fd) != 0)
+		return;
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		close(fd[0]);
+		Sample own;
+		if(runOnce(w, engine, transport, budget, &own) != 0)
+			own.status = -1;
+		write(fd[1], &own, sizeof(own));
+		_exit(0);
+	}
+	close(fd[1]);
+	if(pid > 0 && read(fd[0], s, sizeof(*s)) != sizeof(*s))
+		s->status = -1;
+	close(fd[0]);
+	if(pid > 0)
+		waitpid(pid, NULL, 0);
+}
+
+/****************************************************************
+* Func:   One measured run, called in a fresh child process     *
+* Param:  Workload *w: the workload                             *
+*         int engine: ENGINE_*                                  *
+*         int transport: TRANSPORT_*                            *
+*         long budget: instructions at most                     *
+*         Sample *s: where to store the result                  *
+* Return: int: 0 on success, -1 if the run could not be set up  *
+*****************************************************************/
+int runOnce(const Workload *w, int engine, int transport, long budget, Sample *s)
+{
+	// Peak RSS counts from here
+	int fd = open("/proc/self/clear_refs", O_WRONLY);
+	if(fd >= 0)
+	{
+		write(fd, "5", 1);
+		close(fd);
+	}
+	long startKb = statusKb("VmRSS:");
+
+	Machine *m = machineCreate(transport);
+	if(m == NULL || machineLoadFile(m, w->file) != IMAGE_OK)
+		return -1;
+	machineSetOutput(m, OUTPUT_NULL, NULL);
+	machineSetTimer(m, w->timer);
+	machineSetEngine(m, engine);
+	machineSetSeed(m, 1);
+
+	// Memory process, as in Simulator.c; memory is loaded before fork()
+	pid_t pid = -1;
+	if(transport != TRANSPORT_LOCAL)
+	{
+		int rdpd[2], wtpd[2];
+		if(pipe(rdpd) != 0 || pipe(wtpd) != 0 || (pid = fork()) < 0)
+			return -1;
+		if(pid == 0)
+		{
+			close(rdpd[0]);
+			close(wtpd[1]);
+			runMemory(m->memory, transport, rdpd[1], wtpd[0]);
+			_exit(0);
+		}
+		close(rdpd[1]);
+		close(wtpd[0]);
+		machineConnect(m, wtpd[1], rdpd[0]);
+		char ready;
+		if(transport == TRANSPORT_SHM && read(rdpd[0], &ready, 1) != 1)
+			return -1;
+	}
+
+	// Reading the counter costs calls itself, take that off
+	long long before = systemCalls();
+	long long overhead = systemCalls() - before;
+	struct timespec start, stop;
+
+	before = systemCalls();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	s->status = machineRunFor(m, budget);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	s->calls = systemCalls() - before - overhead;
+
+	s->instructions = m->instructions;
+	s->seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	if(s->seconds <= 0)
+		s->seconds = 1e-9;
+	s->footprint = statusKb("VmHWM:") - startKb;
+
+	endMemory(m);
+	if(pid > 0)
+		waitpid(pid, NULL, 0);
+	machineDestroy(m);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Count the read and write system calls of this process *
+* Param:  none                                                  *
+* Return: long long: syscr + syscw of /proc/self/io, 0 if it    *
+*                    can not be read                            *
+*****************************************************************/
+long long systemCalls(void)
+{
+	char buff[LINE_BUFFER_SIZE];
+	long long calls = 0, value;
+
+	int fd = open("/proc/self/io", O_RDONLY);
+	if(fd < 0)
+		return 0;
+	ssize_t n = read(fd, buff, sizeof(buff) - 1);
+	close(fd);
+	if(n <= 0)
+		return 0;
+	buff[n] = '\0';
+
+	char *field = strstr(buff, "syscr:");
+	if(field != NULL && sscanf(field, "syscr: %lld", &value) == 1)
+		calls += value;
+	field = strstr(buff, "syscw:");
+	if(field != NULL && sscanf(field, "syscw: %lld", &value) == 1)
+		calls += value;
+	return calls;
+}
+
+/****************************************************************
+* Func:   Read a size field of /proc/self/status                *
+* Param:  char *field: eg "VmRSS:"                              *
+* Return: long: the size in KiB, 0 if not found                 *
+*****************************************************************/
+long statusKb(const char *field)
+{
+	char buff[LINE_BUFFER_SIZE];
+	long kb = 0;
+	size_t length = strlen(field);
+
+	FILE *fp = fopen("/proc/self/status", "r");
+	if(fp == NULL)
+		return 0;
+	while(fgets(buff, sizeof(buff), fp) != NULL)
+		if(strncmp(buff, field, length) == 0)
+		{
+			sscanf(buff + length, "%ld", &kb);
+			break;
+		}
+	fclose(fp);
+	return kb;
+}
+
+/****************************************************************
+* Func:   Pick names out of a comma separated list              *
+* Param:  char *text: eg "switch,block"                         *
+*         char **names: the names that may appear               *
+*         int count: number of names                            *
+*         int *chosen: set to 1 for each name in text, else 0   *
+* Return: int: 0 on success, -1 for an unknown name             *
+*****************************************************************/
+int parseList(const char *text, const char *const *names, int count, int *chosen)
+{
+	char buff[LINE_BUFFER_SIZE];
+	int i;
+
+	snprintf(buff, sizeof(buff), "%s", text);
+	for(i = 0; i < count; i++)
+		chosen[i] = 0;
+
+	char *item;
+	for(item = strtok(buff, ","); item != NULL; item = strtok(NULL, ","))
+	{
+		for(i = 0; i < count && strcmp(item, names[i]) != 0; i++);
+		if(i == count)
+			return -1;
+		chosen[i] = 1;
+	}
+	return 0;
+}
+
+/****************************************************************
+* Func:   Run every workload on every chosen engine beside the  *
+*         generic switch loop and compare them, see Diff.h      *
+* Param:  Workload *workloads: the suite                        *
+*         int count: number of workloads                        *
+*         int *engines: 1 per chosen engine                     *
+*         long every: instructions between comparisons          *
+*         long budget: instructions per run at most             *
+* Return: int: runs that diverged or could not be set up        *
+*****************************************************************/
+int validate(const Workload *workloads, int count, const int *engines, long every, long budget)
+{
+	Layout layout;
+	int w, e, failed = 0;
+
+	layoutInit(&layout, MEMORY_SIZE, SYSTEM_ADDRESS, INT_ADDRESS);
+	printf("%-16s %7s %-8s %12s %9s %s\n", "workload", "timer", "engine", "instructions", "checks", "result");
+	for(w = 0; w < count; w++)
+	for(e = ENGINE_SWITCH; e <= ENGINE_BLOCK; e++)
+	{
+		if(!engines[e])
+			continue;
+
+		DiffResult result;
+		int status = diffRun(workloads[w].file, &layout, workloads[w].timer, 1, e, 0, every, budget, &result);
+		printf("%-16s %7d %-8s %12lld %9lld %s\n", workloads[w].name, workloads[w].timer, engineName[e],
+		       result.instructions, result.checks,
+		       (status == DIFF_SAME) ? "same" : (status == DIFF_DIVERGED) ? "DIVERGED" : "failed to run");
+		if(status == DIFF_DIVERGED)
+			diffReport(workloads[w].name, e, &result, stdout);
+		fflush(stdout);
+		failed += (status != DIFF_SAME);
+	}
+	return failed;
+}
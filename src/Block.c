@@ -0,0 +1,715 @@
+/********************************************************************************
+*********************************************************************************
+**  Simulate CPU with translated basic blocks                                  **
+**  A straight-line block ends at Jump*, Call, Ret, Int, IRet or End; common   **
+**  opcode sequences inside it are fused into superinstructions, and the       **
+**  block runs as one unit while the timer still counts every instruction      **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       long runBlock(Machine*, long);   // Run up to a number of instr.      **
+**       void blockInvalidate(Machine*, int); // Drop blocks after code write  **
+**       void blockFree(Machine*);        // Free translated blocks            **
+**    - Internal:                                                              **
+**       void translate(Machine*, int, void**); // Build block starting at PC  **
+**       void flushBlocks(BlockState*);   // Drop every block                  **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Profile.h"
+#include "Verify.h"
+
+
+// One operation of a block: an instruction or a fused superinstruction
+typedef struct
+{
+	void *handler;		// Address of handler label
+	int operand;		// Operand of the first instruction
+	int operand2;		// Operand of the second instruction, if fused
+	int pc;				// Address of the instruction after this op
+	int count;			// Instructions of the block done when this op finishes
+} Op;
+
+// Translated basic block, indexed by its entry address
+typedef struct
+{
+	int gen;			// Valid only while gen == codeGen
+	int first;			// Index of first op in opPool
+	int count;			// Instructions in the block, 0 if none could be translated
+	int end;			// Address after the last word of the block
+#ifdef PROFILE
+	int instr;			// Index of first instruction in instrOp/instrPc
+#endif
+} Block;
+
+// Opcode sequence fused into one superinstruction
+typedef struct
+{
+	int kind;			// FUSE_*
+	int length;
+	int opcode[3];
+} Pattern;
+
+
+#define MAX_OPCODE		END
+#define MAX_BLOCK		64			// Max instructions per block
+#define OP_POOL_SIZE	16384		// Ops of all blocks together
+#define INSTR_POOL_SIZE	(3 * OP_POOL_SIZE)	// An op covers at most 3 instructions
+
+// Per-machine engine state
+typedef struct BlockState
+{
+	Op opPool[OP_POOL_SIZE];
+	int opUsed;
+	int codeGen;						// Bumped when blocks are dropped
+	int size;							// Words of memory
+	Block *blockAt;						// One per word, calloc() leaves untouched pages unbacked
+	unsigned char *isCode;				// Word belongs to a translated block
+	int codeLow, codeHigh;				// isCode[] may be set only in this range
+#ifdef PROFILE
+	unsigned char instrOp[INSTR_POOL_SIZE];	// Opcode and address of every instruction,
+	int instrPc[INSTR_POOL_SIZE];			// blocks run as a unit are counted per instruction
+	int instrUsed;
+#endif
+} BlockState;
+
+
+// Function declare
+static void translate(Machine *m, int pc, void **table);
+static void flushBlocks(BlockState *s);
+
+// Handler kinds beyond the single-instruction ones, which use the opcode
+#define FUSE_LOAD_PUT		(MAX_OPCODE + 1)	// Load value; Put port
+#define FUSE_X_INC			(MAX_OPCODE + 2)	// CopyToX; IncX; CopyFromX
+#define FUSE_X_DEC			(MAX_OPCODE + 3)	// CopyToX; DecX; CopyFromX
+#define FUSE_IDX_PUT_INC	(MAX_OPCODE + 4)	// LoadIdxX addr; Put port; IncX
+#define FUSE_PUT_INC		(MAX_OPCODE + 5)	// Put port; IncX
+#define FUSE_INC_FROM		(MAX_OPCODE + 6)	// IncX; CopyFromX
+#define FUSE_DEC_FROM		(MAX_OPCODE + 7)	// DecX; CopyFromX
+#define FUSE_LOAD_TO_X		(MAX_OPCODE + 8)	// Load value; CopyToX
+#define FUSE_LOAD_TO_Y		(MAX_OPCODE + 9)	// Load value; CopyToY
+#define FUSE_LOAD_ADD_Y		(MAX_OPCODE + 10)	// Load value; AddY; CopyToY
+#define SAFE_LOAD_ADDR		(MAX_OPCODE + 11)	// LoadAddr the verifier proved in bounds
+#define SAFE_LOAD_IND_ADDR	(MAX_OPCODE + 12)	// LoadInd, first read proved in bounds
+#define FALL_THROUGH		(MAX_OPCODE + 13)	// Block cut before a terminator
+#define HANDLER_COUNT		(MAX_OPCODE + 14)
+
+#define IS_TERMINATOR(op) ((op) == JUMP_ADDR || (op) == JUMP_IF_EQUAL_ADDR           \
+                           || (op) == JUMP_IF_NOT_EQUAL_ADDR || (op) == CALL_ADDR   \
+                           || (op) == RET || (op) == INT || (op) == I_RET || (op) == END)
+
+
+// Longest patterns first
+static const Pattern patterns[] = {
+	{FUSE_IDX_PUT_INC, 3, {LOAD_IDX_X_ADDR, PUT_PORT, INC_X}},
+	{FUSE_X_INC,       3, {COPY_TO_X, INC_X, COPY_FROM_X}},
+	{FUSE_X_DEC,       3, {COPY_TO_X, DEC_X, COPY_FROM_X}},
+	{FUSE_LOAD_ADD_Y,  3, {LOAD_VALUE, ADD_Y, COPY_TO_Y}},
+	{FUSE_LOAD_PUT,    2, {LOAD_VALUE, PUT_PORT}},
+	{FUSE_PUT_INC,     2, {PUT_PORT, INC_X}},
+	{FUSE_INC_FROM,    2, {INC_X, COPY_FROM_X}},
+	{FUSE_DEC_FROM,    2, {DEC_X, COPY_FROM_X}},
+	{FUSE_LOAD_TO_X,   2, {LOAD_VALUE, COPY_TO_X}},
+	{FUSE_LOAD_TO_Y,   2, {LOAD_VALUE, COPY_TO_Y}},
+};
+
+
+/****************************************************************
+* Func:   Drop every translated block                           *
+* Param:  BlockState *s: engine state of the machine            *
+* Return: none                                                  *
+*****************************************************************/
+void flushBlocks(BlockState *s)
+{
+	s->codeGen++;
+	s->opUsed = 0;
+#ifdef PROFILE
+	s->instrUsed = 0;
+#endif
+	if(s->codeLow < s->codeHigh)
+		memset(&s->isCode[s->codeLow], 0, s->codeHigh - s->codeLow);	// Not the whole memory
+	s->codeLow = s->size;
+	s->codeHigh = 0;
+}
+
+/****************************************************************
+* Func:   Self-modifying code: drop blocks if addr is code      *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address written                         *
+* Return: none                                                  *
+*****************************************************************/
+void blockInvalidate(Machine *m, int addr)
+{
+	BlockState *s = m->block;
+	if(s != NULL && addr >= 0 && addr < s->size && s->isCode[addr])
+		flushBlocks(s);
+}
+
+/****************************************************************
+* Func:   Free translated blocks, they are rebuilt on the next  *
+*         run                                                   *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void blockFree(Machine *m)
+{
+	if(m->block != NULL)
+	{
+		free(m->block->blockAt);
+		free(m->block->isCode);
+	}
+	free(m->block);
+	m->block = NULL;
+}
+
+/****************************************************************
+* Func:   Translate the basic block starting at pc              *
+* Param:  Machine *m: the machine                               *
+*         int pc: entry address                                 *
+*         void **table: handler label of each kind              *
+* Return: none, blockAt[pc] is valid afterwards                 *
+*                                                               *
+* Words are read ahead only inside the region the current mode  *
+* may access, so translation itself never faults                *
+*****************************************************************/
+void translate(Machine *m, int pc, void **table)
+{
+	BlockState *s = m->block;
+	int opcode[MAX_BLOCK], operand[MAX_BLOCK], next[MAX_BLOCK];
+	int limit = m->limit[(int)m->mode];
+	int n = 0, addr = pc;
+
+	// Decode straight-line instructions up to a terminator
+	while(n < MAX_BLOCK && addr < limit)
+	{
+		int code = readCode(m, addr);
+		if(code <= 0 || code > MAX_OPCODE || table[code] == NULL)
+			break;					// Invalid instruction is left to stepCPU()
+		int length = HAS_OPERAND(code) ? 2 : 1;
+		if(addr + length > limit)
+			break;
+
+		opcode[n] = code;
+		operand[n] = (length == 2) ? readCode(m, addr + 1) : 0;
+		addr += length;
+		next[n] = addr;
+		n++;
+		if(IS_TERMINATOR(code))
+			break;
+	}
+
+	if(s->opUsed + MAX_BLOCK + 1 > OP_POOL_SIZE)
+		flushBlocks(s);
+
+	Block *b = &s->blockAt[pc];
+	b->gen = s->codeGen;
+	b->first = s->opUsed;
+	b->count = n;
+	b->end = addr;
+	if(n == 0)
+		return;
+	memset(&s->isCode[pc], 1, addr - pc);
+#ifdef PROFILE
+	int j;
+	b->instr = s->instrUsed;
+	for(j = 0; j < n; j++)
+	{
+		s->instrOp[s->instrUsed] = opcode[j];
+		s->instrPc[s->instrUsed++] = (j == 0) ? pc : next[j - 1];
+	}
+#endif
+	if(pc < s->codeLow)
+		s->codeLow = pc;
+	if(addr > s->codeHigh)
+		s->codeHigh = addr;
+
+	// Emit ops, fusing the longest matching pattern
+	int i = 0;
+	while(i < n)
+	{
+		int kind = opcode[i], used = 1;
+		int p, k;
+		for(p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+		{
+			if(i + patterns[p].length > n)
+				continue;
+			for(k = 0; k < patterns[p].length && opcode[i + k] == patterns[p].opcode[k]; k++);
+			if(k == patterns[p].length)
+			{
+				kind = patterns[p].kind;
+				used = patterns[p].length;
+				break;
+			}
+		}
+
+		// Verified: the address can not fault, read it without the check
+		int at = (i == 0) ? pc : next[i - 1];
+		if(used == 1 && m->transport != TRANSPORT_PIPE && VERIFIED_SAFE(m, at))
+		{
+			if(kind == LOAD_ADDR)
+				kind = SAFE_LOAD_ADDR;
+			else if(kind == LOAD_IND_ADDR)
+				kind = SAFE_LOAD_IND_ADDR;
+		}
+
+		Op *op = &s->opPool[s->opUsed++];
+		op->handler = table[kind];
+		op->operand = operand[i];
+		op->operand2 = (used > 1) ? operand[i + 1] : 0;
+		op->pc = next[i + used - 1];
+		op->count = i + used;
+		i += used;
+	}
+
+	// Block cut by size or by an invalid instruction: continue at next word
+	if(!IS_TERMINATOR(opcode[n - 1]))
+	{
+		Op *op = &s->opPool[s->opUsed++];
+		op->handler = table[FALL_THROUGH];
+		op->pc = addr;
+		op->count = n;
+	}
+}
+
+/****************************************************************
+* Func:   Run the program with translated blocks, same          *
+*         semantics as the fetch/execute loop in stepCPU()      *
+* Param:  Machine *m: the machine                               *
+*         long limit: most instructions to run                  *
+* Return: long: instructions executed, stops early at End       *
+*                                                               *
+* A block runs as one unit only if neither the timer nor the    *
+* budget can run out inside it; otherwise stepCPU() runs        *
+* single instructions up to the deadline                        *
+*****************************************************************/
+long runBlock(Machine *m, long limit)
+{
+	static void *table[HANDLER_COUNT] = {
+		[LOAD_VALUE]             = &&load_value,
+		[LOAD_ADDR]              = &&load_addr,
+		[LOAD_IND_ADDR]          = &&load_ind_addr,
+		[LOAD_IDX_X_ADDR]        = &&load_idx_x_addr,
+		[LOAD_IDX_Y_ADDR]        = &&load_idx_y_addr,
+		[LOAD_SP_X]              = &&load_sp_x,
+		[STORE_ADDR]             = &&store_addr,
+		[GET]                    = &&get,
+		[PUT_PORT]               = &&put_port,
+		[ADD_X]                  = &&add_x,
+		[ADD_Y]                  = &&add_y,
+		[SUB_X]                  = &&sub_x,
+		[SUB_Y]                  = &&sub_y,
+		[COPY_TO_X]              = &&copy_to_x,
+		[COPY_FROM_X]            = &&copy_from_x,
+		[COPY_TO_Y]              = &&copy_to_y,
+		[COPY_FROM_Y]            = &&copy_from_y,
+		[COPY_TO_SP]             = &&copy_to_sp,
+		[COPY_FROM_SP]           = &&copy_from_sp,
+		[JUMP_ADDR]              = &&jump_addr,
+		[JUMP_IF_EQUAL_ADDR]     = &&jump_if_equal_addr,
+		[JUMP_IF_NOT_EQUAL_ADDR] = &&jump_if_not_equal_addr,
+		[CALL_ADDR]              = &&call_addr,
+		[RET]                    = &&ret,
+		[INC_X]                  = &&inc_x,
+		[DEC_X]                  = &&dec_x,
+		[PUSH]                   = &&push,
+		[POP]                    = &&pop,
+		[INT]                    = &&int_,
+		[I_RET]                  = &&i_ret,
+		[COMPARE_SWAP]           = &&compare_swap,
+		[FETCH_ADD]              = &&fetch_add,
+		[GET_PORT]               = &&get_port,
+		[END]                    = &&end,
+		[FUSE_LOAD_PUT]          = &&fuse_load_put,
+		[FUSE_X_INC]             = &&fuse_x_inc,
+		[FUSE_X_DEC]             = &&fuse_x_dec,
+		[FUSE_IDX_PUT_INC]       = &&fuse_idx_put_inc,
+		[FUSE_PUT_INC]           = &&fuse_put_inc,
+		[FUSE_INC_FROM]          = &&fuse_inc_from,
+		[FUSE_DEC_FROM]          = &&fuse_dec_from,
+		[FUSE_LOAD_TO_X]         = &&fuse_load_to_x,
+		[FUSE_LOAD_TO_Y]         = &&fuse_load_to_y,
+		[FUSE_LOAD_ADD_Y]        = &&fuse_load_add_y,
+		[SAFE_LOAD_ADDR]         = &&safe_load_addr,
+		[SAFE_LOAD_IND_ADDR]     = &&safe_load_ind_addr,
+		[FALL_THROUGH]           = &&fall_through,
+	};
+	Block *b;
+	Op *op;
+	int gen;				// codeGen when the running block was entered
+	Boolean startMode;		// Mode the running block was entered in
+	int done;				// Instructions of the running block finished
+	long executed = 0;		// Instructions finished in this call
+
+	if(m->block == NULL)
+	{
+		int size = m->layout.size;
+		m->block = calloc(1, sizeof(BlockState));
+		if(m->block != NULL)
+		{
+			m->block->blockAt = calloc(size, sizeof(Block));
+			m->block->isCode = calloc(size, 1);
+		}
+		if(m->block == NULL || m->block->blockAt == NULL || m->block->isCode == NULL)
+		{
+			printf("Out of memory\n");
+			exit(-1);
+		}
+		m->block->codeGen = 1;
+		m->block->size = size;
+		m->block->codeLow = size;
+	}
+	BlockState *s = m->block;
+	Block *const blockAt = s->blockAt;	// Fixed while the engine runs
+	const unsigned size = s->size;
+	const int system = m->layout.system;
+
+	// Registers live in locals while the engine runs, the machine is
+	// synchronised around interrupt entry, stepCPU() and return
+	int pc = m->PC, sp = m->SP, ac = m->AC, x = m->X, y = m->Y;
+	long long clock = m->irq.clock;
+
+	#define SYNC_OUT()                                                          \
+		do{                                                                     \
+			m->PC = pc; m->SP = sp; m->AC = ac;                                 \
+			m->X = x; m->Y = y; m->irq.clock = clock;                           \
+		}while(0)
+
+	#define SYNC_IN()                                                           \
+		do{                                                                     \
+			pc = m->PC; sp = m->SP; ac = m->AC;                                 \
+			x = m->X; y = m->Y; clock = m->irq.clock;                           \
+		}while(0)
+
+	// Enter kernel mode through the same path as switch(IR)
+	#define ENTER(handler)                                                      \
+		do{                                                                     \
+			m->PC = pc;                                                         \
+			m->SP = sp;                                                         \
+			interrupt(m, handler);                                              \
+			pc = m->PC;                                                         \
+			sp = m->SP;                                                         \
+		}while(0)
+
+	// Next op of the running block
+	#define NEXT_OP()                                                           \
+		do{                                                                     \
+			op++;                                                               \
+			goto *op->handler;                                                  \
+		}while(0)
+
+	// Block finished at a terminator, pc is already set
+	#define DONE()                                                              \
+		do{                                                                     \
+			done = b->count;                                                    \
+			goto block_done;                                                    \
+		}while(0)
+
+	// A write hit translated code: stop after this op, the rest is stale
+	#define CHECK_CODE()                                                        \
+		do{                                                                     \
+			if(gen != s->codeGen)                                               \
+			{                                                                   \
+				pc = op->pc;                                                    \
+				done = op->count;                                               \
+				goto block_done;                                                \
+			}                                                                   \
+		}while(0)
+
+	#define PUT(port) m->put(m->putData, (Boolean)(port), ac)
+
+	// Count the first n instructions of the running block, one by one
+#ifdef PROFILE
+	#define PROFILE_BLOCK(n)                                                    \
+		do{                                                                     \
+			int i_;                                                             \
+			for(i_ = 0; i_ < (n); i_++)                                         \
+				PROFILE_STEP(m, s->instrPc[b->instr + i_], s->instrOp[b->instr + i_], \
+				             startMode == KERNEL_MODE);                         \
+		}while(0)
+#else
+	#define PROFILE_BLOCK(n)
+#endif
+
+	dispatch:
+		if(executed >= limit)
+		{
+			SYNC_OUT();					// Budget used up
+			return executed;
+		}
+		if((unsigned)pc < size)
+		{
+			b = &blockAt[pc];
+			if(b->gen != s->codeGen)
+				translate(m, pc, table);
+			if(b->count > 0 && executed + b->count <= limit && m->trace == NULL
+			   && (m->mode == KERNEL_MODE || (clock + b->count <= IRQ_NEXT(&m->irq) && b->end <= system)))
+			{
+				gen = s->codeGen;
+				startMode = m->mode;
+				op = &s->opPool[b->first];
+				goto *op->handler;
+			}
+		}
+
+		// Next event or budget deadline inside the block, no block, or tracing: one instruction
+		SYNC_OUT();
+		stepCPU(m);
+		SYNC_IN();
+		executed++;
+		if(m->status == MACHINE_END)
+			return executed;
+		goto dispatch;
+
+	block_done:
+		PROFILE_BLOCK(done);
+		executed += done;
+		if(startMode == USER_MODE)		// Timer works only if in user mode
+			clock += done;
+		if(m->mode == USER_MODE && clock >= IRQ_NEXT(&m->irq))
+		{
+			SYNC_OUT();
+			takeInterrupt(m);
+			pc = m->PC;
+			sp = m->SP;
+		}
+		goto dispatch;
+
+	load_value:
+		ac = op->operand;
+		NEXT_OP();
+
+	load_addr:
+		ac = readMemory(m, op->operand);
+		NEXT_OP();
+
+	load_ind_addr:
+		ac = readMemory(m, readMemory(m, op->operand));
+		NEXT_OP();
+
+	safe_load_addr:
+		ac = PAGE_LOAD(m->memory, op->operand);
+		PROFILE_READ(m, op->operand);
+		NEXT_OP();
+
+	safe_load_ind_addr:
+		PROFILE_READ(m, op->operand);
+		ac = readMemory(m, PAGE_LOAD(m->memory, op->operand));
+		NEXT_OP();
+
+	load_idx_x_addr:
+		ac = readMemory(m, op->operand + x);
+		NEXT_OP();
+
+	load_idx_y_addr:
+		ac = readMemory(m, op->operand + y);
+		NEXT_OP();
+
+	load_sp_x:
+		ac = readMemory(m, sp + x);
+		NEXT_OP();
+
+	store_addr:
+		writeMemory(m, op->operand, ac);
+		CHECK_CODE();
+		NEXT_OP();
+
+	get:
+		ac = m->get(m->getData);
+		NEXT_OP();
+
+	put_port:
+		PUT(op->operand);
+		NEXT_OP();
+
+	add_x:
+		ac += x;
+		NEXT_OP();
+
+	add_y:
+		ac += y;
+		NEXT_OP();
+
+	sub_x:
+		ac -= x;
+		NEXT_OP();
+
+	sub_y:
+		ac -= y;
+		NEXT_OP();
+
+	copy_to_x:
+		x = ac;
+		NEXT_OP();
+
+	copy_from_x:
+		ac = x;
+		NEXT_OP();
+
+	copy_to_y:
+		y = ac;
+		NEXT_OP();
+
+	copy_from_y:
+		ac = y;
+		NEXT_OP();
+
+	copy_to_sp:
+		sp = ac;
+		NEXT_OP();
+
+	copy_from_sp:
+		ac = sp;
+		NEXT_OP();
+
+	inc_x:
+		x++;
+		NEXT_OP();
+
+	dec_x:
+		x--;
+		NEXT_OP();
+
+	push:
+		sp--;
+		writeMemory(m, sp, ac);
+		CHECK_CODE();
+		NEXT_OP();
+
+	pop:
+		ac = readMemory(m, sp);
+		sp++;
+		NEXT_OP();
+
+	compare_swap:
+		ac = compareSwap(m, op->operand, x, ac);
+		CHECK_CODE();
+		NEXT_OP();
+
+	fetch_add:
+		ac = fetchAdd(m, op->operand, ac);
+		CHECK_CODE();
+		NEXT_OP();
+
+	get_port:
+		ac = readPort(m, op->operand);
+		NEXT_OP();
+
+	// Superinstructions
+	fuse_load_put:
+		ac = op->operand;
+		PUT(op->operand2);
+		NEXT_OP();
+
+	fuse_x_inc:
+		x = ac + 1;
+		ac = x;
+		NEXT_OP();
+
+	fuse_x_dec:
+		x = ac - 1;
+		ac = x;
+		NEXT_OP();
+
+	fuse_idx_put_inc:
+		ac = readMemory(m, op->operand + x);
+		PUT(op->operand2);
+		x++;
+		NEXT_OP();
+
+	fuse_put_inc:
+		PUT(op->operand);
+		x++;
+		NEXT_OP();
+
+	fuse_inc_from:
+		ac = ++x;
+		NEXT_OP();
+
+	fuse_dec_from:
+		ac = --x;
+		NEXT_OP();
+
+	fuse_load_to_x:
+		ac = op->operand;
+		x = ac;
+		NEXT_OP();
+
+	fuse_load_to_y:
+		ac = op->operand;
+		y = ac;
+		NEXT_OP();
+
+	fuse_load_add_y:
+		ac = op->operand + y;
+		y = ac;
+		NEXT_OP();
+
+	// Terminators
+	fall_through:
+		pc = op->pc;
+		DONE();
+
+	jump_addr:
+		pc = op->operand;
+		DONE();
+
+	jump_if_equal_addr:
+		pc = (ac == 0) ? op->operand : op->pc;
+		DONE();
+
+	jump_if_not_equal_addr:
+		pc = (ac != 0) ? op->operand : op->pc;
+		DONE();
+
+	call_addr:
+		sp--;							// Stack is grow down
+		writeMemory(m, sp, op->pc);  // Push return address onto stack
+		pc = op->operand;
+		DONE();
+
+	ret:
+		pc = readMemory(m, sp);
+		sp++;
+		DONE();
+
+	int_:
+		pc = op->pc;
+		if(m->mode == USER_MODE)
+		{
+			PROFILE_INT(m);
+			ENTER(m->irq.vector[IRQ_INT]);
+			DONE();
+		}
+		// Int in kernel mode falls through to IRet, same as switch(IR)
+
+	i_ret:
+		pc = readMemory(m, sp); // Pop PC, SP
+		sp++;
+		sp = readMemory(m, sp);
+		m->mode = USER_MODE;
+		DONE();
+
+	end:
+		PROFILE_BLOCK(b->count);
+		executed += b->count;
+		if(startMode == USER_MODE)
+			clock += b->count;
+		pc = op->pc;
+		m->IR = END;
+		m->status = MACHINE_END;         // Caller ends memory process
+		SYNC_OUT();
+		return executed;
+
+	#undef PROFILE_BLOCK
+	#undef PUT
+	#undef CHECK_CODE
+	#undef DONE
+	#undef NEXT_OP
+	#undef ENTER
+	#undef SYNC_IN
+	#undef SYNC_OUT
+}
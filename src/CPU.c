@@ -1,419 +1,941 @@
-/********************************************************************************
-*********************************************************************************
-**  Created by Yiheng Gao, 2/20/2018                                           **
-**                                                                             **
-**  Simulate CPU: fetch, execute, interrupt check                              **
-**  Function:                                                                  **
-**    - External:                                                              **
-**       void CPUInit();                  // Initial CPU                       **
-**       void runCPU(int, int);           // Simulate CPU                      **
-**    - Internal:                                                              **
-**       int fetch(int, int);             // Fetch instruction/data            **
-**       void exeInstruction(int, int);   // Execute instruction               **
-**       int readMemory(int, int, int);   // Read instruction/data from memory **
-**       void writeMemory(int, int, int); // Write data to memory              **
-*********************************************************************************
-********************************************************************************/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <time.h>
-#include "Instruction.h"
-
-
-// Function declare
-void CPUInit();
-void runCPU(int wtpd, int rdpd);
-static int fetch(int wtpd, int rdpd);
-static void exeInstruction(int wtpd, int rdpd);
-static int readMemory(int addr, int wpd, int rpd);
-static void writeMemory(int addr, int data, int wpd);
-
-
-#define Boolean char
-
-#define DEFAULT_TIME_SET 1000
-
-#define USER_MODE   0
-#define KERNEL_MODE 1
-
-#define USER_ADDRESS 	0		// Beginning position of user program
-#define USER_STACK 		1000	// Beginning position of user stack, count down
-#define INT_ADDRESS 	1500	// Beginning position of int instruction interrupt handler
-#define TIMER_ADDRESS   1000	// Beginning position of timer interrupt handler
-#define SYS_STACK 		2000	// Beginning position of system stack, count down
-
-
-// Global variable to simulate CPU register
-int PC, SP, IR, AC, X, Y;	// Special-function register
-int COUNTER;				// Special-function register: to count the instruction CPU run so far
-int counterSet;				// Set counter parameter
-Boolean mode;				// USER_MODE or KERNEL_MODE
-
-
-/****************************************************************
-* Func:   Initial CPU, including set initial value of register, *
-*         get timer interrupt parameter from command line       *
-* Param:  none                                                  *
-* Return: none                                                  *
-*****************************************************************/
-void CPUInit(void)
-{
-	PC = USER_ADDRESS;      // Set Program Counter to user memory
-	SP = USER_STACK;        // Set Stack Pointer to user stack
-	IR = 0;					// No instruction
-	
-	// Clear operand register
-	AC = 0;	
-	X = 0;
-	Y = 0;
-	COUNTER = 0;            // Store the number of instructions that CPU runs so far
-	
-	mode = USER_MODE;		// USER_MODE as default value because CPU runs from 0x0
-	
-	// Get timer parameter and check the parameter
-	printf("Set the timer parameter\n");
-	scanf("%d", &counterSet);
-	while(getchar() != '\n');    // Clear buffer in stdin
-	while(counterSet <= 0)
-	{   // Parameter check
-		counterSet = DEFAULT_TIME_SET;	// Set count to default value
-		printf("Invalid timer parameter, set to default value: %d!\n", DEFAULT_TIME_SET);
-	}
-}
-
-/****************************************************************
-* Func:   Simulate CPU, including fetch instruction,            *
-*         execute the instruction, check timer interrupt flag   *
-* Param:  int wtpd: write command/address/data to pipe          *
-*         int rdpd: read instruction/data from pipe             *
-* Return: none                                                  *
-*****************************************************************/
-void runCPU(int wtpd, int rdpd)
-{
-	do{
-		if(mode == USER_MODE)			// Timer works only if in user mode
-			COUNTER++;
-			
-		IR = fetch(wtpd, rdpd);         // Fetch instruction to Instruction Register
-		exeInstruction(wtpd, rdpd);		// Execute instruction
-		
-		// Check timer interrupt flag
-		if(mode == USER_MODE && COUNTER == counterSet)
-		{
-			COUNTER = 0;				// Clear timer
-			mode = KERNEL_MODE;			// Set mode to kernel mode to access interrupt handler
-				
-			int tmp = SP;				// Record user stack pointer
-			SP = SYS_STACK;				// Stack Pointer switch to system stack
-			SP--;                       
-			writeMemory(SP, tmp, wtpd); // Save user SP into system stack
-			SP--;
-			writeMemory(SP, PC, wtpd);  // Save current PC into system stack
-			PC = TIMER_ADDRESS;			// Set PC to timer interrupt handler		
-		}
-	}while(IR != END);
-	
-	// END
-	write(wtpd, "E", sizeof(char));
-}
-
-/****************************************************************
-* Func:   Read data from memory                                 *
-* Param:  int addr: the address that read from memory           *
-*         int wtpd: write pipe description                      *
-*         int rdpd: read pipe description                       *
-* Return: int: the data read from memory                        *
-*****************************************************************/
-int readMemory(int addr, int wpd, int rpd)
-{
-	// Memory Protection
-	if(mode == USER_MODE && addr >= TIMER_ADDRESS)
-	{
-		printf("Memory violation: accessing system address %d in user mode\n", addr);
-		write(wpd, "E", sizeof(char));    // Error occur, exit processes
-		exit(-1);
-	}
-	
-	int tmp;
-	
-	write(wpd, "r", sizeof(char));    // Control signal
-	write(wpd, &addr, sizeof(addr));  // Address
-	read(rpd, &tmp, sizeof(tmp));     // Returned data
-	
-	return tmp;
-}
-
-/****************************************************************
-* Func:   Write data to memory                                  *
-* Param:  int addr: the address that read from memory           *
-*         int data: the data that write to memory               *
-*         int wtpd: write pipe description                      *
-* Return: none                                                  *
-*****************************************************************/
-void writeMemory(int addr, int data, int wpd)
-{
-	// Memory Protection
-	if(mode == USER_MODE && addr >= TIMER_ADDRESS)
-	{
-		printf("Memory violation: accessing system address %d in user mode\n", addr);
-		write(wpd, "E", sizeof(char));    // Error occur, exit processes
-		exit(-1);
-	}
-	
-	write(wpd, "w", sizeof(char));    // Control signal 
-	write(wpd, &addr, sizeof(addr));  // Address 
-	write(wpd, &data, sizeof(data));  // Data
-}
-
-
-/****************************************************************
-* Func:   Fetch data from memory, data: instruction or data     *
-* Param:  int wtpd: write pipe description                      *
-*         int rdpd: read pipe description                       *
-* Return: int: the instruction/data read from memory            *
-*****************************************************************/
-int fetch(int wtpd, int rdpd)
-{
-	return readMemory(PC++, wtpd, rdpd);
-}
-
-/****************************************************************
-* Func:   Execute the instruction                               *
-* Param:  int wtpd: write pipe description                      *
-*         int rdpd: read pipe description                       *
-* Return: none                                                  *
-*****************************************************************/
-void exeInstruction(int wtpd, int rdpd)
-{
-	switch(IR){
-		/* Load the value into the AC*/
-		case LOAD_VALUE:
-			AC = fetch(wtpd, rdpd);
-			break;
-		
-		/* Load the value at the address into the AC */
-		case LOAD_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd);
-			AC = readMemory(addr, wtpd, rdpd);
-			break;
-		}
-		
-		/* Load the value from the address found in the given address into AC */
-		case LOAD_IND_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd);
-			addr = readMemory(addr, wtpd, rdpd);
-			AC = readMemory(addr, wtpd, rdpd);
-			break;
-		}
-			
-		/* Load the value at (address + X) into the AC */
-		case LOAD_IDX_X_ADDR:
-		{
-			// Calculate address
-			int addr = fetch(wtpd, rdpd) + X;				// Base address + offset
-			AC = readMemory(addr, wtpd, rdpd);
-			break;
-		}
-		
-		/* Load the value at (address + Y) into the AC */
-		/* Similar with LOAD_IDX_X_ADDR */
-		case LOAD_IDX_Y_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd) + Y;
-			AC = readMemory(addr, wtpd, rdpd);
-			break;
-		}
-		
-		/* Load from (SP + X) into the AC */
-		case LOAD_SP_X:
-		{
-			int addr = SP + X;
-			AC = readMemory(addr, wtpd, rdpd);
-			break;
-		}
-		
-		/* Store the value in the AC into the address */
-		case STORE_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd);
-			writeMemory(addr, AC, wtpd);
-			break;
-		}
-		
-		/* Gets a random int from 1 to 100 into the AC */
-		case GET:
-			srand(time(NULL));      // Generate the seed
-			AC = rand() % 100 + 1;  // Create a random number [1, 100]
-			break;
-		
-		/* Put AC to the screen*/
-		/* If port = 1, writes AC as an int to the screen */
-		/* If port = 2, writes AC as a char to the screen */
-		case PUT_PORT:
-		{
-			Boolean flag = fetch(wtpd, rdpd);
-			if(flag == 1)
-				printf("%d", AC);
-			else if(flag == 2)
-				printf("%c", AC);
-			else
-				printf("Parameter error: %d\n", flag);
-			break;
-		}
-			
-		/* Add the value in X to the AC */
-		case ADD_X:
-			AC += X;
-			break;
-			
-		/* Add the value in Y to the AC */
-		case ADD_Y:
-			AC += Y;
-			break;
-		
-		/* Subtract the value in X from the AC */
-		case SUB_X:
-			AC -= X;
-			break;
-		
-		/* Subtract the value in Y from the AC */
-		case SUB_Y:
-			AC -= Y;
-			break;
-		
-		/* Copy the value in the AC to X */
-		case COPY_TO_X:
-			X = AC;
-			break;
-		
-		/* Copy the value in X to the AC */
-		case COPY_FROM_X:
-			AC = X;
-			break;
-		
-		/* Copy the value in the AC to Y */
-		case COPY_TO_Y:
-			Y = AC;
-			break;
-		
-		/* Copy the value in Y to the AC */
-		case COPY_FROM_Y:
-			AC = Y;
-			break;
-		
-		/* Copy the value in AC to the SP */
-		case COPY_TO_SP:
-			SP = AC;
-			break;
-		
-		/* Copy the value in SP to the AC */
-		case COPY_FROM_SP:
-			AC = SP;
-			break;
-		
-		/* Jump to the address */
-		case JUMP_ADDR:
-			PC = fetch(wtpd, rdpd);
-			break;
-			
-		/* Jump to the address only if the value in the AC is 0 */
-		case JUMP_IF_EQUAL_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd);
-			if(AC == 0)
-				PC = addr;
-			break;
-		}
-		
-		/* Jump to the address only if the value in the AC is not 0*/
-		case JUMP_IF_NOT_EQUAL_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd);
-			if(AC != 0)
-				PC = addr;
-			break;
-		}
-		
-		/* Function call: push return address onto stack, jump to the address */
-		case CALL_ADDR:
-		{
-			int addr = fetch(wtpd, rdpd);   // Finish the whole instruction fetch
-			
-			SP--;							// Stack is grow down
-			writeMemory(SP, PC, wtpd);      // Push PC onto stack
-			
-			PC = addr;						// Jump to the address
-			
-			break;
-		}
-		
-		/* Pop return address from the stack, jump to the address */
-		case RET:
-			PC = readMemory(SP, wtpd, rdpd); // Read current content of the stack
-			SP++;			                 // Stack shrink
-			break;
-		
-		/* Increment the value in X*/
-		case INC_X:
-			X++;
-			break;
-		
-		/* Decrement the value in X */
-		case DEC_X:
-			X--;
-			break;
-		
-		/* Push AC onto stack */
-		case PUSH:
-			SP--;
-			writeMemory(SP, AC, wtpd);
-			break;
-		
-		/* Pop from stack into AC */
-		case POP:
-			AC = readMemory(SP, wtpd, rdpd);
-			SP++;
-			break;
-		
-		/* Perform system call */
-		case INT:
-			if(mode == USER_MODE)
-			{
-				mode = KERNEL_MODE;			// Set mode to kernel mode to access interrup handler
-				int tmp = SP;				// Record user stack pointer
-				SP = SYS_STACK;				// Stack Pointer switch to system stack
-				
-				SP--;
-				writeMemory(SP, tmp, wtpd); // Save user SP, PC into system stack
-				SP--;
-				writeMemory(SP, PC, wtpd);
-				PC = INT_ADDRESS;			// Set PC to timer interrupt handler
-				break;				
-			}
-		
-		/* Return from system call */
-		case I_RET:
-			PC = readMemory(SP, wtpd, rdpd); // Pop PC, SP
-			SP++;
-			SP = readMemory(SP, wtpd, rdpd);
-			mode = USER_MODE;                // Change mode
-			break;
-			
-		/* End execution */
-		case END:
-			write(wtpd, "E", sizeof(char));  // Tell memory program finished so that memory can remove the process
-			break;
-			
-		default:
-			printf("Invalid instruction\n");
-			write(wtpd, "E", sizeof(char));    // Error occur, exit processes
-			exit(-1);
-			break;
-	}
-}
\ No newline at end of file
+/********************************************************************************
+*********************************************************************************
+**  Created by Yiheng Gao, 2/20/2018                                           **
+**                                                                             **
+**  Simulate CPU: fetch, execute, interrupt check                              **
+**  All state lives in a Machine, see Machine.h                                **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       void CPUInit(Machine*, char*);   // Initial CPU                       **
+**       void runCPU(Machine*);           // Simulate CPU process              **
+**       void stepCPU(Machine*);          // Run one instruction               **
+**       int readMemory(Machine*, int);   // Read instruction/data from memory **
+**       int readCode(Machine*, int);     // Read an instruction word          **
+**       void writeMemory(Machine*, int, int); // Write data to memory         **
+**       int compareSwap(Machine*, int, int, int); // Atomic compare and store **
+**       int fetchAdd(Machine*, int, int); // Atomic add, returns the old word **
+**       int readPort(Machine*, int);     // GetPort: next byte of a port      **
+**       void interrupt(Machine*, int);   // Enter kernel mode at a handler    **
+**       void takeInterrupt(Machine*);    // Enter the due line's handler      **
+**       void endMemory(Machine*);        // Tell memory process to exit       **
+**    - Internal:                                                              **
+**       int fetch(Machine*);             // Fetch instruction/data            **
+**       void exeInstruction(Machine*);   // Execute instruction               **
+**       int readWord(Machine*, int, ReadWindow*); // Read through a window    **
+**       int peekCode(Machine*, int);     // Trace operand, read uncounted     **
+**       void readBlock(Machine*, int, int, int*); // Batched read request     **
+**       void flushMemory(Machine*);      // Send pending frames to memory     **
+**       void awaitReply(Machine*, int*, int); // Flush, read the reply        **
+**       void announceMode(Machine*);     // Server: frames follow in m->mode  **
+**       int serverAtomic(Machine*, int, int, int, int); // Server: 'c' or 'a' **
+**       int *atomicWord(Machine*, int);  // Checked word for an atomic access **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Cache.h"
+#include "Timing.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "Stream.h"
+#include "Diff.h"
+#include "Verify.h"
+#include "Smp.h"
+#include "Server.h"
+
+
+// Function declare
+static int fetch(Machine *m);
+static void exeInstruction(Machine *m);
+static int readWord(Machine *m, int addr, ReadWindow *win);
+static int peekCode(Machine *m, int addr);
+static void readBlock(Machine *m, int addr, int count, int *dest);
+static void flushMemory(Machine *m);
+static void awaitReply(Machine *m, int *dest, int count);
+static void announceMode(Machine *m);
+static int serverAtomic(Machine *m, int command, int addr, int expected, int data);
+static int *atomicWord(Machine *m, int addr);
+
+
+#define DEFAULT_TIME_SET 1000
+
+
+/****************************************************************
+* Func:   Initial CPU, including set initial value of register, *
+*         get timer interrupt parameter from command line       *
+* Param:  Machine *m: the machine                               *
+*         char *timer: timer parameter, NULL to ask the user    *
+* Return: none                                                  *
+*****************************************************************/
+void CPUInit(Machine *m, const char *timer)
+{
+	int counterSet;
+
+	machineReset(m);	// Registers to their initial value, USER_MODE at 0x0
+
+	// Get timer parameter and check the parameter
+	if(timer == NULL)
+	{
+		printf("Set the timer parameter\n");
+		scanf("%d", &counterSet);
+		while(getchar() != '\n');    // Clear buffer in stdin
+	}
+	else
+		counterSet = atoi(timer);
+	while(counterSet <= 0)
+	{   // Parameter check
+		counterSet = DEFAULT_TIME_SET;	// Set count to default value
+		printf("Invalid timer parameter, set to default value: %d!\n", DEFAULT_TIME_SET);
+	}
+	machineSetTimer(m, counterSet);
+}
+
+/****************************************************************
+* Func:   Simulate CPU process: run the machine until End,      *
+*         then end memory process                               *
+* Param:  Machine *m: the machine, connected to memory process  *
+* Return: none, exits on memory violation/invalid instruction   *
+*****************************************************************/
+void runCPU(Machine *m)
+{
+	if(m->transport == TRANSPORT_SHM)
+	{
+		char ready;
+		if(read(m->rdpd, &ready, sizeof(ready)) != sizeof(ready))	// Wait until memory process has loaded the program
+		{
+			printf("Memory process is gone\n");
+			exit(-1);
+		}
+	}
+	fflush(stdout);		// Prompts go out before the program's own output
+	if(m->verify && verifyProgram(m, stderr) < 0)	// Program is in memory now
+		fprintf(stderr, "verify: out of memory\n");
+
+	char text[128];
+	if(m->checkpointEvery > 0)
+	{
+		// Checkpoint between slices, the run itself is unchanged
+		while(machineRunFor(m, m->checkpointEvery) == MACHINE_RUNNING)
+			if(machineCheckpoint(m) != 0)
+			{
+				fprintf(stderr, "Can not write checkpoint %s.%d\n", m->checkpointPrefix, m->checkpoints);
+				machineSetCheckpoints(m, 0, NULL);
+				machineRun(m);
+				break;
+			}
+	}
+	else
+		machineRun(m);
+	if(machineSetTrace(m, NULL) != 0)	// Trace complete before any exit
+		fprintf(stderr, "Trace is incomplete, writing it failed\n");
+	PROFILE_REPORT(m);
+	if(machineStatusText(m, text, sizeof(text)) > 0)
+	{
+		printf("%s", text);             // Memory violation or invalid instruction
+		endMemory(m);                   // Error occur, exit processes
+		exit(-1);
+	}
+
+	// END
+	endMemory(m);	// Tell memory program finished so that memory can remove the process
+
+	if(m->cache != NULL)
+		cachePrintStats(m->cache);
+	if(m->timing != NULL)
+		timingReport(m->timing, m->instructions, stderr);
+}
+
+/****************************************************************
+* Func:   Run one instruction: fetch, execute, take a due       *
+*         interrupt                                             *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void stepCPU(Machine *m)
+{
+	Boolean user = m->mode == USER_MODE;
+	uint64_t start = (m->timing != NULL) ? TIMING_TOTAL(m->timing) : 0;
+
+	if(user && (m->timing == NULL || !m->timing->timerCycles))	// Timer works only if in user mode
+		m->irq.clock++;
+
+	m->IR = fetch(m);               // Fetch instruction to Instruction Register
+	if(m->trace != NULL)
+		traceStep(m->trace, m->PC - 1, m->IR, HAS_OPERAND(m->IR) ? peekCode(m, m->PC) : 0,
+		          m->AC, m->X, m->Y, m->SP, m->mode);
+	exeInstruction(m);				// Execute instruction
+	if(m->timing != NULL)
+		timingStep(m, user, start);	// Cycles may move the timer on
+
+	// Check the next event, interrupts are taken in user mode only
+	if(m->mode == USER_MODE && m->irq.clock >= IRQ_NEXT(&m->irq))
+		takeInterrupt(m);
+}
+
+/****************************************************************
+* Func:   Enter the handler of the line the interrupt           *
+*         controller picks, if any is due                       *
+* Param:  Machine *m: the machine, in user mode                 *
+* Return: none                                                  *
+*****************************************************************/
+void takeInterrupt(Machine *m)
+{
+	Boolean input = m->stream != NULL && m->irq.vector[IRQ_INPUT] >= 0;
+	if(input && streamArrived(m->stream, 1))
+		irqRaise(&m->irq, IRQ_INPUT);
+	int line = irqTake(&m->irq);
+	if(input && streamArrived(m->stream, 0))
+		IRQ_SET_NEXT(&m->irq, m->irq.clock);	// Came after the check, irqTake() may have overwritten the wake
+	if(line < 0)
+		return;
+	if(line == IRQ_TIMER)
+		PROFILE_TIMER(m);
+	interrupt(m, m->irq.vector[line]);	// Set PC to the line's handler
+}
+
+/****************************************************************
+* Func:   Enter kernel mode: switch to system stack, save user  *
+*         SP and PC there, jump to the interrupt handler        *
+* Param:  Machine *m: the machine                               *
+*         int handler: address from the vector table            *
+* Return: none                                                  *
+*****************************************************************/
+void interrupt(Machine *m, int handler)
+{
+	m->mode = KERNEL_MODE;		// Set mode to kernel mode to access interrupt handler
+
+	int tmp = m->SP;			// Record user stack pointer
+	m->SP = m->layout.systemStack;	// Stack Pointer switch to system stack
+	m->SP--;
+	writeMemory(m, m->SP, tmp); // Save user SP into system stack
+	m->SP--;
+	writeMemory(m, m->SP, m->PC); // Save current PC into system stack
+	m->PC = handler;			// Set PC to interrupt handler
+}
+
+/****************************************************************
+* Func:   Read data from memory                                 *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address that read from memory           *
+* Return: int: the data read from memory                        *
+*****************************************************************/
+int readMemory(Machine *m, int addr)
+{
+	int data = readWord(m, addr, &m->dataWindow);
+
+	PROFILE_READ(m, addr);			// Counted once it passed protection
+	TIMING_READ(m, addr);
+	return data;
+}
+
+/****************************************************************
+* Func:   Read an instruction word, not counted as a data read  *
+*         by the profiler                                       *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address of the word                     *
+* Return: int: the word                                         *
+*****************************************************************/
+int readCode(Machine *m, int addr)
+{
+	int word = readWord(m, addr, &m->codeWindow);
+
+	TIMING_READ(m, addr);
+	return word;
+}
+
+/****************************************************************
+* Func:   Read a word, refill the given read-ahead window on    *
+*         a miss so neighbouring words need no more requests    *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address that read from memory           *
+*         ReadWindow *win: window to refill on a miss           *
+* Return: int: the data read from memory                        *
+*****************************************************************/
+int readWord(Machine *m, int addr, ReadWindow *win)
+{
+	// Memory protection and bounds in one compare
+	if((unsigned)addr >= ACCESS_LIMIT(m))
+		machineFault(m, MACHINE_FAULT, addr);
+
+	if(m->transport != TRANSPORT_PIPE)
+	{
+		if(m->stores != NULL)
+			return smpLoad(m, addr);		// Lock-step: own stores of the quantum first
+		return PAGE_LOAD(m->memory, addr);	// Own or shared memory, no round-trip
+	}
+
+	// Memory server: other clients write too, data is read every time
+	if(m->server != NULL)
+	{
+		if(m->server->mode != m->mode)
+			announceMode(m);
+		if(win == &m->dataWindow)
+		{
+			int word;
+			readBlock(m, addr, 1, &word);
+			return word;
+		}
+	}
+
+	// A pending write to the same address holds the newest data
+	int i;
+	for(i = m->pendingFrames - 1; i >= 0; i--)
+		if(m->sendBuffer[i].address == addr)
+			return m->sendBuffer[i].data;
+
+	// CPU-side cache replaces the read-ahead windows, a line fill is one request
+	if(m->cache != NULL)
+	{
+		int *word = cacheLookup(m->cache, addr);
+		if(word != NULL)
+			return *word;
+
+		int base, count;
+		int *line = cacheAllocate(m->cache, addr, &base, &count);
+		readBlock(m, base, count, line);
+		return line[addr - base];
+	}
+
+	// Read-ahead windows
+	ReadWindow *code = &m->codeWindow, *data = &m->dataWindow;
+	if(addr >= code->base && addr < code->base + code->size)
+		return code->words[addr - code->base];
+	if(addr >= data->base && addr < data->base + data->size)
+		return data->words[addr - data->base];
+
+	// Refill window, pending writes go out ahead of the request
+	int size = m->layout.size;
+	win->base = addr;
+	win->size = size - addr < READ_AHEAD ? size - addr : READ_AHEAD;
+	readBlock(m, win->base, win->size, win->words);
+
+	return win->words[0];
+}
+
+/****************************************************************
+* Func:   Read an instruction word for the trace: the cycle     *
+*         model, cache counters and LRU order stay as they      *
+*         were, so a traced run counts what an untraced one     *
+*         does                                                  *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address of the word                     *
+* Return: int: the word                                         *
+*****************************************************************/
+int peekCode(Machine *m, int addr)
+{
+	if(m->transport != TRANSPORT_PIPE || m->cache == NULL)
+		return readWord(m, addr, &m->codeWindow);	// Nothing counted on the way
+
+	if((unsigned)addr >= ACCESS_LIMIT(m))
+		machineFault(m, MACHINE_FAULT, addr);
+	int i;
+	for(i = m->pendingFrames - 1; i >= 0; i--)
+		if(m->sendBuffer[i].address == addr)
+			return m->sendBuffer[i].data;
+	int *word = cachePeek(m->cache, addr);
+	if(word != NULL)
+		return *word;
+
+	int data;
+	readBlock(m, addr, 1, &data);	// Around the cache, the fetch fills the line
+	return data;
+}
+
+/****************************************************************
+* Func:   Write data to memory                                  *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address that read from memory           *
+*         int data: the data that write to memory               *
+* Return: none                                                  *
+*****************************************************************/
+void writeMemory(Machine *m, int addr, int data)
+{
+	// Memory protection and bounds in one compare
+	if((unsigned)addr >= ACCESS_LIMIT(m))
+		machineFault(m, MACHINE_FAULT, addr);
+	PROFILE_WRITE(m, addr);
+	DIFF_WRITE(m, addr, data);
+	TIMING_WRITE(m);
+
+	// Self-modifying code: drop pre-decoded instructions covering addr
+	VERIFY_INVALIDATE(m, addr);
+	if(m->engine == ENGINE_THREADED)
+		threadedInvalidate(m, addr);
+	else if(m->engine == ENGINE_BLOCK)
+		blockInvalidate(m, addr);
+
+	if(m->transport != TRANSPORT_PIPE)
+	{
+		if(m->stores != NULL)
+			smpStore(m, addr, data);		// Lock-step: memory sees it at the barrier
+		else
+			PAGE_STORE(m->memory, addr, data);	// Own or shared memory, no round-trip
+		return;
+	}
+
+	// Keep cache and read-ahead windows coherent
+	if(m->cache != NULL)
+		cacheUpdate(m->cache, addr, data);
+	ReadWindow *code = &m->codeWindow, *window = &m->dataWindow;
+	if(addr >= code->base && addr < code->base + code->size)
+		code->words[addr - code->base] = data;
+	if(addr >= window->base && addr < window->base + window->size)
+		window->words[addr - window->base] = data;
+
+	// Coalesce with a pending write to the same address
+	int i;
+	for(i = m->pendingFrames - 1; i >= 0; i--)
+		if(m->sendBuffer[i].address == addr)
+		{
+			m->sendBuffer[i].data = data;
+			return;
+		}
+
+	if(m->server != NULL && m->server->mode != m->mode)
+		announceMode(m);
+	if(m->pendingFrames >= WRITE_BUFFER_SIZE)
+		flushMemory(m);
+
+	MemFrame *f = &m->sendBuffer[m->pendingFrames++];
+	f->command = 'w';
+	f->address = addr;
+	f->data = data;
+}
+
+/****************************************************************
+* Func:   Compare and swap, one atomic step for every CPU on    *
+*         the memory: if the word at addr equals expected, it   *
+*         becomes data                                          *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address                                 *
+*         int expected: the value the word must have            *
+*         int data: the new value                               *
+* Return: int: the word before, equal to expected if it was     *
+*              replaced                                         *
+*****************************************************************/
+int compareSwap(Machine *m, int addr, int expected, int data)
+{
+	int *word = atomicWord(m, addr);
+	if(word == NULL)
+	{
+		if(m->server != NULL)
+			return serverAtomic(m, 'c', addr, expected, data);
+
+		// Pipe: the memory process serves this CPU alone
+		int old = readMemory(m, addr);
+		if(old == expected)
+			writeMemory(m, addr, data);
+		return old;
+	}
+
+	PROFILE_READ(m, addr);
+	TIMING_READ(m, addr);			// One read and one write, swapped or not
+	TIMING_WRITE(m);
+	int old = expected;
+	if(m->stores != NULL)
+		old = smpAtomic(m, COMPARE_SWAP, addr, expected, data);	// Lock-step: runs at the barrier
+	else
+		__atomic_compare_exchange_n(word, &old, data, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	if(old == expected)
+	{
+		PROFILE_WRITE(m, addr);
+		DIFF_WRITE(m, addr, data);
+		m->memory->dirty[addr >> PAGE_SHIFT] = 1;
+	}
+	return old;
+}
+
+/****************************************************************
+* Func:   Fetch and add, one atomic step for every CPU on the   *
+*         memory                                                *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address                                 *
+*         int data: added to the word                           *
+* Return: int: the word before                                  *
+*****************************************************************/
+int fetchAdd(Machine *m, int addr, int data)
+{
+	int *word = atomicWord(m, addr);
+	if(word == NULL)
+	{
+		if(m->server != NULL)
+			return serverAtomic(m, 'a', addr, 0, data);
+		int old = readMemory(m, addr);
+		writeMemory(m, addr, old + data);
+		return old;
+	}
+
+	PROFILE_READ(m, addr);
+	PROFILE_WRITE(m, addr);
+	TIMING_READ(m, addr);
+	TIMING_WRITE(m);
+	m->memory->dirty[addr >> PAGE_SHIFT] = 1;
+	if(m->stores != NULL)
+		return smpAtomic(m, FETCH_ADD, addr, 0, data);	// Lock-step: runs at the barrier
+	int old = __atomic_fetch_add(word, data, __ATOMIC_SEQ_CST);
+	DIFF_WRITE(m, addr, old + data);
+	return old;
+}
+
+/****************************************************************
+* Func:   GetPort: take the next byte of an input port, never   *
+*         waits for the host                                    *
+* Param:  Machine *m: the machine                               *
+*         int port: 1 for the input port of machineSetStream()  *
+* Return: int: the byte, STREAM_EMPTY if none came yet, or      *
+*              STREAM_END at its end and for ports without one  *
+*****************************************************************/
+int readPort(Machine *m, int port)
+{
+	if(port != 1 || m->stream == NULL)
+		return STREAM_END;
+	return streamGet(m->stream);
+}
+
+/****************************************************************
+* Func:   Read a block of words with one request, pending       *
+*         writes go out in the same write() ahead of it         *
+* Param:  Machine *m: the machine                               *
+*         int addr: the first address that read from memory     *
+*         int count: number of words, at most MAX_READ_WORDS    *
+*         int *dest: where to store the words                   *
+* Return: none                                                  *
+*****************************************************************/
+void readBlock(Machine *m, int addr, int count, int *dest)
+{
+	MemFrame *f = &m->sendBuffer[m->pendingFrames++];
+	f->command = 'r';
+	f->address = addr;
+	f->data = count;
+	awaitReply(m, dest, count);
+}
+
+/****************************************************************
+* Func:   Send all pending frames to memory in one write()      *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void flushMemory(Machine *m)
+{
+	size_t size = m->pendingFrames * sizeof(MemFrame);
+	m->pendingFrames = 0;
+	if(size > 0 && write(m->wtpd, m->sendBuffer, size) != size)
+	{
+		machineFlush(m);
+		printf("Memory process is gone\n");
+		exit(-1);
+	}
+}
+
+/****************************************************************
+* Func:   Send pending frames and wait for the reply words,     *
+*         timed per round trip if memory is a server            *
+* Param:  Machine *m: the machine                               *
+*         int *dest: where to store the words                   *
+*         int count: words the frames ask for                   *
+* Return: none, exits if memory is gone                         *
+*****************************************************************/
+void awaitReply(Machine *m, int *dest, int count)
+{
+	struct timespec start, end;
+	if(m->server != NULL)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	flushMemory(m);
+
+	// Returned data, may arrive in pieces
+	size_t want = count * sizeof(int), got = 0;
+	while(got < want)
+	{
+		ssize_t n = read(m->rdpd, (char *)dest + got, want - got);
+		if(n <= 0)
+		{
+			machineFlush(m);
+			printf("Memory process is gone\n");
+			exit(-1);
+		}
+		got += n;
+	}
+
+	if(m->server != NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		serverRecord(m->server, (end.tv_sec - start.tv_sec) * 1000000000LL + end.tv_nsec - start.tv_nsec);
+	}
+}
+
+/****************************************************************
+* Func:   Memory server: queue an 'm' frame, the server checks  *
+*         the frames after it against the limit of m->mode      *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*                                                               *
+* Words the server read ahead in user mode past the boundary    *
+* came back as 0, so kernel mode drops the code window          *
+*****************************************************************/
+void announceMode(Machine *m)
+{
+	MemFrame *f = &m->sendBuffer[m->pendingFrames++];
+	f->command = 'm';
+	f->address = -1;				// Never matches a pending write
+	f->data = m->mode;
+	m->server->mode = m->mode;
+	if(m->mode == KERNEL_MODE)
+		m->codeWindow.size = 0;
+}
+
+/****************************************************************
+* Func:   Memory server: compare and swap ('c') or fetch and    *
+*         add ('a'), atomic for every client                    *
+* Param:  Machine *m: the machine                               *
+*         int command: 'c' or 'a'                               *
+*         int addr: the address                                 *
+*         int expected: 'c': the value the word must have       *
+*         int data: 'c': the new value, 'a': added              *
+* Return: int: the word before                                  *
+*****************************************************************/
+int serverAtomic(Machine *m, int command, int addr, int expected, int data)
+{
+	if((unsigned)addr >= ACCESS_LIMIT(m))
+		machineFault(m, MACHINE_FAULT, addr);
+	PROFILE_READ(m, addr);
+	PROFILE_WRITE(m, addr);
+	TIMING_READ(m, addr);
+	TIMING_WRITE(m);
+	if(m->engine == ENGINE_THREADED)
+		threadedInvalidate(m, addr);
+	else if(m->engine == ENGINE_BLOCK)
+		blockInvalidate(m, addr);
+	if(m->server->mode != m->mode)
+		announceMode(m);
+
+	MemFrame *f;
+	if(command == 'c')
+	{
+		f = &m->sendBuffer[m->pendingFrames++];
+		f->command = 'x';
+		f->address = -1;
+		f->data = expected;
+	}
+	f = &m->sendBuffer[m->pendingFrames++];
+	f->command = command;
+	f->address = addr;
+	f->data = data;
+
+	int old;
+	awaitReply(m, &old, 1);
+
+	// Keep the code window coherent, as writeMemory() does
+	int now = (command == 'a') ? old + data : (old == expected) ? data : old;
+	ReadWindow *code = &m->codeWindow;
+	if(addr >= code->base && addr < code->base + code->size)
+		code->words[addr - code->base] = now;
+	return old;
+}
+
+/****************************************************************
+* Func:   Tell memory process to exit, after pending writes     *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void endMemory(Machine *m)
+{
+	if(m->transport == TRANSPORT_LOCAL)
+		return;                     // No memory process
+
+	MemFrame *f = &m->sendBuffer[m->pendingFrames++];
+	f->command = 'E';
+	f->address = 0;
+	f->data = 0;
+	flushMemory(m);
+}
+
+
+/****************************************************************
+* Func:   Fetch data from memory, data: instruction or data     *
+* Param:  Machine *m: the machine                               *
+* Return: int: the instruction/data read from memory            *
+*****************************************************************/
+int fetch(Machine *m)
+{
+	return readCode(m, m->PC++);    // Opcode and operands come with one request
+}
+
+/****************************************************************
+* Func:   Execute the instruction                               *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void exeInstruction(Machine *m)
+{
+	PROFILE_STEP(m, m->PC - 1, m->IR, m->mode == KERNEL_MODE);
+
+	switch(m->IR){
+		/* Load the value into the AC*/
+		case LOAD_VALUE:
+			m->AC = fetch(m);
+			break;
+
+		/* Load the value at the address into the AC */
+		case LOAD_ADDR:
+		{
+			int addr = fetch(m);
+			m->AC = readMemory(m, addr);
+			break;
+		}
+
+		/* Load the value from the address found in the given address into AC */
+		case LOAD_IND_ADDR:
+		{
+			int addr = fetch(m);
+			addr = readMemory(m, addr);
+			m->AC = readMemory(m, addr);
+			break;
+		}
+
+		/* Load the value at (address + X) into the AC */
+		case LOAD_IDX_X_ADDR:
+		{
+			// Calculate address
+			int addr = fetch(m) + m->X;				// Base address + offset
+			m->AC = readMemory(m, addr);
+			break;
+		}
+
+		/* Load the value at (address + Y) into the AC */
+		/* Similar with LOAD_IDX_X_ADDR */
+		case LOAD_IDX_Y_ADDR:
+		{
+			int addr = fetch(m) + m->Y;
+			m->AC = readMemory(m, addr);
+			break;
+		}
+
+		/* Load from (SP + X) into the AC */
+		case LOAD_SP_X:
+		{
+			int addr = m->SP + m->X;
+			m->AC = readMemory(m, addr);
+			break;
+		}
+
+		/* Store the value in the AC into the address */
+		case STORE_ADDR:
+		{
+			int addr = fetch(m);
+			writeMemory(m, addr, m->AC);
+			break;
+		}
+
+		/* Gets a random int from 1 to 100 into the AC */
+		case GET:
+			m->AC = m->get(m->getData);
+			break;
+
+		/* Next byte of the input port into the AC, -1 if none came yet, -2 at its end */
+		case GET_PORT:
+		{
+			int port = fetch(m);
+			m->AC = readPort(m, port);
+			break;
+		}
+
+		/* Put AC to the screen*/
+		/* If port = 1, writes AC as an int to the screen */
+		/* If port = 2, writes AC as a char to the screen */
+		case PUT_PORT:
+		{
+			Boolean flag = fetch(m);
+			m->put(m->putData, flag, m->AC);
+			break;
+		}
+
+		/* Add the value in X to the AC */
+		case ADD_X:
+			m->AC += m->X;
+			break;
+
+		/* Add the value in Y to the AC */
+		case ADD_Y:
+			m->AC += m->Y;
+			break;
+
+		/* Subtract the value in X from the AC */
+		case SUB_X:
+			m->AC -= m->X;
+			break;
+
+		/* Subtract the value in Y from the AC */
+		case SUB_Y:
+			m->AC -= m->Y;
+			break;
+
+		/* Copy the value in the AC to X */
+		case COPY_TO_X:
+			m->X = m->AC;
+			break;
+
+		/* Copy the value in X to the AC */
+		case COPY_FROM_X:
+			m->AC = m->X;
+			break;
+
+		/* Copy the value in the AC to Y */
+		case COPY_TO_Y:
+			m->Y = m->AC;
+			break;
+
+		/* Copy the value in Y to the AC */
+		case COPY_FROM_Y:
+			m->AC = m->Y;
+			break;
+
+		/* Copy the value in AC to the SP */
+		case COPY_TO_SP:
+			m->SP = m->AC;
+			break;
+
+		/* Copy the value in SP to the AC */
+		case COPY_FROM_SP:
+			m->AC = m->SP;
+			break;
+
+		/* Jump to the address */
+		case JUMP_ADDR:
+			m->PC = fetch(m);
+			break;
+
+		/* Jump to the address only if the value in the AC is 0 */
+		case JUMP_IF_EQUAL_ADDR:
+		{
+			int addr = fetch(m);
+			if(m->AC == 0)
+				m->PC = addr;
+			break;
+		}
+
+		/* Jump to the address only if the value in the AC is not 0*/
+		case JUMP_IF_NOT_EQUAL_ADDR:
+		{
+			int addr = fetch(m);
+			if(m->AC != 0)
+				m->PC = addr;
+			break;
+		}
+
+		/* Function call: push return address onto stack, jump to the address */
+		case CALL_ADDR:
+		{
+			int addr = fetch(m);            // Finish the whole instruction fetch
+
+			m->SP--;						// Stack is grow down
+			writeMemory(m, m->SP, m->PC);   // Push PC onto stack
+
+			m->PC = addr;					// Jump to the address
+
+			break;
+		}
+
+		/* Pop return address from the stack, jump to the address */
+		case RET:
+			m->PC = readMemory(m, m->SP);   // Read current content of the stack
+			m->SP++;			            // Stack shrink
+			break;
+
+		/* Increment the value in X*/
+		case INC_X:
+			m->X++;
+			break;
+
+		/* Decrement the value in X */
+		case DEC_X:
+			m->X--;
+			break;
+
+		/* Push AC onto stack */
+		case PUSH:
+			m->SP--;
+			writeMemory(m, m->SP, m->AC);
+			break;
+
+		/* Pop from stack into AC */
+		case POP:
+			m->AC = readMemory(m, m->SP);
+			m->SP++;
+			break;
+
+		/* Perform system call */
+		case INT:
+			if(m->mode == USER_MODE)
+			{
+				PROFILE_INT(m);
+				interrupt(m, m->irq.vector[IRQ_INT]);	// Set PC to int interrupt handler
+				break;
+			}
+
+		/* Return from system call */
+		case I_RET:
+			m->PC = readMemory(m, m->SP);   // Pop PC, SP
+			m->SP++;
+			m->SP = readMemory(m, m->SP);
+			m->mode = USER_MODE;            // Change mode
+			break;
+
+		/* If the word at the address equals X, store AC there; AC gets the old word */
+		case COMPARE_SWAP:
+		{
+			int addr = fetch(m);
+			m->AC = compareSwap(m, addr, m->X, m->AC);
+			break;
+		}
+
+		/* Add AC to the word at the address; AC gets the old word */
+		case FETCH_ADD:
+		{
+			int addr = fetch(m);
+			m->AC = fetchAdd(m, addr, m->AC);
+			break;
+		}
+
+		/* End execution */
+		case END:
+			m->status = MACHINE_END;        // Caller ends memory process
+			break;
+
+		default:
+			machineFault(m, MACHINE_INVALID, m->PC - 1);
+			break;
+	}
+}
+
+/****************************************************************
+* Func:   Check an atomic access and find its word: protection, *
+*         bounds and self-modifying code as for writeMemory()   *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address                                 *
+* Return: int*: the word in memory, NULL with TRANSPORT_PIPE    *
+*****************************************************************/
+int *atomicWord(Machine *m, int addr)
+{
+	if(m->transport == TRANSPORT_PIPE)
+		return NULL;				// readMemory()/writeMemory() check it
+	if((unsigned)addr >= ACCESS_LIMIT(m))
+		machineFault(m, MACHINE_FAULT, addr);
+
+	VERIFY_INVALIDATE(m, addr);
+	if(m->engine == ENGINE_THREADED)
+		threadedInvalidate(m, addr);
+	else if(m->engine == ENGINE_BLOCK)
+		blockInvalidate(m, addr);
+
+	int *page = PAGE_OF(m->memory, addr);
+	if(page == pageZero)
+		page = pageAllocate(m->memory, addr);
+	return &page[addr & PAGE_MASK];
+}
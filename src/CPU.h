@@ -0,0 +1,51 @@
+#ifndef _CPU_H_
+#define _CPU_H_
+
+#include "Machine.h"
+
+#define USER_MODE   0
+#define KERNEL_MODE 1
+
+#define USER_ADDRESS 	0		// Beginning position of user program
+#define USER_STACK 		1000	// Default beginning position of user stack, count down
+#define INT_ADDRESS 	1500	// Default beginning position of int instruction interrupt handler
+#define TIMER_ADDRESS   1000	// Default beginning position of timer interrupt handler
+#define SYS_STACK 		2000	// Default beginning position of system stack, count down
+// The machine's Layout holds the values in use, see layoutInit()
+
+// First address the current mode may not touch: one unsigned compare
+// checks both protection and bounds, negative addresses included
+#define ACCESS_LIMIT(m)	((unsigned)(m)->limit[(int)(m)->mode])
+
+// Execution engine
+#define ENGINE_SWITCH	0		// Fetch and decode every step, switch(IR)
+#define ENGINE_THREADED	1		// Pre-decoded instructions, computed-goto dispatch
+#define ENGINE_BLOCK	2		// Basic blocks of fused superinstructions
+
+void CPUInit(Machine *m, const char *timer);
+void runCPU(Machine *m);
+void stepCPU(Machine *m);
+int readMemory(Machine *m, int addr);
+int readCode(Machine *m, int addr);
+void writeMemory(Machine *m, int addr, int data);
+int compareSwap(Machine *m, int addr, int expected, int data);
+int fetchAdd(Machine *m, int addr, int data);
+int readPort(Machine *m, int port);
+void interrupt(Machine *m, int handler);
+void takeInterrupt(Machine *m);
+void endMemory(Machine *m);
+
+// Leave the running instruction with status, see Machine.c
+void machineFault(Machine *m, int status, int addr);
+
+// Threaded engine, returns instructions executed, at most limit
+long runThreaded(Machine *m, long limit);
+void threadedInvalidate(Machine *m, int addr);
+void threadedFree(Machine *m);
+
+// Block engine, returns instructions executed, at most limit
+long runBlock(Machine *m, long limit);
+void blockInvalidate(Machine *m, int addr);
+void blockFree(Machine *m);
+
+#endif
@@ -0,0 +1,222 @@
+/********************************************************************************
+*********************************************************************************
+**  Simulate a CPU-side cache between CPU and Memory process                   **
+**  Direct-mapped (1 way) or set-associative with LRU replacement,             **
+**  write-through without write-allocate                                       **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Cache *cacheCreate(int, int, int, int, int); // Geometry and layout   **
+**       void cacheFree(Cache*);          // Release a cache                   **
+**       int *cacheLookup(Cache*, int);   // Find a cached word                **
+**       int *cachePeek(Cache*, int);     // Find it, nothing counted          **
+**       int *cacheAllocate(Cache*, int, int*, int*); // Line to fill on miss  **
+**       void cacheUpdate(Cache*, int, int); // Write-through update           **
+**       void cachePrintStats(Cache*);    // Hit/miss/eviction counters        **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Cache.h"
+#include "Memory.h"
+
+
+// One cache line
+typedef struct
+{
+	int tag;					// addr >> lineShift, -1 if line is invalid
+	unsigned long lastUse;		// For LRU replacement
+	int *words;					// lineWords words of data
+} CacheLine;
+
+
+// One cache, each machine owns its own
+typedef struct Cache
+{
+	CacheLine *lines;			// numSets * numWays lines, set by set
+	int *data;					// Words of all lines
+	int numSets, numWays;
+	int lineWords, lineShift;
+	int system;					// First system address, splits the statistics
+	unsigned long useClock;
+
+	// Statistics, per region
+	unsigned long hits[2], misses[2], evictions[2];
+} Cache;
+
+
+#define REGION(c, addr) ((addr) >= (c)->system)	// 0: user region, 1: system region
+
+
+/****************************************************************
+* Func:   Create a cache                                        *
+* Param:  int sets: number of sets, power of 2                  *
+*         int ways: lines per set, 1 means direct-mapped        *
+*         int words: words per line, power of 2 that divides    *
+*                    system so no line mixes user and system    *
+*                    words, and size so no line leaves memory   *
+*         int system: first system address                      *
+*         int size: words of memory                             *
+* Return: Cache*: the cache, NULL on invalid configuration      *
+*****************************************************************/
+Cache *cacheCreate(int sets, int ways, int words, int system, int size)
+{
+	if(sets <= 0 || sets > CACHE_MAX_SETS || (sets & (sets - 1)) != 0)
+		return NULL;
+	if(ways <= 0 || ways > CACHE_MAX_WAYS)
+		return NULL;
+	if(words <= 0 || words > MAX_READ_WORDS || (words & (words - 1)) != 0
+	   || system % words != 0 || size % words != 0)
+		return NULL;
+	
+	Cache *c = calloc(1, sizeof(Cache));
+	if(c == NULL)
+		return NULL;
+	c->numSets = sets;
+	c->numWays = ways;
+	c->lineWords = words;
+	c->system = system;
+	for(c->lineShift = 0; (1 << c->lineShift) < words; c->lineShift++);
+	
+	c->lines = malloc(sets * ways * sizeof(CacheLine));
+	c->data = malloc(sets * ways * words * sizeof(int));
+	if(c->lines == NULL || c->data == NULL)
+	{
+		cacheFree(c);
+		return NULL;
+	}
+	
+	int i;
+	for(i = 0; i < sets * ways; i++)
+	{
+		c->lines[i].tag = -1;
+		c->lines[i].lastUse = 0;
+		c->lines[i].words = &c->data[i * words];
+	}
+	return c;
+}
+
+/****************************************************************
+* Func:   Release a cache                                       *
+* Param:  Cache *c: the cache, may be NULL                      *
+* Return: none                                                  *
+*****************************************************************/
+void cacheFree(Cache *c)
+{
+	if(c == NULL)
+		return;
+	free(c->lines);
+	free(c->data);
+	free(c);
+}
+
+/****************************************************************
+* Func:   Find a cached word, count hit or miss                 *
+* Param:  Cache *c: the cache                                   *
+*         int addr: the address, inside memory                  *
+* Return: int*: pointer to the cached word, NULL on a miss      *
+*****************************************************************/
+int *cacheLookup(Cache *c, int addr)
+{
+	int tag = addr >> c->lineShift;
+	CacheLine *set = &c->lines[(tag & (c->numSets - 1)) * c->numWays];
+	
+	int i;
+	for(i = 0; i < c->numWays; i++)
+		if(set[i].tag == tag)
+		{
+			set[i].lastUse = ++c->useClock;
+			c->hits[REGION(c, addr)]++;
+			return &set[i].words[addr & (c->lineWords - 1)];
+		}
+	
+	c->misses[REGION(c, addr)]++;
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Find a cached word without counting it or touching    *
+*         the LRU order, for reads the program does not make    *
+* Param:  Cache *c: the cache                                   *
+*         int addr: the address, inside memory                  *
+* Return: int*: pointer to the cached word, NULL if not cached  *
+*****************************************************************/
+int *cachePeek(Cache *c, int addr)
+{
+	int tag = addr >> c->lineShift;
+	CacheLine *set = &c->lines[(tag & (c->numSets - 1)) * c->numWays];
+
+	int i;
+	for(i = 0; i < c->numWays; i++)
+		if(set[i].tag == tag)
+			return &set[i].words[addr & (c->lineWords - 1)];
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Pick the line for addr after a miss, the caller       *
+*         fills it with *count words from *base                 *
+* Param:  Cache *c: the cache                                   *
+*         int addr: the address that missed                    *
+*         int *base: returns the first address of the line      *
+*         int *count: returns the number of words in the line   *
+* Return: int*: the words of the line                           *
+*****************************************************************/
+int *cacheAllocate(Cache *c, int addr, int *base, int *count)
+{
+	int tag = addr >> c->lineShift;
+	CacheLine *set = &c->lines[(tag & (c->numSets - 1)) * c->numWays];
+	
+	// Invalid line first, otherwise least recently used one
+	CacheLine *victim = &set[0];
+	int i;
+	for(i = 0; i < c->numWays && victim->tag != -1; i++)
+		if(set[i].tag == -1 || set[i].lastUse < victim->lastUse)
+			victim = &set[i];
+	
+	if(victim->tag != -1)
+		c->evictions[REGION(c, victim->tag << c->lineShift)]++;
+	
+	victim->tag = tag;
+	victim->lastUse = ++c->useClock;
+	*base = tag << c->lineShift;
+	*count = c->lineWords;
+	return victim->words;
+}
+
+/****************************************************************
+* Func:   Write-through: update the word if its line is cached  *
+* Param:  Cache *c: the cache                                   *
+*         int addr: the address written                        *
+*         int data: the data written                            *
+* Return: none                                                  *
+*****************************************************************/
+void cacheUpdate(Cache *c, int addr, int data)
+{
+	int tag = addr >> c->lineShift;
+	CacheLine *set = &c->lines[(tag & (c->numSets - 1)) * c->numWays];
+	
+	int i;
+	for(i = 0; i < c->numWays; i++)
+		if(set[i].tag == tag)
+		{
+			set[i].words[addr & (c->lineWords - 1)] = data;
+			return;
+		}
+}
+
+/****************************************************************
+* Func:   Print hit, miss and eviction counters to stderr       *
+* Param:  Cache *c: the cache                                   *
+* Return: none                                                  *
+*****************************************************************/
+void cachePrintStats(Cache *c)
+{
+	const char *name[2] = {"user", "system"};
+	
+	fprintf(stderr, "\nCache: %d sets x %d ways x %d words\n", c->numSets, c->numWays, c->lineWords);
+	int r;
+	for(r = 0; r < 2; r++)
+		fprintf(stderr, "  %-6s hits %lu, misses %lu, evictions %lu\n",
+		        name[r], c->hits[r], c->misses[r], c->evictions[r]);
+}
@@ -0,0 +1,20 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+// CPU-side cache in front of the memory transport
+// Direct-mapped when ways == 1, write-through, no write-allocate
+
+#define CACHE_MAX_SETS	4096
+#define CACHE_MAX_WAYS	16
+
+struct Cache;
+
+struct Cache *cacheCreate(int sets, int ways, int lineWords, int system, int size);
+void cacheFree(struct Cache *c);
+int *cacheLookup(struct Cache *c, int addr);
+int *cachePeek(struct Cache *c, int addr);
+int *cacheAllocate(struct Cache *c, int addr, int *base, int *count);
+void cacheUpdate(struct Cache *c, int addr, int data);
+void cachePrintStats(struct Cache *c);
+
+#endif
@@ -0,0 +1,77 @@
+/********************************************************************************
+*********************************************************************************
+**  Convert a text program into a binary image                                 **
+**  The image loads with one mmap() and no parsing, see Image.h                **
+**                                                                             **
+**  Usage: ./convert [-m size,system] program.txt program.img                  **
+**         -m must match the simulator's -m so segments split at the same      **
+**         system boundary                                                     **
+**  Build: gcc -o convert Convert.c Image.c Page.c                             **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "Image.h"
+#include "Memory.h"
+
+
+int main(int argc, char *argv[])
+{
+	int size = MEMORY_SIZE, system = SYSTEM_ADDRESS;
+	int opt;
+
+	while((opt = getopt(argc, argv, "m:")) != -1)
+	{
+		if(opt != 'm' || sscanf(optarg, "%d,%d", &size, &system) != 2
+		   || size <= 0 || size > MEMORY_MAX_SIZE || system <= 0 || system >= size)
+		{
+			printf("Usage: %s [-m size,system] program.txt program.img\n", argv[0]);
+			exit(1);
+		}
+	}
+	if(argc - optind != 2)
+	{
+		printf("Usage: %s [-m size,system] program.txt program.img\n", argv[0]);
+		exit(1);
+	}
+	const char *source = argv[optind], *target = argv[optind + 1];
+
+	FILE *fp = fopen(source, "r");
+	if(fp == NULL)
+	{
+		printf("Error! File does not exist: %s\n", source);
+		exit(1);
+	}
+
+	// Parse into a scratch memory, remember which words the program sets
+	PageTable *memory = pageCreate(size, 0);
+	unsigned char *loaded = calloc(size, 1);
+	if(memory == NULL || loaded == NULL)
+	{
+		printf("Out of memory\n");
+		exit(1);
+	}
+	char error[IMAGE_ERROR_SIZE];
+	int result = imageParseText(memory, loaded, fp, error);
+	fclose(fp);
+	if(result != IMAGE_OK)
+	{
+		printf("%s: %s\n", source, error);
+		exit(1);
+	}
+
+	int segments = imageWrite(memory, loaded, system, target);
+	if(segments < 0)
+	{
+		printf("Error! Can not write %s\n", target);
+		exit(1);
+	}
+
+	int words = 0, i;
+	for(i = 0; i < size; i++)
+		words += loaded[i];
+	printf("%s: %d words in %d segments\n", target, words, segments);
+	exit(0);
+}
@@ -0,0 +1,357 @@
+/********************************************************************************
+*********************************************************************************
+**  Differential validation of the execution engines                           **
+**  Runs the switch engine and a candidate engine side by side in steps of     **
+**  `every` instructions, compares rolling hashes of their state after each    **
+**  step, and finds the first instruction after which they differ, see Diff.h  **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int diffRun(char*, Layout*, int, ...); // Compare two engines         **
+**       void diffReport(char*, int, DiffResult*, FILE*); // Print the result  **
+**    - Internal:                                                              **
+**       int openPair(Pair*, char*, Layout*, int, ...); // Two fresh machines  **
+**       void closePair(Pair*);           // Free both machines                **
+**       void runPair(Pair*, long);       // Both run the same count           **
+**       int replay(Pair*, long long, long, long); // From the start to a step **
+**       void hashPut(void*, int, int);   // Put device: hash the output       **
+**       void capture(Side*, DiffState*); // What is compared of a machine     **
+**       uint64_t stateHash(DiffState*);  // Rolling hash of a state           **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CPU.h"
+#include "Instruction.h"
+#include "Verify.h"
+#include "Diff.h"
+
+
+// One machine of the comparison and its Put output
+typedef struct
+{
+	Machine *m;
+	uint64_t putHash;
+} Side;
+
+// Reference and candidate, and how to make them again
+typedef struct
+{
+	Side side[2];				// 0: switch engine, 1: candidate
+	const char *file;
+	const Layout *layout;
+	int timer;
+	unsigned long long seed;
+	int engine;
+	int verify;
+} Pair;
+
+
+// Function declare
+static int openPair(Pair *p, const char *file, const Layout *layout, int timer, unsigned long long seed,
+                    int engine, int verify);
+static void closePair(Pair *p);
+static void runPair(Pair *p, long count);
+static int replay(Pair *p, long long start, long every, long count);
+static void hashPut(void *user, int port, int value);
+static void capture(Side *s, DiffState *state);
+static uint64_t stateHash(const DiffState *state);
+
+
+static const char *const engineName[] = {"switch", "threaded", "block"};
+
+
+/****************************************************************
+* Func:   Run the switch engine and a candidate engine on the   *
+*         same program, compare them every `every`              *
+*         instructions, find the first divergence               *
+* Param:  char *file: the program, text or binary image         *
+*         Layout *layout: memory layout of both                 *
+*         int timer: timer period                               *
+*         unsigned long long seed: seed of Get                  *
+*         int engine: ENGINE_* of the candidate                 *
+*         int verify: 1 to verify first, so the candidate       *
+*                     takes its unchecked loads too             *
+*         long every: instructions between comparisons          *
+*         long budget: instructions at most, 0 until both stop  *
+*         DiffResult *result: where the outcome goes            *
+* Return: int: DIFF_SAME, DIFF_DIVERGED or DIFF_ERROR           *
+*****************************************************************/
+int diffRun(const char *file, const Layout *layout, int timer, unsigned long long seed,
+            int engine, int verify, long every, long budget, DiffResult *result)
+{
+	Pair p;
+	DiffState a, b;
+	long long done = 0;
+	long step = every;
+
+	result->instructions = 0;
+	result->checks = 0;
+	result->at = -1;
+	if(every <= 0 || openPair(&p, file, layout, timer, seed, engine, verify) != 0)
+		return DIFF_ERROR;
+
+	// Fast pass: one hash compare per step
+	for(;;)
+	{
+		step = every;
+		if(budget > 0 && budget - done < step)
+			step = budget - done;
+		if(step <= 0)
+			break;
+		runPair(&p, step);
+		done += step;
+		result->checks++;
+		capture(&p.side[0], &a);
+		capture(&p.side[1], &b);
+		if(stateHash(&a) != stateHash(&b))
+			break;
+		if(a.status != MACHINE_RUNNING && b.status != MACHINE_RUNNING)
+			break;
+	}
+	result->instructions = p.side[0].m->instructions;	// The switch engine counts a faulting one too
+	closePair(&p);
+	if(stateHash(&a) == stateHash(&b))
+		return DIFF_SAME;
+
+	// Equal after done - step, not after done: bisect the last step, each
+	// probe runs both again from the start in the same steps
+	long long start = done - step;
+	long low = 0, high = step;
+	while(high - low > 1)
+	{
+		long mid = low + (high - low) / 2;
+		int differ = replay(&p, start, every, mid);
+		if(differ < 0)
+			return DIFF_ERROR;
+		if(differ)
+			high = mid;
+		else
+			low = mid;
+	}
+
+	// The reference just before the instruction, then both just after it
+	if(replay(&p, start, every, high - 1) < 0)
+		return DIFF_ERROR;
+	Machine *ref = p.side[0].m;
+	result->pc = ref->PC;
+	result->opcode = ((unsigned)ref->PC < (unsigned)ref->layout.size) ? PAGE_LOAD(ref->memory, ref->PC) : -1;
+	closePair(&p);
+	if(replay(&p, start, every, high) < 0)
+		return DIFF_ERROR;
+	capture(&p.side[0], &result->reference);
+	capture(&p.side[1], &result->candidate);
+	closePair(&p);
+	result->at = start + high;
+	result->instructions = start + high;
+	return DIFF_DIVERGED;
+}
+
+/****************************************************************
+* Func:   Print the outcome of diffRun(): agreement, or the     *
+*         first divergence with every field that differs        *
+* Param:  char *file: the program                               *
+*         int engine: ENGINE_* of the candidate                 *
+*         DiffResult *result: from diffRun()                    *
+*         FILE *fp: where it goes                               *
+* Return: none                                                  *
+*****************************************************************/
+void diffReport(const char *file, int engine, const DiffResult *result, FILE *fp)
+{
+	const char *name = engineName[engine];
+
+	if(result->at < 0)
+	{
+		fprintf(fp, "diff: %s: switch and %s agree over %lld instructions, %lld checks\n", file, name,
+		        result->instructions, result->checks);
+		return;
+	}
+
+	const DiffState *a = &result->reference, *b = &result->candidate;
+	const char *op = instructionName(result->opcode);
+	fprintf(fp, "diff: %s: switch and %s differ after instruction %lld: PC %d, %s (%d)\n", file, name,
+	        result->at, result->pc, op != NULL ? op : "invalid", result->opcode);
+
+	// Field, switch value, candidate value
+	const struct
+	{
+		const char *field;
+		long long value[2];
+	} fields[] = {
+		{"PC", {a->PC, b->PC}}, {"SP", {a->SP, b->SP}}, {"AC", {a->AC, b->AC}},
+		{"X", {a->X, b->X}}, {"Y", {a->Y, b->Y}}, {"mode", {a->mode, b->mode}},
+		{"status", {a->status, b->status}}, {"fault", {a->faultAddress, b->faultAddress}},
+		{"clock", {a->clock, b->clock}},
+		{"instructions", {a->instructions, b->instructions}},
+	};
+	int i;
+	for(i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++)
+		if(fields[i].value[0] != fields[i].value[1])
+			fprintf(fp, "  %-12s switch %lld, %s %lld\n", fields[i].field, fields[i].value[0], name,
+			        fields[i].value[1]);
+	if(a->writeHash != b->writeHash)
+		fprintf(fp, "  memory writes differ (hash %016llx, %s %016llx)\n",
+		        (unsigned long long)a->writeHash, name, (unsigned long long)b->writeHash);
+	if(a->putHash != b->putHash)
+		fprintf(fp, "  Put output differs (hash %016llx, %s %016llx)\n",
+		        (unsigned long long)a->putHash, name, (unsigned long long)b->putHash);
+}
+
+/****************************************************************
+* Func:   Create the reference and the candidate machine        *
+* Param:  Pair *p: where they go, and what replay() needs       *
+*         the other parameters as for diffRun()                 *
+* Return: int: 0 on success, -1 on failure                      *
+*****************************************************************/
+static int openPair(Pair *p, const char *file, const Layout *layout, int timer, unsigned long long seed,
+                    int engine, int verify)
+{
+	int i;
+
+	p->file = file;
+	p->layout = layout;
+	p->timer = timer;
+	p->seed = seed;
+	p->engine = engine;
+	p->verify = verify;
+	for(i = 0; i < 2; i++)
+	{
+		Side *s = &p->side[i];
+		s->putHash = 0;
+		s->m = machineCreateLayout(TRANSPORT_LOCAL, layout);
+		if(s->m == NULL || machineLoadFile(s->m, file) != IMAGE_OK)
+		{
+			machineDestroy(s->m);
+			if(i == 1)
+				machineDestroy(p->side[0].m);
+			return -1;
+		}
+		machineSetTimer(s->m, timer);
+		machineSetSeed(s->m, seed);
+		machineSetEngine(s->m, (i == 0) ? ENGINE_SWITCH : engine);
+		machineSetDevices(s->m, hashPut, NULL, s);
+		s->m->hashWrites = 1;
+		s->m->generic = (i == 0);	// Reference is stepCPU(), also against -e switch
+		if(i == 1 && verify && verifyProgram(s->m, NULL) < 0)
+		{
+			closePair(p);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************
+* Func:   Free both machines of a pair                          *
+* Param:  Pair *p: the pair                                     *
+* Return: none                                                  *
+*****************************************************************/
+static void closePair(Pair *p)
+{
+	machineDestroy(p->side[0].m);
+	machineDestroy(p->side[1].m);
+	p->side[0].m = p->side[1].m = NULL;
+}
+
+/****************************************************************
+* Func:   Run both machines for the same count, a stopped one   *
+*         stays as it is                                        *
+* Param:  Pair *p: the pair                                     *
+*         long count: instructions                              *
+* Return: none                                                  *
+*****************************************************************/
+static void runPair(Pair *p, long count)
+{
+	machineRunFor(p->side[0].m, count);
+	machineRunFor(p->side[1].m, count);
+}
+
+/****************************************************************
+* Func:   Fresh machines run to start in steps of every, as the *
+*         fast pass did, then count more                        *
+* Param:  Pair *p: settings of the pair, machines closed        *
+*         long long start: a multiple of every                  *
+*         long every: step of the fast pass                     *
+*         long count: instructions after start                  *
+* Return: int: 1 if the two differ then, 0 if not, -1 if they   *
+*              can not be created; the machines stay open       *
+*****************************************************************/
+static int replay(Pair *p, long long start, long every, long count)
+{
+	DiffState a, b;
+	long long done;
+
+	closePair(p);
+	if(openPair(p, p->file, p->layout, p->timer, p->seed, p->engine, p->verify) != 0)
+		return -1;
+	for(done = 0; done < start; done += every)
+		runPair(p, every);
+	if(count > 0)
+		runPair(p, count);
+	capture(&p->side[0], &a);
+	capture(&p->side[1], &b);
+	return stateHash(&a) != stateHash(&b);
+}
+
+/****************************************************************
+* Func:   Put device of a compared machine: hash the output     *
+*         instead of printing it                                *
+* Param:  void *user: the Side                                  *
+*         int port: 1 int, 2 char                               *
+*         int value: AC                                         *
+* Return: none                                                  *
+*****************************************************************/
+static void hashPut(void *user, int port, int value)
+{
+	Side *s = user;
+	DIFF_MIX(s->putHash, port, value);
+}
+
+/****************************************************************
+* Func:   Take what is compared of a machine                    *
+* Param:  Side *s: the machine and its output hash              *
+*         DiffState *state: where it goes                       *
+* Return: none                                                  *
+*****************************************************************/
+static void capture(Side *s, DiffState *state)
+{
+	Machine *m = s->m;
+
+	memset(state, 0, sizeof(*state));
+	state->mode = m->mode;
+	state->status = m->status;
+	state->writeHash = m->writeHash;
+	state->putHash = s->putHash;
+	if(m->status == MACHINE_FAULT || m->status == MACHINE_INVALID)
+	{
+		state->faultAddress = (m->status == MACHINE_FAULT) ? m->faultAddress : 0;
+		return;					// The rest may be stale, see Diff.h
+	}
+	state->PC = m->PC;
+	state->SP = m->SP;
+	state->AC = m->AC;
+	state->X = m->X;
+	state->Y = m->Y;
+	state->clock = m->irq.clock;
+	state->instructions = m->instructions;
+}
+
+/****************************************************************
+* Func:   Rolling hash of a state, one number to compare        *
+* Param:  DiffState *state: the state                           *
+* Return: uint64_t: the hash                                    *
+*****************************************************************/
+static uint64_t stateHash(const DiffState *state)
+{
+	uint64_t h = state->writeHash;
+
+	DIFF_MIX(h, state->PC, state->SP);
+	DIFF_MIX(h, state->AC, state->X);
+	DIFF_MIX(h, state->Y, state->mode << 8 | state->status);
+	DIFF_MIX(h, state->faultAddress, 0);
+	DIFF_MIX(h, state->clock >> 32, state->clock);
+	DIFF_MIX(h, state->instructions >> 32, state->instructions);
+	DIFF_MIX(h, state->putHash >> 32, state->putHash);
+	return h;
+}
@@ -0,0 +1,69 @@
+#ifndef _DIFF_H_
+#define _DIFF_H_
+
+// Differential validation: the switch engine in its generic loop, whose
+// exeInstruction() is the reference, and a candidate engine run the same
+// program with the same seed and timer in one process (-t local). Every
+// `every` instructions the two are compared by a rolling hash of their
+// registers, interrupt clock, Put output and memory write stream; on a
+// mismatch both run again from the start, in the same steps, to find the
+// first instruction after which they differ
+//
+// The write stream is hashed in writeMemory() and the atomics, only for
+// machines with hashWrites set, see DIFF_WRITE()
+//
+// After a memory violation or an invalid instruction only status, mode, the
+// fault address, the writes and the output are compared: the threaded and
+// block engines leave through longjmp() with their registers and counts in
+// host locals, so the rest of the Machine is stale
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Machine.h"
+
+#define DIFF_SAME		0
+#define DIFF_DIVERGED	1
+#define DIFF_ERROR		-1		// Program could not be loaded, or out of memory
+
+// One step of the rolling hash: the word pair (a, b) into h
+#define DIFF_MIX(h, a, b)                                                   \
+	do{                                                                     \
+		(h) ^= ((uint64_t)(uint32_t)(a) << 32) | (uint32_t)(b);             \
+		(h) *= 0x9E3779B97F4A7C15ull;                                       \
+		(h) ^= (h) >> 31;                                                   \
+	}while(0)
+
+// Memory write stream of a machine under comparison
+#define DIFF_WRITE(m, addr, data)                                           \
+	do{                                                                     \
+		if((m)->hashWrites)                                                 \
+			DIFF_MIX((m)->writeHash, addr, data);                           \
+	}while(0)
+
+// What is compared of one machine
+typedef struct
+{
+	int PC, SP, AC, X, Y, mode, status;
+	int faultAddress;			// MACHINE_FAULT only
+	long long clock;			// User mode instructions, the timer's time base
+	long long instructions;
+	uint64_t writeHash;			// Memory write stream
+	uint64_t putHash;			// Put output
+} DiffState;
+
+// How a comparison went
+typedef struct
+{
+	long long instructions;		// Compared, up to the first divergence
+	long long checks;			// Hash comparisons made
+	long long at;				// Instruction after which the two first differ, or -1
+	int pc;						// Reference PC of that instruction
+	int opcode;					// Its opcode
+	DiffState reference, candidate;	// After instruction at
+} DiffResult;
+
+int diffRun(const char *file, const Layout *layout, int timer, unsigned long long seed,
+            int engine, int verify, long every, long budget, DiffResult *result);
+void diffReport(const char *file, int engine, const DiffResult *result, FILE *fp);
+
+#endif
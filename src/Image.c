@@ -0,0 +1,302 @@
+/********************************************************************************
+*********************************************************************************
+**  Load program images into memory                                            **
+**  Text: one pass over the file, one word per line, ".N" continues at N,      **
+**        any other line is a comment; errors name the line                    **
+**  Binary: header, segment table and words, mmap()ed and copied in place      **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int imageLoad(PageTable*, int, char*, char*); // Text or binary image **
+**       int imageParseText(PageTable*, char*, FILE*, char*); // Text format   **
+**       int imageWrite(PageTable*, char*, int, char*); // Write binary image  **
+**    - Internal:                                                              **
+**       int loadBinary(PageTable*, int, char*, size_t, char*); // Check, copy **
+**       uint32_t checksum(char*, size_t); // FNV-1a                           **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Image.h"
+#include "Memory.h"
+
+
+// Function declare
+static int loadBinary(PageTable *memory, int system, const unsigned char *image, size_t size,
+                      char *error);
+static uint32_t checksum(const unsigned char *data, size_t size);
+
+
+/****************************************************************
+* Func:   Load a program file into memory, binary images are    *
+*         recognised by their magic                             *
+* Param:  PageTable *memory: the memory                         *
+*         int system: first system address                      *
+*         char *path: the program file                          *
+*         char *error: IMAGE_ERROR_SIZE bytes for the message   *
+* Return: int: IMAGE_OK, IMAGE_NO_FILE or IMAGE_BAD             *
+*****************************************************************/
+int imageLoad(PageTable *memory, int system, const char *path, char *error)
+{
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL)
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "%s: can not open", path);
+		return IMAGE_NO_FILE;
+	}
+
+	char magic[4];
+	if(fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, IMAGE_MAGIC, 4) != 0)
+	{
+		// Text
+		rewind(fp);
+		int result = imageParseText(memory, NULL, fp, error);
+		fclose(fp);
+		return result;
+	}
+
+	// Binary: map the whole file, no parsing
+	struct stat st;
+	void *image = MAP_FAILED;
+	if(fstat(fileno(fp), &st) == 0)
+		image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	fclose(fp);
+	if(image == MAP_FAILED)
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "%s: can not map image", path);
+		return IMAGE_BAD;
+	}
+
+	int result = loadBinary(memory, system, image, st.st_size, error);
+	munmap(image, st.st_size);
+	return result;
+}
+
+/****************************************************************
+* Func:   Parse the text format in one pass                     *
+*         Line starting with a digit: one word                  *
+*         Line starting with '.': continue at the address       *
+*         Other lines: comment                                  *
+* Param:  PageTable *memory: the memory                         *
+*         char *loaded: one flag per word of memory, set for    *
+*                       every word loaded, may be NULL          *
+*         FILE *fp: the program text                            *
+*         char *error: IMAGE_ERROR_SIZE bytes for the message   *
+* Return: int: IMAGE_OK, or IMAGE_BAD with "line N: ..." text   *
+*****************************************************************/
+int imageParseText(PageTable *memory, unsigned char *loaded, FILE *fp, char *error)
+{
+	int line = 1, offset = 0;
+	int c;
+
+	while((c = getc(fp)) != EOF)
+	{
+		if(c >= '0' && c <= '9')
+		{
+			// Data line
+			long long value = 0;
+			do{
+				value = value * 10 + (c - '0');
+				if(value > INT_MAX)
+				{
+					snprintf(error, IMAGE_ERROR_SIZE, "line %d: number too large", line);
+					return IMAGE_BAD;
+				}
+				c = getc(fp);
+			}while(c >= '0' && c <= '9');
+
+			if(offset < 0 || offset >= memory->size)
+			{
+				snprintf(error, IMAGE_ERROR_SIZE, "line %d: address %d outside memory", line, offset);
+				return IMAGE_BAD;
+			}
+			PAGE_STORE(memory, offset, (int)value);
+			if(loaded != NULL)
+				loaded[offset] = 1;
+			offset++;
+		}
+		else if(c == '.')
+		{
+			// Load address
+			long long value = 0;
+			int digits = 0;
+			while((c = getc(fp)) == ' ' || c == '\t');
+			while(c >= '0' && c <= '9')
+			{
+				value = value * 10 + (c - '0');
+				if(value > INT_MAX)
+					value = INT_MAX;        // Outside memory either way
+				digits++;
+				c = getc(fp);
+			}
+			if(digits == 0)
+			{
+				snprintf(error, IMAGE_ERROR_SIZE, "line %d: '.' needs an address", line);
+				return IMAGE_BAD;
+			}
+			offset = value;
+		}
+
+		// Rest of the line is comment, whatever its length
+		while(c != '\n' && c != EOF)
+			c = getc(fp);
+		if(c == EOF)
+			break;
+		line++;
+	}
+	return IMAGE_OK;
+}
+
+/****************************************************************
+* Func:   Write loaded words as a binary image, one segment     *
+*         per run of words, split at the system boundary        *
+* Param:  PageTable *memory: the memory                         *
+*         char *loaded: one flag per word of memory, word i is  *
+*                       written if loaded[i] is set             *
+*         int system: first system address                      *
+*         char *path: the image file                            *
+* Return: int: number of segments, -1 if the file can not be    *
+*              written                                          *
+*****************************************************************/
+int imageWrite(PageTable *memory, const unsigned char *loaded, int system, const char *path)
+{
+	int segments = 0, words = 0;
+	int addr = 0;
+
+	// Count runs first, the table is sized by the program, not by memory
+	int runs = 0;
+	for(addr = 0; addr < memory->size; addr++)
+		if(loaded[addr] && (addr == 0 || !loaded[addr - 1] || addr == system))
+			runs++;
+	ImageSegment *table = malloc((runs + 1) * sizeof(ImageSegment));
+	if(table == NULL)
+		return -1;
+
+	// Runs of loaded words
+	addr = 0;
+	while(addr < memory->size)
+	{
+		if(!loaded[addr])
+		{
+			addr++;
+			continue;
+		}
+		ImageSegment *s = &table[segments++];
+		s->region = (addr < system) ? IMAGE_REGION_USER : IMAGE_REGION_SYSTEM;
+		s->address = addr;
+		while(addr < memory->size && loaded[addr] && (addr != system || addr == s->address))
+			addr++;
+		s->count = addr - s->address;
+		words += s->count;
+	}
+
+	// Header, table, words
+	size_t size = sizeof(ImageHeader) + segments * sizeof(ImageSegment) + words * sizeof(int32_t);
+	unsigned char *image = calloc(1, size);
+	if(image == NULL)
+	{
+		free(table);
+		return -1;
+	}
+	ImageHeader *h = (ImageHeader *)image;
+	memcpy(h->magic, IMAGE_MAGIC, 4);
+	h->version = IMAGE_VERSION;
+	h->segments = segments;
+
+	size_t at = sizeof(ImageHeader) + segments * sizeof(ImageSegment);
+	int i;
+	for(i = 0; i < segments; i++)
+	{
+		table[i].offset = at;
+		pageRead(memory, table[i].address, table[i].count, (int *)(image + at));
+		at += table[i].count * sizeof(int32_t);
+	}
+	memcpy(image + sizeof(ImageHeader), table, segments * sizeof(ImageSegment));
+	free(table);
+	h->checksum = checksum(image + sizeof(ImageHeader), size - sizeof(ImageHeader));
+
+	FILE *fp = fopen(path, "wb");
+	if(fp == NULL)
+	{
+		free(image);
+		return -1;
+	}
+	size_t written = fwrite(image, 1, size, fp);
+	free(image);
+	if(fclose(fp) != 0 || written != size)
+		return -1;
+	return segments;
+}
+
+
+/****************************************************************
+* Func:   Check a binary image and copy its segments            *
+* Param:  PageTable *memory: the memory                         *
+*         int system: first system address                      *
+*         char *image: the whole file                           *
+*         size_t size: bytes of the file                        *
+*         char *error: IMAGE_ERROR_SIZE bytes for the message   *
+* Return: int: IMAGE_OK or IMAGE_BAD                            *
+*****************************************************************/
+int loadBinary(PageTable *memory, int system, const unsigned char *image, size_t size, char *error)
+{
+	const ImageHeader *h = (const ImageHeader *)image;
+
+	if(size < sizeof(ImageHeader) || h->version != IMAGE_VERSION
+	   || size < sizeof(ImageHeader) + (size_t)h->segments * sizeof(ImageSegment))
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "unsupported or truncated image");
+		return IMAGE_BAD;
+	}
+	if(checksum(image + sizeof(ImageHeader), size - sizeof(ImageHeader)) != h->checksum)
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "image checksum mismatch");
+		return IMAGE_BAD;
+	}
+
+	// Check every segment before the first word is copied
+	const ImageSegment *table = (const ImageSegment *)(image + sizeof(ImageHeader));
+	int i;
+	for(i = 0; i < h->segments; i++)
+	{
+		const ImageSegment *s = &table[i];
+		uint32_t low = (s->region == IMAGE_REGION_USER) ? 0 : system;
+		uint32_t high = (s->region == IMAGE_REGION_USER) ? system : memory->size;
+		if(s->region > IMAGE_REGION_SYSTEM || s->address < low || s->address > high
+		   || s->count > high - s->address
+		   || s->offset % sizeof(int32_t) != 0 || s->offset > size
+		   || s->count > (size - s->offset) / sizeof(int32_t))
+		{
+			snprintf(error, IMAGE_ERROR_SIZE, "segment %d: bad region, address or offset", i);
+			return IMAGE_BAD;
+		}
+	}
+
+	for(i = 0; i < h->segments; i++)
+		pageWrite(memory, table[i].address, table[i].count, (const int32_t *)(image + table[i].offset));
+	return IMAGE_OK;
+}
+
+/****************************************************************
+* Func:   FNV-1a hash                                           *
+* Param:  char *data: the bytes                                 *
+*         size_t size: number of bytes                          *
+* Return: uint32_t: the hash                                    *
+*****************************************************************/
+uint32_t checksum(const unsigned char *data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for(i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
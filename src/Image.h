@@ -0,0 +1,51 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Page.h"
+
+// Program image: the text format of the sample folder, or a binary image
+// that is mmap()ed and copied into memory without parsing
+//
+// Binary layout, host byte order:
+//   ImageHeader
+//   ImageSegment[segments]
+//   int32 words of every segment
+// checksum is FNV-1a over everything after the header
+
+#define IMAGE_MAGIC		"CPUI"
+#define IMAGE_VERSION	1
+
+#define IMAGE_REGION_USER	0	// Segment below the system boundary
+#define IMAGE_REGION_SYSTEM	1	// Segment from the system boundary to the end of memory
+
+// Result of imageLoad
+#define IMAGE_OK		0
+#define IMAGE_NO_FILE	-1		// File can not be opened
+#define IMAGE_BAD		-2		// Syntax error or damaged image, see error text
+
+#define IMAGE_ERROR_SIZE 128
+
+typedef struct
+{
+	char magic[4];				// IMAGE_MAGIC
+	uint16_t version;			// IMAGE_VERSION
+	uint16_t segments;			// Entries of the segment table
+	uint32_t checksum;
+	uint32_t reserved;			// 0
+} ImageHeader;
+
+typedef struct
+{
+	uint32_t region;			// IMAGE_REGION_*
+	uint32_t address;			// Load address of the first word
+	uint32_t count;				// Words
+	uint32_t offset;			// Byte offset of the words in the file
+} ImageSegment;
+
+int imageLoad(PageTable *memory, int system, const char *path, char *error);
+int imageParseText(PageTable *memory, unsigned char *loaded, FILE *fp, char *error);
+int imageWrite(PageTable *memory, const unsigned char *loaded, int system, const char *path);
+
+#endif
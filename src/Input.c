@@ -0,0 +1,194 @@
+/********************************************************************************
+*********************************************************************************
+**  Input device for Get                                                       **
+**  Get used to reseed rand() from time() on every call; now each machine      **
+**  owns a xoshiro256** generator seeded once, so runs are fast and a given    **
+**  seed replays the same numbers. A script file of numbers may feed Get       **
+**  first, the generator continues when it runs out                            **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Input *inputCreate(unsigned long long); // New device with a seed     **
+**       void inputFree(Input*);          // Release device, close script      **
+**       void inputSeed(Input*, unsigned long long); // Restart generator      **
+**       int inputSetScript(Input*, char*); // Replay numbers from a file      **
+**       int inputGet(void*);             // Get device: next number           **
+**       void inputSave(Input*, InputState*); // State for a snapshot          **
+**       void inputRestore(Input*, InputState*); // State from a snapshot      **
+**    - Internal:                                                              **
+**       uint64_t nextRandom(Input*);     // xoshiro256** step                 **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "Input.h"
+
+
+// One input device
+typedef struct Input
+{
+	uint64_t state[4];			// xoshiro256** state, never all zero
+	FILE *script;				// Numbers to replay, NULL if none
+} Input;
+
+
+// Function declare
+static uint64_t nextRandom(Input *in);
+
+
+#define ROTL(x, k) (((x) << (k)) | ((x) >> (64 - (k))))
+
+
+/****************************************************************
+* Func:   Create an input device                                *
+* Param:  unsigned long long seed: seed of the generator        *
+* Return: Input*: the device, NULL on failure                   *
+*****************************************************************/
+Input *inputCreate(unsigned long long seed)
+{
+	Input *in = calloc(1, sizeof(Input));
+	if(in == NULL)
+		return NULL;
+	inputSeed(in, seed);
+	return in;
+}
+
+/****************************************************************
+* Func:   Release an input device                               *
+* Param:  Input *in: the device, may be NULL                    *
+* Return: none                                                  *
+*****************************************************************/
+void inputFree(Input *in)
+{
+	if(in == NULL)
+		return;
+	if(in->script != NULL)
+		fclose(in->script);
+	free(in);
+}
+
+/****************************************************************
+* Func:   Restart the generator from a seed                     *
+* Param:  Input *in: the device                                 *
+*         unsigned long long seed: any value, 0 included        *
+* Return: none                                                  *
+*                                                               *
+* splitmix64 spreads the seed over the four state words, so     *
+* the state is never all zero                                   *
+*****************************************************************/
+void inputSeed(Input *in, unsigned long long seed)
+{
+	uint64_t x = seed;
+	int i;
+
+	for(i = 0; i < 4; i++)
+	{
+		uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		in->state[i] = z ^ (z >> 31);
+	}
+}
+
+/****************************************************************
+* Func:   Replay numbers from a file before the generator       *
+* Param:  Input *in: the device                                 *
+*         char *path: whitespace separated integers             *
+* Return: int: 0 on success, -1 if the file can not be opened   *
+*****************************************************************/
+int inputSetScript(Input *in, const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL)
+		return -1;
+	if(in->script != NULL)
+		fclose(in->script);
+	in->script = fp;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Get device: next number of the script, or a random    *
+*         int from 1 to 100                                     *
+* Param:  void *user: Input*                                    *
+* Return: int: the number                                       *
+*****************************************************************/
+int inputGet(void *user)
+{
+	Input *in = user;
+
+	if(in->script != NULL)
+	{
+		int value;
+		if(fscanf(in->script, "%d", &value) == 1)
+			return value;
+		fclose(in->script);     // Script used up
+		in->script = NULL;
+	}
+
+	// Top 32 bits scaled to [0, 100) without a division
+	return (int)(((nextRandom(in) >> 32) * 100) >> 32) + 1;
+}
+
+/****************************************************************
+* Func:   Copy out the device state for a snapshot              *
+* Param:  Input *in: the device                                 *
+*         InputState *state: where to store it                  *
+* Return: none                                                  *
+*****************************************************************/
+void inputSave(Input *in, InputState *state)
+{
+	int i;
+	for(i = 0; i < 4; i++)
+		state->state[i] = in->state[i];
+	state->scriptOffset = (in->script != NULL) ? ftell(in->script) : -1;
+}
+
+/****************************************************************
+* Func:   Continue from a saved device state                    *
+* Param:  Input *in: the device                                 *
+*         InputState *state: from inputSave()                   *
+* Return: none                                                  *
+*                                                               *
+* The script itself is not saved: a script set again with       *
+* inputSetScript() continues at the saved offset, one that was  *
+* used up at save time is dropped                               *
+*****************************************************************/
+void inputRestore(Input *in, const InputState *state)
+{
+	int i;
+	for(i = 0; i < 4; i++)
+		in->state[i] = state->state[i];
+	if(in->script == NULL)
+		return;
+	if(state->scriptOffset < 0)
+	{
+		fclose(in->script);
+		in->script = NULL;
+	}
+	else
+		fseek(in->script, state->scriptOffset, SEEK_SET);
+}
+
+
+/****************************************************************
+* Func:   Advance xoshiro256**                                  *
+* Param:  Input *in: the device                                 *
+* Return: uint64_t: 64 random bits                              *
+*****************************************************************/
+uint64_t nextRandom(Input *in)
+{
+	uint64_t *s = in->state;
+	uint64_t result = ROTL(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = ROTL(s[3], 45);
+
+	return result;
+}
@@ -0,0 +1,26 @@
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+// Input device behind Get: a per-machine xoshiro256** generator, seeded once,
+// or a script of numbers that is replayed before the generator takes over
+
+#include <stdint.h>
+
+// Device state kept in snapshots: the generator, and how far the script was read
+typedef struct
+{
+	uint64_t state[4];
+	int64_t scriptOffset;		// -1 if no script is being replayed
+} InputState;
+
+struct Input;
+
+struct Input *inputCreate(unsigned long long seed);
+void inputFree(struct Input *in);
+void inputSeed(struct Input *in, unsigned long long seed);
+int inputSetScript(struct Input *in, const char *path);
+int inputGet(void *user);
+void inputSave(struct Input *in, InputState *state);
+void inputRestore(struct Input *in, const InputState *state);
+
+#endif
@@ -0,0 +1,63 @@
+/********************************************************************************
+*********************************************************************************
+**  Names of the instruction set, shared by the profiler and the trace tools   **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       char *instructionName(int);      // Name of an opcode                 **
+*********************************************************************************
+********************************************************************************/
+
+#include <stddef.h>
+#include "Instruction.h"
+
+
+// Spelling of the instruction set in README.md
+static const char *const names[END + 1] = {
+	[LOAD_VALUE]             = "LoadValue",
+	[LOAD_ADDR]              = "LoadAddr",
+	[LOAD_IND_ADDR]          = "LoadInd",
+	[LOAD_IDX_X_ADDR]        = "LoadIdxX",
+	[LOAD_IDX_Y_ADDR]        = "LoadIdxY",
+	[LOAD_SP_X]              = "LoadSpX",
+	[STORE_ADDR]             = "Store",
+	[GET]                    = "Get",
+	[PUT_PORT]               = "Put",
+	[ADD_X]                  = "AddX",
+	[ADD_Y]                  = "AddY",
+	[SUB_X]                  = "SubX",
+	[SUB_Y]                  = "SubY",
+	[COPY_TO_X]              = "CopyToX",
+	[COPY_FROM_X]            = "CopyFromX",
+	[COPY_TO_Y]              = "CopyToY",
+	[COPY_FROM_Y]            = "CopyFromY",
+	[COPY_TO_SP]             = "CopyToSp",
+	[COPY_FROM_SP]           = "CopyFromSp",
+	[JUMP_ADDR]              = "Jump",
+	[JUMP_IF_EQUAL_ADDR]     = "JumpIfEqual",
+	[JUMP_IF_NOT_EQUAL_ADDR] = "JumpIfNotEqual",
+	[CALL_ADDR]              = "Call",
+	[RET]                    = "Ret",
+	[INC_X]                  = "IncX",
+	[DEC_X]                  = "DecX",
+	[PUSH]                   = "Push",
+	[POP]                    = "Pop",
+	[INT]                    = "Int",
+	[I_RET]                  = "IRet",
+	[COMPARE_SWAP]           = "CompareSwap",
+	[FETCH_ADD]              = "FetchAdd",
+	[GET_PORT]               = "GetPort",
+	[END]                    = "End",
+};
+
+
+/****************************************************************
+* Func:   Name of an opcode                                     *
+* Param:  int opcode: any value                                 *
+* Return: char*: the name, NULL if opcode is not an instruction *
+*****************************************************************/
+const char *instructionName(int opcode)
+{
+	if(opcode < 0 || opcode > END)
+		return NULL;
+	return names[opcode];
+}
@@ -0,0 +1,195 @@
+/********************************************************************************
+*********************************************************************************
+**  Interrupt controller                                                       **
+**  Timers used to be one counter compared with the period on every            **
+**  instruction. Now timers are deadlines on the user mode instruction clock,  **
+**  lines are raised, masked and taken through one controller, and the         **
+**  engines compare the clock with a single next-event value                   **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       void irqInit(InterruptController*, int, int); // Power-on state       **
+**       void irqReset(InterruptController*); // Clock to 0, timers restart    **
+**       int irqSetTimer(InterruptController*, int, int, int, int); // Timer   **
+**       int irqSetVector(InterruptController*, int, int); // Handler of line  **
+**       int irqRaise(InterruptController*, int); // Make a line pending       **
+**       int irqMask(InterruptController*, int, int); // Mask or unmask line   **
+**       int irqTake(InterruptController*); // Line to enter now, if any       **
+**    - Internal:                                                              **
+**       void schedule(InterruptController*); // Recompute next                **
+*********************************************************************************
+********************************************************************************/
+
+#include <string.h>
+#include "Interrupt.h"
+
+
+// Function declare
+static void schedule(InterruptController *ic);
+
+
+/****************************************************************
+* Func:   Controller at power-on: timer and int vectors set,    *
+*         every timer stopped, nothing pending or masked        *
+* Param:  InterruptController *ic: the controller               *
+*         int timerHandler: vector of IRQ_TIMER                 *
+*         int intHandler: vector of IRQ_INT                     *
+* Return: none                                                  *
+*****************************************************************/
+void irqInit(InterruptController *ic, int timerHandler, int intHandler)
+{
+	int i;
+
+	memset(ic, 0, sizeof(*ic));
+	for(i = 0; i < IRQ_LINES; i++)
+		ic->vector[i] = -1;
+	ic->vector[IRQ_TIMER] = timerHandler;
+	ic->vector[IRQ_INT] = intHandler;
+	for(i = 0; i < IRQ_TIMERS; i++)
+		ic->timer[i].deadline = IRQ_NEVER;
+	IRQ_SET_NEXT(ic, IRQ_NEVER);
+}
+
+/****************************************************************
+* Func:   Clock back to 0 and nothing pending; periodic timers  *
+*         start a new period, one-shot timers stop              *
+* Param:  InterruptController *ic: the controller               *
+* Return: none, vectors and masks are kept                      *
+*****************************************************************/
+void irqReset(InterruptController *ic)
+{
+	int i;
+
+	ic->clock = 0;
+	ic->pending = 0;
+	for(i = 0; i < IRQ_TIMERS; i++)
+		ic->timer[i].deadline = (ic->timer[i].period > 0) ? ic->timer[i].period : IRQ_NEVER;
+	schedule(ic);
+}
+
+/****************************************************************
+* Func:   Start or stop a timer                                 *
+* Param:  InterruptController *ic: the controller               *
+*         int timer: 0 to IRQ_TIMERS-1                          *
+*         int line: line it raises                              *
+*         int delay: user instructions to the first firing,     *
+*                    < 0 stops the timer                        *
+*         int period: user instructions between firings after   *
+*                     that, 0 for one-shot                      *
+* Return: int: 0 on success, -1 for a bad timer or line         *
+*****************************************************************/
+int irqSetTimer(InterruptController *ic, int timer, int line, int delay, int period)
+{
+	if(timer < 0 || timer >= IRQ_TIMERS || line < 0 || line >= IRQ_LINES || period < 0)
+		return -1;
+
+	IrqTimer *t = &ic->timer[timer];
+	t->line = line;
+	t->period = period;
+	t->deadline = (delay >= 0) ? ic->clock + delay : IRQ_NEVER;
+	schedule(ic);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Set the handler of a line                             *
+* Param:  InterruptController *ic: the controller               *
+*         int line: 0 to IRQ_LINES-1                            *
+*         int address: handler, -1 drops the line when taken    *
+* Return: int: 0 on success, -1 for a bad line                  *
+*****************************************************************/
+int irqSetVector(InterruptController *ic, int line, int address)
+{
+	if(line < 0 || line >= IRQ_LINES)
+		return -1;
+	ic->vector[line] = (address >= 0) ? address : -1;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Make a line pending, it is taken at the next check in *
+*         user mode unless masked                               *
+* Param:  InterruptController *ic: the controller               *
+*         int line: 0 to IRQ_LINES-1                            *
+* Return: int: 0 on success, -1 for a bad line                  *
+*****************************************************************/
+int irqRaise(InterruptController *ic, int line)
+{
+	if(line < 0 || line >= IRQ_LINES)
+		return -1;
+	ic->pending |= 1u << line;
+	schedule(ic);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Mask or unmask a line, a masked line stays pending    *
+* Param:  InterruptController *ic: the controller               *
+*         int line: 0 to IRQ_LINES-1                            *
+*         int masked: 1 to mask, 0 to unmask                    *
+* Return: int: 0 on success, -1 for a bad line                  *
+*****************************************************************/
+int irqMask(InterruptController *ic, int line, int masked)
+{
+	if(line < 0 || line >= IRQ_LINES)
+		return -1;
+	if(masked)
+		ic->masked |= 1u << line;
+	else
+		ic->masked &= ~(1u << line);
+	schedule(ic);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Fire the timers that are due and pick the line to     *
+*         enter, called once clock reaches next in user mode    *
+* Param:  InterruptController *ic: the controller               *
+* Return: int: the line, no longer pending, -1 if none is due   *
+*****************************************************************/
+int irqTake(InterruptController *ic)
+{
+	int i, line = -1;
+
+	for(i = 0; i < IRQ_TIMERS; i++)
+	{
+		IrqTimer *t = &ic->timer[i];
+		if(t->deadline > ic->clock)
+			continue;
+		ic->pending |= 1u << t->line;
+		t->deadline = (t->period > 0) ? t->deadline + t->period : IRQ_NEVER;
+	}
+
+	// Lowest line first, a line without a handler is dropped
+	uint32_t due = ic->pending & ~ic->masked;
+	while(due != 0 && line < 0)
+	{
+		i = __builtin_ctz(due);
+		due &= due - 1;
+		ic->pending &= ~(1u << i);
+		if(ic->vector[i] >= 0)
+			line = i;
+	}
+	schedule(ic);
+	return line;
+}
+
+
+/****************************************************************
+* Func:   Recompute next: clock if an unmasked line is pending, *
+*         else the earliest timer deadline                      *
+* Param:  InterruptController *ic: the controller               *
+* Return: none                                                  *
+*****************************************************************/
+void schedule(InterruptController *ic)
+{
+	int64_t next = IRQ_NEVER;
+	int i;
+
+	if(ic->pending & ~ic->masked)
+		next = ic->clock;
+	else
+		for(i = 0; i < IRQ_TIMERS; i++)
+			if(ic->timer[i].deadline < next)
+				next = ic->timer[i].deadline;
+	IRQ_SET_NEXT(ic, next);		// One store, the reader thread may write it too
+}
@@ -0,0 +1,55 @@
+#ifndef _INTERRUPT_H_
+#define _INTERRUPT_H_
+
+#include <stdint.h>
+
+// Interrupt controller: timers on a deadline queue, pending and masked lines
+// and a vector table. Time is counted in user mode instructions, as the timer
+// always was. The engines only compare the clock with next, the earliest
+// moment anything can happen, and call irqTake() when it is reached
+//
+// Interrupts are taken in user mode only, one at a time: a handler runs in
+// kernel mode until IRet, so interrupts never nest. Lines raised meanwhile
+// stay pending and are taken, lowest line first, once back in user mode
+//
+// The input port's reader thread may pull next down to 0 at any time, so
+// the engines load it with IRQ_NEXT(), never from a register they kept, and
+// the CPU thread publishes a new value with one IRQ_SET_NEXT()
+
+#define IRQ_TIMER		0		// Timer 0, vector layout.timerHandler
+#define IRQ_INT			1		// Int instruction, vector layout.intHandler
+#define IRQ_INPUT		2		// Input port has data, see Stream.h
+#define IRQ_LINES		8
+#define IRQ_TIMERS		4
+#define IRQ_NEVER		INT64_MAX	// Deadline of a stopped timer
+
+#define IRQ_NEXT(ic)	__atomic_load_n(&(ic)->next, __ATOMIC_RELAXED)
+#define IRQ_SET_NEXT(ic, v)	__atomic_store_n(&(ic)->next, (v), __ATOMIC_RELAXED)
+
+typedef struct
+{
+	int64_t deadline;			// Clock it fires at, IRQ_NEVER if stopped
+	int32_t period;				// Clock between firings, 0 for one-shot
+	int32_t line;				// Line it raises
+} IrqTimer;
+
+// Fixed-size fields only, snapshots store it as it is
+typedef struct
+{
+	int64_t clock;				// User mode instructions since reset
+	int64_t next;				// Earliest deadline, or clock if a line is due
+	uint32_t pending;			// Bit per line
+	uint32_t masked;			// Bit per line, masked lines stay pending
+	int32_t vector[IRQ_LINES];	// Handler address per line, -1 if none
+	IrqTimer timer[IRQ_TIMERS];
+} InterruptController;
+
+void irqInit(InterruptController *ic, int timerHandler, int intHandler);
+void irqReset(InterruptController *ic);
+int irqSetTimer(InterruptController *ic, int timer, int line, int delay, int period);
+int irqSetVector(InterruptController *ic, int line, int address);
+int irqRaise(InterruptController *ic, int line);
+int irqMask(InterruptController *ic, int line, int masked);
+int irqTake(InterruptController *ic);
+
+#endif
@@ -0,0 +1,785 @@
+/********************************************************************************
+*********************************************************************************
+**  Embedded simulator API                                                     **
+**  A Machine holds registers, memory, engine state and devices, so a host     **
+**  program can load an image and run it in-process, without fork() and        **
+**  without prompts; the forked simulator is a thin wrapper around it          **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int layoutInit(Layout*, int, int, int); // Layout from size/boundary  **
+**       int layoutForCPU(Layout*, int);  // Stacks of a further CPU           **
+**       Machine *machineCreate(int);     // New machine, program not loaded   **
+**       Machine *machineCreateLayout(int, Layout*); // ... with a layout      **
+**       Machine *machineCreateCPU(Machine*); // Another CPU on its memory     **
+**       void machineDestroy(Machine*);   // Free machine                      **
+**       void machineReset(Machine*);     // Registers to power-on state       **
+**       int machineLoadFile(Machine*, char*); // Load a text or binary image  **
+**       void machineLoadImage(Machine*, int*, int, int); // Load words        **
+**       void machineSetTimer(Machine*, int); // Timer interrupt period        **
+**       void machineSetEngine(Machine*, int); // Execution engine             **
+**       int machineSetCache(Machine*, int, int, int); // CPU-side cache       **
+**       int machineSetTiming(Machine*, char*, int, int, int); // Cycle model  **
+**       void machineSetDevices(Machine*, PutDevice, GetDevice, void*);        **
+**       int machineSetOutput(Machine*, int, char*); // Sink of output device  **
+**       void machineFlush(Machine*);     // Flush buffered output             **
+**       void machineSetSeed(Machine*, unsigned long long); // Seed of Get     **
+**       int machineSetScript(Machine*, char*); // Numbers for Get from a file **
+**       int machineSetStream(Machine*, char*, int); // Input port for GetPort **
+**       void machineConnect(Machine*, int, int); // Pipes to memory process   **
+**       int machineSave(Machine*, char*, char*); // Snapshot, full or delta   **
+**       int machineRestore(Machine*, char*); // Continue from a snapshot      **
+**       int machineSetCheckpoints(Machine*, long, char*); // Periodic saves   **
+**       int machineCheckpoint(Machine*); // Write the next checkpoint         **
+**       int machineSetProfile(Machine*, char*); // Where the profile goes     **
+**       int machineSetSymbols(Machine*, char*); // Names for the profile      **
+**       int machineSetTrace(Machine*, char*); // Start or stop a trace        **
+**       int machineStep(Machine*);       // Run one instruction               **
+**       int machineRunFor(Machine*, long); // Run up to N instructions        **
+**       int machineRun(Machine*);        // Run until End or fault            **
+**       int machineStatusText(Machine*, char*, int); // Why it stopped        **
+**       void machineFault(Machine*, int, int); // Stop running instruction    **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "CPU.h"
+#include "Cache.h"
+#include "Output.h"
+#include "Input.h"
+#include "Stream.h"
+#include "Snapshot.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "Symbol.h"
+#include "Verify.h"
+#include "Special.h"
+#include "Timing.h"
+
+
+#define DEFAULT_TIME_SET 1000
+
+
+/****************************************************************
+* Func:   Fill a layout: user program and stack below the       *
+*         system boundary, timer handler at the boundary,       *
+*         system stack at the top of memory                     *
+* Param:  Layout *l: the layout to fill                         *
+*         int size: words of memory, at most MEMORY_MAX_SIZE    *
+*         int system: first system address                      *
+*         int intHandler: int instruction handler, <= 0 for the *
+*                         middle of the system area             *
+* Return: int: 0 on success, -1 if the values do not fit        *
+*                                                               *
+* layoutInit(l, MEMORY_SIZE, SYSTEM_ADDRESS, 0) gives the       *
+* original 2000-word machine                                    *
+*****************************************************************/
+int layoutInit(Layout *l, int size, int system, int intHandler)
+{
+	if(size <= 0 || size > MEMORY_MAX_SIZE || system <= 0 || system >= size)
+		return -1;
+	if(intHandler <= 0)
+		intHandler = system + (size - system) / 2;
+	if(intHandler < system || intHandler >= size)
+		return -1;
+
+	l->size = size;
+	l->system = system;
+	l->userStack = system;
+	l->timerHandler = system;
+	l->intHandler = intHandler;
+	l->systemStack = size;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Move the stacks of a layout to those of CPU n: both   *
+*         n * CPU_STACK_WORDS lower                             *
+* Param:  Layout *l: the layout of CPU 0, changed               *
+*         int n: the CPU, >= 0                                  *
+* Return: int: 0 on success, -1 if the stacks would run out of  *
+*              memory or into the handlers                      *
+*****************************************************************/
+int layoutForCPU(Layout *l, int n)
+{
+	int userStack = l->userStack - n * CPU_STACK_WORDS;
+	int systemStack = l->systemStack - n * CPU_STACK_WORDS;
+	if(userStack - CPU_STACK_WORDS < 0 || systemStack - CPU_STACK_WORDS <= l->intHandler
+	   || systemStack - CPU_STACK_WORDS <= l->timerHandler)
+		return -1;
+	l->userStack = userStack;
+	l->systemStack = systemStack;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Create a machine with the default 2000-word memory    *
+* Param:  int transport: TRANSPORT_LOCAL for in-process use,    *
+*                        TRANSPORT_PIPE/TRANSPORT_SHM to talk   *
+*                        to a memory process                    *
+* Return: Machine*: the machine, NULL on failure                *
+*****************************************************************/
+Machine *machineCreate(int transport)
+{
+	Layout l;
+
+	layoutInit(&l, MEMORY_SIZE, SYSTEM_ADDRESS, INT_ADDRESS);
+	return machineCreateLayout(transport, &l);
+}
+
+/****************************************************************
+* Func:   Create a machine with its memory                      *
+* Param:  int transport: TRANSPORT_LOCAL for in-process use,    *
+*                        TRANSPORT_PIPE/TRANSPORT_SHM to talk   *
+*                        to a memory process                    *
+*         Layout *layout: memory layout, see layoutInit()       *
+* Return: Machine*: the machine, NULL on failure or if a        *
+*                   handler or stack is outside memory          *
+*****************************************************************/
+Machine *machineCreateLayout(int transport, const Layout *layout)
+{
+	const Layout *l = layout;
+	if(l->size <= 0 || l->size > MEMORY_MAX_SIZE || l->system <= 0 || l->system >= l->size
+	   || l->userStack < 0 || l->userStack > l->size || l->systemStack < 2 || l->systemStack > l->size
+	   || l->timerHandler < 0 || l->timerHandler >= l->size
+	   || l->intHandler < 0 || l->intHandler >= l->size)
+		return NULL;
+
+	Machine *m = calloc(1, sizeof(Machine));
+	if(m == NULL)
+		return NULL;
+
+	m->layout = *l;
+	m->limit[USER_MODE] = l->system;
+	m->limit[KERNEL_MODE] = l->size;
+	m->memory = pageCreate(l->size, transport == TRANSPORT_SHM);	// Shared before fork()
+	m->output = outputCreate(OUTPUT_STDOUT, NULL);
+	m->input = inputCreate(time(NULL));	// Seeded once, machineSetSeed() for replays
+	if(m->memory == NULL || m->output == NULL || m->input == NULL)
+	{
+		pageFree(m->memory);
+		outputFree(m->output);
+		inputFree(m->input);
+		free(m);
+		return NULL;
+	}
+	m->transport = transport;
+	m->cpus = 1;
+	m->wtpd = m->rdpd = -1;
+	m->engine = ENGINE_SWITCH;
+	irqInit(&m->irq, l->timerHandler, l->intHandler);
+	irqSetTimer(&m->irq, 0, IRQ_TIMER, DEFAULT_TIME_SET, DEFAULT_TIME_SET);
+	m->put = outputPut;
+	m->putData = m->output;
+	m->get = inputGet;
+	m->getData = m->input;
+	machineReset(m);
+#ifdef PROFILE
+	if((m->profile = profileCreate(l->size)) == NULL)
+	{
+		machineDestroy(m);
+		return NULL;
+	}
+#endif
+
+	return m;
+}
+
+/****************************************************************
+* Func:   Create another CPU on the memory of a machine: same   *
+*         layout, engine, timer and devices, its own registers, *
+*         stacks and interrupt controller                       *
+* Param:  Machine *boot: CPU 0, TRANSPORT_LOCAL; destroy the    *
+*                        other CPUs before it                   *
+* Return: Machine*: the CPU, NULL if out of memory, if boot is  *
+*                   not local or the stacks do not fit          *
+*                                                               *
+* CPU n starts at address 0 with n in AC; its stacks are        *
+* n * CPU_STACK_WORDS below those of CPU 0. Put output goes to  *
+* the same sink through an own buffer, Get has its own          *
+* generator seeded from CPU 0's                                 *
+*****************************************************************/
+Machine *machineCreateCPU(Machine *boot)
+{
+	Layout l = boot->layout;
+	int n = boot->cpus;
+	if(boot->transport != TRANSPORT_LOCAL || boot->boot != NULL || layoutForCPU(&l, n) != 0)
+		return NULL;
+
+	Machine *m = calloc(1, sizeof(Machine));
+	if(m == NULL)
+		return NULL;
+
+	InputState state;
+	inputSave(boot->input, &state);
+	m->layout = l;
+	m->limit[USER_MODE] = l.system;
+	m->limit[KERNEL_MODE] = l.size;
+	m->memory = boot->memory;
+	m->output = outputShare(boot->output);
+	m->input = inputCreate(state.state[0] ^ (0x9E3779B97F4A7C15ull * n));
+	if(m->output == NULL || m->input == NULL)
+	{
+		outputFree(m->output);
+		inputFree(m->input);
+		free(m);
+		return NULL;
+	}
+	m->boot = boot;
+	m->cpu = n;
+	m->transport = TRANSPORT_LOCAL;
+	m->wtpd = m->rdpd = -1;
+	m->engine = boot->engine;
+	m->irq = boot->irq;				// Same timers and vectors, counted per CPU
+	machineSetDevices(m, NULL, NULL, NULL);
+	if(boot->put != outputPut || boot->get != inputGet)	// Devices of the host are shared
+		machineSetDevices(m, boot->put != outputPut ? boot->put : NULL,
+		                  boot->get != inputGet ? boot->get : NULL,
+		                  boot->put != outputPut ? boot->putData : boot->getData);
+	machineReset(m);
+#ifdef PROFILE
+	if((m->profile = profileCreate(l.size)) == NULL)
+	{
+		machineDestroy(m);
+		return NULL;
+	}
+#endif
+	boot->cpus++;
+	return m;
+}
+
+/****************************************************************
+* Func:   Free a machine and everything it owns                 *
+* Param:  Machine *m: the machine, may be NULL                  *
+* Return: none                                                  *
+*****************************************************************/
+void machineDestroy(Machine *m)
+{
+	if(m == NULL)
+		return;
+	threadedFree(m);
+	blockFree(m);
+	cacheFree(m->cache);
+	timingFree(m->timing);
+	outputFree(m->output);
+	inputFree(m->input);
+	streamClose(m->stream);
+	if(m->boot == NULL)
+		pageFree(m->memory);		// Other CPUs share CPU 0's
+	free(m->checkpointPrefix);
+	traceClose(m->trace);
+	symbolFree(m->symbols);
+	verifyFree(m);
+	free(m->server);
+#ifdef PROFILE
+	profileFree(m->profile);
+#endif
+	free(m);
+}
+
+/****************************************************************
+* Func:   Set registers to their power-on value, memory is kept *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void machineReset(Machine *m)
+{
+	m->PC = USER_ADDRESS;       // Begin at user program
+	m->SP = m->layout.userStack;	// User stack
+	m->IR = m->X = m->Y = 0;
+	m->AC = m->cpu;				// 0 unless another CPU, see machineCreateCPU()
+	irqReset(&m->irq);
+	m->mode = USER_MODE;
+	m->status = MACHINE_RUNNING;
+	m->faultAddress = 0;
+	m->instructions = 0;
+	m->pendingFrames = 0;
+	m->codeWindow.size = 0;
+	m->dataWindow.size = 0;
+}
+
+/****************************************************************
+* Func:   Load a program file into the machine's memory         *
+* Param:  Machine *m: the machine                               *
+*         char *fileName: text program or binary image          *
+* Return: int: IMAGE_OK, IMAGE_NO_FILE, or IMAGE_BAD with the   *
+*              reason in m->loadError                           *
+*****************************************************************/
+int machineLoadFile(Machine *m, const char *fileName)
+{
+	PROFILE_BEGIN(m, PHASE_LOAD);
+	int result = imageLoad(m->memory, m->layout.system, fileName, m->loadError);
+	PROFILE_END(m, PHASE_LOAD);
+
+	threadedFree(m);            // Code changed under the engines
+	blockFree(m);
+	verifyFree(m);
+	return result;
+}
+
+/****************************************************************
+* Func:   Copy words into the machine's memory                  *
+* Param:  Machine *m: the machine                               *
+*         int *words: the image                                 *
+*         int count: number of words                            *
+*         int offset: address of words[0]                       *
+* Return: none, words outside memory are dropped                *
+*****************************************************************/
+void machineLoadImage(Machine *m, const int *words, int count, int offset)
+{
+	pageWrite(m->memory, offset, count, words);
+
+	threadedFree(m);            // Code changed under the engines
+	blockFree(m);
+	verifyFree(m);
+}
+
+/****************************************************************
+* Func:   Set timer interrupt period                            *
+* Param:  Machine *m: the machine                               *
+*         int period: user instructions between interrupts,     *
+*                     <= 0 for the default                      *
+* Return: none, instructions since the last interrupt count     *
+*         towards the new period                                *
+*****************************************************************/
+void machineSetTimer(Machine *m, int period)
+{
+	IrqTimer *t = &m->irq.timer[0];
+
+	if(period <= 0)
+		period = DEFAULT_TIME_SET;
+	long long elapsed = (t->deadline != IRQ_NEVER && t->period > 0)
+	                    ? m->irq.clock - (t->deadline - t->period) : 0;	// Since the last interrupt
+	irqSetTimer(&m->irq, 0, IRQ_TIMER, elapsed < period ? period - elapsed : 0, period);
+}
+
+/****************************************************************
+* Func:   Select execution engine                               *
+* Param:  Machine *m: the machine                               *
+*         int engine: ENGINE_SWITCH, ENGINE_THREADED or         *
+*                     ENGINE_BLOCK                              *
+* Return: none                                                  *
+*****************************************************************/
+void machineSetEngine(Machine *m, int engine)
+{
+	// Writes made under another engine did not invalidate this one
+	threadedFree(m);
+	blockFree(m);
+	m->engine = engine;
+}
+
+/****************************************************************
+* Func:   Put a cache in front of the pipe transport            *
+* Param:  Machine *m: the machine                               *
+*         int sets, ways, words: geometry, sets 0 for no cache  *
+* Return: int: 0 on success, -1 on invalid geometry             *
+*****************************************************************/
+int machineSetCache(Machine *m, int sets, int ways, int words)
+{
+	struct Cache *c = NULL;
+
+	if(sets != 0 && (c = cacheCreate(sets, ways, words, m->layout.system, m->layout.size)) == NULL)
+		return -1;
+	cacheFree(m->cache);
+	m->cache = c;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Count simulated cycles, see Timing.h                  *
+* Param:  Machine *m: the machine                               *
+*         char *spec: costs as for timingCreate(), NULL to stop *
+*                     counting                                  *
+*         int sets, ways, words: geometry of the modelled       *
+*                                cache, sets 0 for none         *
+* Return: int: 0 on success, -1 on an invalid spec or geometry  *
+*****************************************************************/
+int machineSetTiming(Machine *m, const char *spec, int sets, int ways, int words)
+{
+	Timing *t = NULL;
+
+	if(spec != NULL && (t = timingCreate(spec)) == NULL)
+		return -1;
+	if(t != NULL && sets != 0
+	   && (t->cache = cacheCreate(sets, ways, words, m->layout.system, m->layout.size)) == NULL)
+	{
+		timingFree(t);
+		return -1;
+	}
+	timingFree(m->timing);
+	m->timing = t;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Replace the Put/Get devices                           *
+* Param:  Machine *m: the machine                               *
+*         PutDevice put: called by Put port, NULL for the       *
+*                        buffered output device                 *
+*         GetDevice get: called by Get, NULL for the seeded     *
+*                        input device                           *
+*         void *user: passed to both                            *
+* Return: none                                                  *
+*****************************************************************/
+void machineSetDevices(Machine *m, PutDevice put, GetDevice get, void *user)
+{
+	m->put = (put != NULL) ? put : outputPut;
+	m->putData = (put != NULL) ? user : m->output;
+	m->get = (get != NULL) ? get : inputGet;
+	m->getData = (get != NULL) ? user : m->input;
+}
+
+/****************************************************************
+* Func:   Point the buffered output device at another sink and  *
+*         use it for Put port                                   *
+* Param:  Machine *m: the machine                               *
+*         int sink: OUTPUT_STDOUT, OUTPUT_FILE, OUTPUT_CAPTURE  *
+*                   or OUTPUT_NULL                              *
+*         char *path: file for OUTPUT_FILE                      *
+* Return: int: 0 on success, -1 if the file can not be opened   *
+*****************************************************************/
+int machineSetOutput(Machine *m, int sink, const char *path)
+{
+	struct Output *o = outputCreate(sink, path);
+	if(o == NULL)
+		return -1;
+
+	outputFree(m->output);      // Flushes what the old sink still holds
+	m->output = o;
+	m->put = outputPut;
+	m->putData = o;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Send buffered output to its sink                      *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void machineFlush(Machine *m)
+{
+	PROFILE_BEGIN(m, PHASE_OUTPUT);
+	outputFlush(m->output);
+	PROFILE_END(m, PHASE_OUTPUT);
+}
+
+/****************************************************************
+* Func:   Restart the Get generator from a seed, the same seed  *
+*         gives the same numbers                                *
+* Param:  Machine *m: the machine                               *
+*         unsigned long long seed: the seed                     *
+* Return: none                                                  *
+*****************************************************************/
+void machineSetSeed(Machine *m, unsigned long long seed)
+{
+	inputSeed(m->input, seed);
+}
+
+/****************************************************************
+* Func:   Let Get replay numbers from a file, the generator     *
+*         continues when the file runs out                      *
+* Param:  Machine *m: the machine                               *
+*         char *path: whitespace separated integers             *
+* Return: int: 0 on success, -1 if the file can not be opened   *
+*****************************************************************/
+int machineSetScript(Machine *m, const char *path)
+{
+	return inputSetScript(m->input, path);
+}
+
+/****************************************************************
+* Func:   Give GetPort an input port read by a background       *
+*         thread, and the handler of IRQ_INPUT                  *
+* Param:  Machine *m: the machine, start it once the prompts    *
+*         have read stdin and a snapshot is restored            *
+*         char *path: file, "-" for stdin, NULL to close it     *
+*         int handler: address of the IRQ_INPUT handler, -1 to  *
+*                      poll with GetPort only                   *
+* Return: int: 0 on success, -1 if it can not be opened         *
+*****************************************************************/
+int machineSetStream(Machine *m, const char *path, int handler)
+{
+	streamClose(m->stream);
+	m->stream = NULL;
+	irqSetVector(&m->irq, IRQ_INPUT, -1);
+	if(path == NULL)
+		return 0;
+	if(handler >= m->layout.size)
+		return -1;
+
+	m->stream = streamOpen(path, (handler >= 0) ? &m->irq.next : NULL);
+	if(m->stream == NULL)
+		return -1;
+	irqSetVector(&m->irq, IRQ_INPUT, handler);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Attach the pipes of a memory process                  *
+* Param:  Machine *m: the machine                               *
+*         int wtpd: write pipe description                      *
+*         int rdpd: read pipe description                       *
+* Return: none                                                  *
+*****************************************************************/
+void machineConnect(Machine *m, int wtpd, int rdpd)
+{
+	m->wtpd = wtpd;
+	m->rdpd = rdpd;
+}
+
+/****************************************************************
+* Func:   Save the complete machine state                       *
+* Param:  Machine *m: the machine, TRANSPORT_LOCAL or           *
+*                     TRANSPORT_SHM                             *
+*         char *path: the snapshot file                         *
+*         char *parent: NULL for a full snapshot, or the last   *
+*                       snapshot of this machine for a delta    *
+* Return: int: 0 on success, -1 on failure                      *
+*****************************************************************/
+int machineSave(Machine *m, const char *path, const char *parent)
+{
+	machineFlush(m);            // Output so far belongs before the snapshot
+	PROFILE_BEGIN(m, PHASE_SNAPSHOT);
+	int result = snapshotSave(m, path, parent);
+	PROFILE_END(m, PHASE_SNAPSHOT);
+	return result;
+}
+
+/****************************************************************
+* Func:   Continue from a snapshot: registers, timer, mode,     *
+*         memory and the Get generator                          *
+* Param:  Machine *m: a machine with the snapshot's layout, see *
+*                     snapshotLayout()                          *
+*         char *path: the snapshot file                         *
+* Return: int: SNAPSHOT_OK, SNAPSHOT_NO_FILE, or SNAPSHOT_BAD   *
+*              with the reason in m->loadError                  *
+*                                                               *
+* A Get script set before the restore continues where it was    *
+*****************************************************************/
+int machineRestore(Machine *m, const char *path)
+{
+	PROFILE_BEGIN(m, PHASE_LOAD);
+	int result = snapshotRestore(m, path, m->loadError);
+	PROFILE_END(m, PHASE_LOAD);
+
+	threadedFree(m);            // Code changed under the engines
+	blockFree(m);
+	verifyFree(m);
+	m->pendingFrames = 0;
+	m->codeWindow.size = 0;
+	m->dataWindow.size = 0;
+	return result;
+}
+
+/****************************************************************
+* Func:   Write a checkpoint every few instructions, see        *
+*         machineCheckpoint()                                   *
+* Param:  Machine *m: the machine                               *
+*         long every: instructions between checkpoints, 0 to    *
+*                      stop                                     *
+*         char *prefix: checkpoint n goes to <prefix>.<n>       *
+* Return: int: 0 on success, -1 if out of memory                *
+*****************************************************************/
+int machineSetCheckpoints(Machine *m, long every, const char *prefix)
+{
+	char *copy = NULL;
+
+	if(every > 0 && (copy = strdup(prefix)) == NULL)
+		return -1;
+	free(m->checkpointPrefix);
+	m->checkpointPrefix = copy;
+	m->checkpointEvery = (every > 0) ? every : 0;
+	m->checkpoints = 0;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Write the next checkpoint: every SNAPSHOT_FULL_EVERY  *
+*         one is full, the others are deltas on the one before, *
+*         so no restore follows a long chain                    *
+* Param:  Machine *m: the machine, checkpoints set              *
+* Return: int: 0 on success, -1 on failure                      *
+*                                                               *
+* machineRun() does not call it; a host runs                    *
+* machineRunFor(m, m->checkpointEvery) and checkpoints between  *
+*****************************************************************/
+int machineCheckpoint(Machine *m)
+{
+	char path[SNAPSHOT_PATH_SIZE], parent[SNAPSHOT_PATH_SIZE];
+	int n = m->checkpoints;
+
+	if(m->checkpointPrefix == NULL)
+		return -1;
+	snprintf(path, sizeof(path), "%s.%d", m->checkpointPrefix, n);
+	snprintf(parent, sizeof(parent), "%s.%d", m->checkpointPrefix, n - 1);
+	if(machineSave(m, path, (n % SNAPSHOT_FULL_EVERY == 0) ? NULL : parent) != 0)
+		return -1;
+	m->checkpoints++;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Send the profile report to a file instead of stderr   *
+* Param:  Machine *m: the machine                               *
+*         char *path: the JSON report file                      *
+* Return: int: 0 on success, -1 if out of memory or the         *
+*              simulator was built without -DPROFILE            *
+*****************************************************************/
+int machineSetProfile(Machine *m, const char *path)
+{
+#ifdef PROFILE
+	char *copy = strdup(path);
+	if(copy == NULL)
+		return -1;
+	free(m->profile->report);
+	m->profile->report = copy;
+	return 0;
+#else
+	(void)m;
+	(void)path;
+	return -1;
+#endif
+}
+
+/****************************************************************
+* Func:   Name PCs in the profile report with the symbol table  *
+*         the assembler wrote for the program                   *
+* Param:  Machine *m: the machine                               *
+*         char *path: the symbol file, see Symbol.h             *
+* Return: int: 0 on success, -1 if the file can not be read     *
+*****************************************************************/
+int machineSetSymbols(Machine *m, const char *path)
+{
+	SymbolTable *t = symbolLoad(path);
+	if(t == NULL)
+		return -1;
+	symbolFree(m->symbols);
+	m->symbols = t;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Record every instruction from now on into a trace     *
+*         file, see Trace.h                                     *
+* Param:  Machine *m: the machine                               *
+*         char *path: the trace file, NULL to stop tracing      *
+* Return: int: 0 on success, -1 if the file can not be created  *
+*              or the trace being stopped lost records          *
+*                                                               *
+* The block engine runs single instructions while tracing       *
+*****************************************************************/
+int machineSetTrace(Machine *m, const char *path)
+{
+	int result = traceClose(m->trace);
+
+	m->trace = NULL;
+	if(path != NULL && (m->trace = traceCreate(path)) == NULL)
+		result = -1;
+	return result;
+}
+
+/****************************************************************
+* Func:   Run one instruction                                   *
+* Param:  Machine *m: the machine                               *
+* Return: int: MACHINE_* status                                 *
+*****************************************************************/
+int machineStep(Machine *m)
+{
+	return machineRunFor(m, 1);
+}
+
+/****************************************************************
+* Func:   Run up to count instructions                          *
+* Param:  Machine *m: the machine                               *
+*         long count: most instructions to run                  *
+* Return: int: MACHINE_RUNNING if the budget ran out, else      *
+*              MACHINE_END, MACHINE_FAULT or MACHINE_INVALID    *
+*                                                               *
+* Buffered output is flushed once the machine stops, so it      *
+* comes before any message the caller prints about the stop     *
+*****************************************************************/
+int machineRunFor(Machine *m, long count)
+{
+	if(m->status != MACHINE_RUNNING)
+		return m->status;         // Finished machines stay finished
+	PROFILE_BEGIN(m, PHASE_RUN);
+	if(setjmp(m->fault) != 0)
+	{
+		machineFlush(m);          // Violation or invalid instruction
+		PROFILE_END(m, PHASE_RUN);
+		return m->status;
+	}
+
+	switch((m->timing != NULL) ? ENGINE_SWITCH : m->engine)	// Cycles are counted in stepCPU()
+	{
+		case ENGINE_THREADED:
+			m->instructions += runThreaded(m, count);
+			break;
+
+		case ENGINE_BLOCK:
+			m->instructions += runBlock(m, count);
+			break;
+
+		default:
+			specialRun(m, count);
+			break;
+	}
+	if(m->status != MACHINE_RUNNING)
+		machineFlush(m);
+	PROFILE_END(m, PHASE_RUN);
+	return m->status;
+}
+
+/****************************************************************
+* Func:   Run until End, memory violation or invalid            *
+*         instruction                                           *
+* Param:  Machine *m: the machine                               *
+* Return: int: MACHINE_END, MACHINE_FAULT or MACHINE_INVALID    *
+*****************************************************************/
+int machineRun(Machine *m)
+{
+	int status;
+
+	while((status = machineRunFor(m, LONG_MAX)) == MACHINE_RUNNING);
+	return status;
+}
+
+/****************************************************************
+* Func:   Describe why the machine stopped                      *
+* Param:  Machine *m: the machine                               *
+*         char *text: buffer for the message and its newline    *
+*         int size: bytes of text                               *
+* Return: int: length of the message, 0 if the machine did not  *
+*              stop on a fault or invalid instruction           *
+*****************************************************************/
+int machineStatusText(Machine *m, char *text, int size)
+{
+	int addr = m->faultAddress;
+
+	text[0] = '\0';
+	if(m->status == MACHINE_INVALID)
+		return snprintf(text, size, "Invalid instruction\n");
+	if(m->status != MACHINE_FAULT)
+		return 0;
+	if(m->mode == USER_MODE && addr >= m->layout.system && addr < m->layout.size)
+		return snprintf(text, size, "Memory violation: accessing system address %d in user mode\n", addr);
+	return snprintf(text, size, "Memory violation: address %d outside memory\n", addr);
+}
+
+/****************************************************************
+* Func:   Stop the running instruction, called from inside      *
+*         machineRunFor() only                                  *
+* Param:  Machine *m: the machine                               *
+*         int status: MACHINE_FAULT or MACHINE_INVALID          *
+*         int addr: address that caused it                      *
+* Return: none, does not return                                 *
+*****************************************************************/
+void machineFault(Machine *m, int status, int addr)
+{
+	m->status = status;
+	m->faultAddress = addr;
+	longjmp(m->fault, 1);
+}
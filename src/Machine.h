@@ -0,0 +1,146 @@
+#ifndef _MACHINE_H_
+#define _MACHINE_H_
+
+#include <setjmp.h>
+#include "Memory.h"
+#include "Image.h"
+#include "Interrupt.h"
+
+// Embedded simulator: one Machine holds everything a simulated computer needs,
+// so several machines can live in one process without fork() or prompts
+
+#define Boolean char
+
+// Result of machineStep/machineRunFor/machineRun
+#define MACHINE_RUNNING	0		// Instruction budget used up, machine can go on
+#define MACHINE_END		1		// End executed
+#define MACHINE_FAULT	2		// User mode accessed system memory or an address outside
+								// memory, see faultAddress
+#define MACHINE_INVALID	3		// Invalid instruction
+
+// Devices
+typedef void (*PutDevice)(void *user, int port, int value);	// Put port: port 1 int, port 2 char
+typedef int (*GetDevice)(void *user);						// Get: value for AC
+
+#define WRITE_BUFFER_SIZE 64	// Pending write frames before a forced flush
+#define READ_AHEAD 		16		// Words read ahead in one request
+
+// Read-ahead window: a block of words fetched with one request,
+// kept coherent with writes since the CPU is the only writer
+typedef struct
+{
+	int base;					// Address of words[0]
+	int size;					// Number of valid words
+	int words[READ_AHEAD];
+} ReadWindow;
+
+// Memory layout, fixed when the machine is created
+typedef struct
+{
+	int size;					// Words of memory
+	int system;					// First system address, user program and stack below
+	int userStack;				// Initial SP, count down
+	int timerHandler;			// Timer interrupt handler
+	int intHandler;				// Int instruction handler
+	int systemStack;			// SP on interrupt entry, count down
+} Layout;
+
+// Further CPUs on the same memory, see machineCreateCPU(): CPU n has its
+// user and system stacks n * CPU_STACK_WORDS below those of CPU 0
+#define CPU_STACK_WORDS	100
+
+typedef struct Machine
+{
+	// CPU register
+	int PC, SP, IR, AC, X, Y;	// Special-function register
+	Boolean mode;				// USER_MODE or KERNEL_MODE
+	InterruptController irq;	// Timers, interrupt lines and vectors
+
+	// Memory
+	Layout layout;
+	int limit[2];				// Per mode: first address it may not access
+	PageTable *memory;			// layout.size words, unused with TRANSPORT_PIPE
+	struct Machine *boot;		// CPU 0 that owns memory, NULL for CPU 0 itself
+	int cpu;					// Number of this CPU, starts with it in AC
+	int cpus;					// CPU 0: CPUs created on its memory, itself included
+	struct StoreBuffer *stores;	// Lock-step: stores of the running quantum, see Smp.h, or NULL
+	int transport;				// TRANSPORT_LOCAL, TRANSPORT_SHM or TRANSPORT_PIPE
+	int wtpd, rdpd;				// Pipes to memory process
+	MemFrame sendBuffer[WRITE_BUFFER_SIZE + 3];	// Pending writes, plus room for a request of up to
+												// three frames: mode, compare value, read/atomic/end
+	int pendingFrames;
+	ReadWindow codeWindow;		// Read ahead from PC
+	ReadWindow dataWindow;		// Read ahead from last data address
+	struct Cache *cache;		// CPU-side cache in front of the pipe, or NULL
+	struct Timing *timing;		// Cycle model, see Timing.h, or NULL
+	struct ServerLink *server;	// The pipe is a memory server socket, see Server.h, or NULL
+
+	// Execution engine
+	int engine;					// ENGINE_SWITCH, ENGINE_THREADED or ENGINE_BLOCK
+	struct ThreadedState *threaded;
+	struct BlockState *block;
+
+	// Devices
+	PutDevice put;
+	void *putData;
+	GetDevice get;
+	void *getData;
+	struct Output *output;		// Buffered output behind the default Put device
+	struct Input *input;		// Seeded generator or script behind the default Get device
+	struct Stream *stream;		// Input port behind GetPort, see Stream.h, or NULL
+
+	// Run state
+	int status;					// MACHINE_*
+	int faultAddress;			// Address of the last memory violation
+	long long instructions;		// Instructions executed since reset
+	char loadError[IMAGE_ERROR_SIZE];	// Why machineLoadFile()/machineRestore() failed
+
+	// Checkpoints, see machineCheckpoint()
+	long checkpointEvery;		// Instructions between checkpoints, 0 for none
+	char *checkpointPrefix;		// Checkpoint n goes to <prefix>.<n>
+	int checkpoints;			// Checkpoints written
+
+	struct Profile *profile;	// Counters with -DPROFILE, else NULL
+	struct Trace *trace;		// Execution trace, or NULL
+	struct SymbolTable *symbols;	// Names of PCs in the profile report, or NULL
+	unsigned char *safe;		// Loads proven in bounds, see Verify.h, or NULL
+	Boolean verify;				// runCPU() verifies the program first, report to stderr
+	Boolean hashWrites;			// Hash every memory write into writeHash, see Diff.h
+	Boolean generic;			// Switch engine: never a specialised loop, see Special.h
+	uint64_t writeHash;
+	jmp_buf fault;				// Where a fault leaves the running instruction
+} Machine;
+
+int layoutInit(Layout *l, int size, int system, int intHandler);
+int layoutForCPU(Layout *l, int n);
+Machine *machineCreate(int transport);
+Machine *machineCreateLayout(int transport, const Layout *layout);
+Machine *machineCreateCPU(Machine *boot);
+void machineDestroy(Machine *m);
+void machineReset(Machine *m);
+int machineLoadFile(Machine *m, const char *fileName);
+void machineLoadImage(Machine *m, const int *words, int count, int offset);
+void machineSetTimer(Machine *m, int period);
+void machineSetEngine(Machine *m, int engine);
+int machineSetCache(Machine *m, int sets, int ways, int words);
+int machineSetTiming(Machine *m, const char *spec, int sets, int ways, int words);
+void machineSetDevices(Machine *m, PutDevice put, GetDevice get, void *user);
+int machineSetOutput(Machine *m, int sink, const char *path);
+void machineFlush(Machine *m);
+void machineSetSeed(Machine *m, unsigned long long seed);
+int machineSetScript(Machine *m, const char *path);
+int machineSetStream(Machine *m, const char *path, int handler);
+void machineConnect(Machine *m, int wtpd, int rdpd);
+int machineSave(Machine *m, const char *path, const char *parent);
+int machineRestore(Machine *m, const char *path);
+int machineSetCheckpoints(Machine *m, long every, const char *prefix);
+int machineCheckpoint(Machine *m);
+int machineSetProfile(Machine *m, const char *path);
+int machineSetSymbols(Machine *m, const char *path);
+int machineSetTrace(Machine *m, const char *path);
+int machineStep(Machine *m);
+int machineRunFor(Machine *m, long count);
+int machineRun(Machine *m);
+int machineStatusText(Machine *m, char *text, int size);
+
+#endif
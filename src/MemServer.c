@@ -0,0 +1,99 @@
+/********************************************************************************
+*********************************************************************************
+**  Memory server: load a program once and serve its memory on a Unix domain   **
+**  socket to many CPU processes, see Server.h                                 **
+**                                                                             **
+**  Usage: ./memserver [-m size,system[,int]] [-n clients] [-x] socket program **
+**    -m: memory layout, as the simulator's -m; clients get it from the server **
+**    -n: most CPU clients at once, default 16; client n is CPU n with AC = n  **
+**        and stacks n*100 words below those of CPU 0                          **
+**    -x: exit once the last client left, else run until SIGINT or SIGTERM     **
+**  Clients: ./a.out -u socket [timer], one process per CPU                    **
+**  Build: make memserver, or gcc -pthread -o memserver MemServer.c and every  **
+**         simulator file but Simulator.c, with -lm                            **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "CPU.h"
+#include "Memory.h"
+#include "Server.h"
+
+
+int main(int argc, char *argv[])
+{
+	Layout layout;
+	int clients = SERVER_MAX_CLIENTS, once = 0;
+	int opt;
+
+	layoutInit(&layout, MEMORY_SIZE, SYSTEM_ADDRESS, INT_ADDRESS);
+	while((opt = getopt(argc, argv, "m:n:x")) != -1)
+	{
+		switch(opt)
+		{
+			case 'm':
+			{
+				int size = 0, system = 0, intHandler = 0;
+				if(sscanf(optarg, "%d,%d,%d", &size, &system, &intHandler) < 2
+				   || layoutInit(&layout, size, system, intHandler) != 0)
+				{
+					printf("Invalid memory layout: %s\n", optarg);
+					exit(1);
+				}
+				break;
+			}
+
+			case 'n':
+				clients = atoi(optarg);
+				if(clients < 1)
+				{
+					printf("Invalid number of clients: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case 'x':
+				once = 1;
+				break;
+
+			default:
+				printf("Usage: %s [-m size,system[,int]] [-n clients] [-x] socket program\n", argv[0]);
+				exit(1);
+		}
+	}
+	if(argc - optind != 2)
+	{
+		printf("Usage: %s [-m size,system[,int]] [-n clients] [-x] socket program\n", argv[0]);
+		exit(1);
+	}
+	const char *path = argv[optind], *program = argv[optind + 1];
+
+	PageTable *memory = pageCreate(layout.size, 0);
+	if(memory == NULL)
+	{
+		printf("Out of memory\n");
+		exit(1);
+	}
+	char error[IMAGE_ERROR_SIZE];
+	int result = imageLoad(memory, layout.system, program, error);
+	if(result == IMAGE_NO_FILE)
+	{
+		printf("Error! File does not exist: %s\n", program);
+		exit(1);
+	}
+	if(result != IMAGE_OK)
+	{
+		printf("Error! %s: %s\n", program, error);
+		exit(1);
+	}
+
+	if(runServer(memory, &layout, path, clients, once) != 0)
+	{
+		printf("Can not listen on %s\n", path);
+		exit(1);
+	}
+	pageFree(memory);
+	exit(0);
+}
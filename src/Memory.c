@@ -1,134 +1,139 @@
-/********************************************************************************
-*********************************************************************************
-**  Created by Yiheng Gao, 2/20/2018                                           **
-**                                                                             **
-**  Simulate Memory: read, write data                                          **
-**  Function:                                                                  **
-**    - External:                                                              **
-**       void MemoryInit();               // Initial data in Memory            **
-**       void runMemory(int, int);        // Simulate Memory                   **
-**    - Internal:                                                              **
-**       void loadMemoryTest();           // Get the data for the whole memory **
-**                                        // help debug                        **
-*********************************************************************************
-********************************************************************************/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-
-
-// Function declare
-void MemoryInit(void);
-void runMemory(int wtpd, int rdpd);
-static void loadMemoryTest();
-
-
-#define MEMORY_SIZE 2000       // Total size of memory
-#define LINE_BUFFER_SIZE 100   // Max size for each line in a specific file
-
-
-// Memory space
-// 0-999: user program, 1000-1999: system area
-int memory[MEMORY_SIZE];	
-
-
-/****************************************************************
-* Func:   Initialize Memory, Load data into memory              *
-* Param:  none                                                  *
-* Return: none                                                  *
-*****************************************************************/
-void MemoryInit( )
-{
-	// Load a program into memory
-	int offset = 0;
-
-	printf("Input file name\n");
-	char fileName[20];	
-	scanf("%s", fileName);       // Get file name from user
-	while(getchar() != '\n');    // Clear rest buffer in stdin
-	
-	FILE *fp = fopen(fileName, "r");
-	while(fp == NULL)			// Make sure the file open correctly.
-	{
-		printf("Error! File does not exist\nInput file name again!\n");
-		scanf("%s", fileName);
-		while(getchar() != '\n');
-		fp = fopen(fileName, "r");
-	}
-
-	while(!feof(fp))	// Load the whole file into memory, end until EOF appears
-	{
-		char buff[LINE_BUFFER_SIZE] = "";
-		fgets(buff, sizeof(buff), fp);         // Read line into buffer
-		// Data line
-		if(buff[0] >= '0' && buff[0] <= '9')
-			memory[offset++] = atoi(buff);	   // Transfer char into instruction & store
-		else if(buff[0] == '.')
-			offset = atoi(&buff[1]);
-	}
-
-	// Test the content of memory
-	//loadMemoryTest();
-}
-
-/****************************************************************
-* Func:   Read/Write memory according to control signal         *
-* Param:  int wtpd: write pipe description                      *
-*         int rdpd: read pipe description                       *
-* Return: none                                                  *
-*                                                               *
-* Step1: Read control signal -> 'r', 'w', 'E'                   *
-* Step2: Read address                                           *
-* Step3: Store/Send data                                        *
-*****************************************************************/
-void runMemory(int wtpd, int rdpd)
-{
-	char command;        // 'r': read from memory; 'w': write into memory; 'E': end process
-	int address, data;
-	
-	// read command from pipe
-	read(rdpd, &command, sizeof(command));
-	
-	while(command != 'E')
-	{
-		switch(command)
-		{
-			// Read instruction/data from memory
-			case 'r':
-				read(rdpd, &address, sizeof(address));                   // Read PC from pipe
-				write(wtpd, &memory[address], sizeof(memory[address]));  // Write the content of address into pipe
-				break;
-			
-			// Write data into memory
-			case 'w':
-				read(rdpd, &address, sizeof(address));   // Read address from pipe
-				read(rdpd, &data, sizeof(address));		 // Read the data that processor want to save from pipe
-				memory[address] = data;						
-				break;
-				
-			default:
-				printf("Unexpected command: %c\n", command);
-				exit(-1);
-				break;
-		}
-		read(rdpd, &command, sizeof(command));				// Read next command from CPU
-	}
-}
-
-
-/****************************************************************
-* Func:   Test if memory load correctly                         *
-*         Output the value of mem[i]                            *
-* Param:  none                                                  *
-* Return: none                                                  *
-*****************************************************************/
-void loadMemoryTest(){
-	printf(" Test Memory Now: \n");
-	int offset = 0;
-	printf("size of Memory is: %d\n", sizeof(memory)/sizeof(int));
-	while(offset < sizeof(memory)/sizeof(int))
-		printf("%d, %d\n", offset++, memory[offset]);
-}
+/********************************************************************************
+*********************************************************************************
+**  Created by Yiheng Gao, 2/20/2018                                           **
+**                                                                             **
+**  Simulate Memory: read, write data                                          **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       void MemoryInit(Machine*, char*);// Initial data in Memory            **
+**       void runMemory(PageTable*, int, int, int); // Simulate Memory         **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "Memory.h"
+#include "Machine.h"
+
+
+#define FRAME_BATCH 256        // Max frames handled per read()
+#define REPLY_BUFFER_SIZE 1024 // Words buffered before replying to CPU
+
+
+/****************************************************************
+* Func:   Initialize Memory, Load data into memory              *
+* Param:  Machine *m: the machine whose memory is loaded        *
+*         char *fileName: program file, NULL to ask the user    *
+* Return: none                                                  *
+*****************************************************************/
+void MemoryInit(Machine *m, const char *fileName)
+{
+	char name[256];
+	int c;
+
+	if(fileName == NULL)
+	{
+		printf("Input file name\n");
+		if(scanf("%255s", name) != 1) // Get file name from user
+			exit(-1);                 // No more input
+		while((c = getchar()) != '\n' && c != EOF);    // Clear rest buffer in stdin
+		fileName = name;
+	}
+
+	int result;
+	while((result = machineLoadFile(m, fileName)) != IMAGE_OK)	// Make sure the file open correctly.
+	{
+		if(result == IMAGE_NO_FILE)
+			printf("Error! File does not exist\nInput file name again!\n");
+		else
+			printf("Error! %s: %s\nInput file name again!\n", fileName, m->loadError);
+		if(scanf("%255s", name) != 1)
+			exit(-1);
+		while((c = getchar()) != '\n' && c != EOF);
+		fileName = name;
+	}
+}
+
+/****************************************************************
+* Func:   Read/Write memory according to control signal         *
+* Param:  PageTable *memory: the memory to serve, created       *
+*                            before fork()                      *
+*         int transport: TRANSPORT_PIPE or TRANSPORT_SHM        *
+*         int wtpd: write pipe description                      *
+*         int rdpd: read pipe description                       *
+* Return: none                                                  *
+*                                                               *
+* Step1: Read as many frames as the pipe holds                  *
+* Step2: Apply them in order: 'r', 'w', 'E', words outside      *
+*        memory read as 0 and are not written                   *
+* Step3: Send the data of all 'r' frames back in one write()    *
+*                                                               *
+* In TRANSPORT_SHM mode, send 'R' once memory is loaded, then   *
+* the CPU only sends 'E' when it finishes                       *
+*****************************************************************/
+void runMemory(PageTable *memory, int transport, int wtpd, int rdpd)
+{
+	MemFrame frames[FRAME_BATCH];   // Frames received from CPU
+	int reply[REPLY_BUFFER_SIZE];   // Data to send back to CPU
+	size_t have = 0;                // Bytes buffered in frames[]
+	
+	if(transport == TRANSPORT_SHM)
+		write(wtpd, "R", sizeof(char));    // Program is loaded, CPU may start
+	
+	while(1)
+	{
+		// Read next batch of commands from CPU
+		ssize_t n = read(rdpd, (char *)frames + have, sizeof(frames) - have);
+		if(n <= 0)
+			return;                     // CPU is gone
+		have += n;
+		
+		int count = have / sizeof(MemFrame);
+		int replyLen = 0;
+		int i;
+		for(i = 0; i < count; i++)
+		{
+			MemFrame *f = &frames[i];
+			switch(f->command)
+			{
+				// Read instruction/data block from memory
+				case 'r':
+					if(replyLen + f->data > REPLY_BUFFER_SIZE)
+					{
+						write(wtpd, reply, replyLen * sizeof(int));
+						replyLen = 0;
+					}
+					pageRead(memory, f->address, f->data, &reply[replyLen]);
+					replyLen += f->data;
+					break;
+				
+				// Write data into memory
+				case 'w':
+					if(f->address >= 0 && f->address < memory->size)
+						PAGE_STORE(memory, f->address, f->data);
+					break;
+				
+				// End process
+				case 'E':
+					if(replyLen > 0)
+						write(wtpd, reply, replyLen * sizeof(int));
+					return;
+					
+				default:
+					printf("Unexpected command: %c\n", f->command);
+					exit(-1);
+					break;
+			}
+		}
+		if(replyLen > 0)
+			write(wtpd, reply, replyLen * sizeof(int));   // All replies of this batch
+		
+		// Keep the tail of a partially received frame
+		have -= count * sizeof(MemFrame);
+		memmove(frames, &frames[count], have);
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include <stdio.h>
+#include "Page.h"
+
+// Transport between CPU and Memory
+#define TRANSPORT_PIPE	0		// Memory process, batched frames over the pipes
+#define TRANSPORT_SHM	1		// Memory process, memory lives in a MAP_SHARED region the CPU accesses directly
+#define TRANSPORT_LOCAL	2		// No memory process, CPU owns memory
+
+#define MEMORY_SIZE 2000       // Default total size of memory
+#define SYSTEM_ADDRESS 1000    // Default boundary, 0-999: user program, 1000-1999: system area
+#define MEMORY_MAX_SIZE (1 << 28)	// Largest configurable size, 1 GiB of words
+
+// Batched pipe protocol: the CPU packs command, address and data into one frame,
+// several frames may go out in a single write()
+typedef struct
+{
+	int command;	// 'r': read; 'w': write; 'E': end process
+	int address;	// First address to read, or address to write
+	int data;		// 'r': number of words to send back; 'w': data to store
+} MemFrame;
+
+#define MAX_READ_WORDS 64      // Largest block one 'r' frame may request
+
+struct Machine;
+
+void MemoryInit(struct Machine *m, const char *fileName);
+void runMemory(PageTable *memory, int transport, int wtpd, int rdpd);
+
+#endif
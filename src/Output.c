@@ -0,0 +1,330 @@
+/********************************************************************************
+*********************************************************************************
+**  Output device for Put port                                                 **
+**  Put appends to a per-machine ring buffer; the ring goes to its sink with   **
+**  one writev() when it fills up, at End, before an error message, or on an   **
+**  explicit flush, instead of one printf() per character                      **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Output *outputCreate(int, char*); // New device on a sink             **
+**       Output *outputShare(Output*);    // Another device on the same sink   **
+**       void outputFree(Output*);        // Flush and release                 **
+**       void outputPut(void*, int, int); // Put device: AC as int or char     **
+**       void outputWrite(Output*, char*, size_t); // Append raw text          **
+**       void outputFlush(Output*);       // Send buffered text to the sink    **
+**       void outputHold(Output*);        // Keep flushed text back            **
+**       void outputRelease(Output*);     // Send held text, stop holding      **
+**       char *outputCaptured(Output*, size_t*); // Text of a capture sink     **
+**    - Internal:                                                              **
+**       void appendByte(Output*, char);  // Append one byte                   **
+**       void writeSink(int, struct iovec*, int); // writev() all pieces       **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include "Output.h"
+
+
+// One output device
+typedef struct Output
+{
+	int sink;					// OUTPUT_*
+	int fd;						// OUTPUT_STDOUT/OUTPUT_FILE
+	int borrowed;				// fd belongs to the device of outputShare()
+	int lineMode;				// Flush at '\n', stdout is a terminal
+	int held;					// Flushes go to captured until outputRelease()
+	char ring[OUTPUT_RING_SIZE];
+	unsigned head, tail;		// Bytes [tail, head) are buffered, both run freely
+	char *captured;				// OUTPUT_CAPTURE or held: flushed text
+	size_t length, capacity;
+} Output;
+
+
+// Function declare
+static void appendByte(Output *o, char c);
+static void writeSink(int fd, struct iovec *iov, int pieces);
+
+
+#define RING_MASK (OUTPUT_RING_SIZE - 1)
+
+
+/****************************************************************
+* Func:   Create an output device                               *
+* Param:  int sink: OUTPUT_STDOUT, OUTPUT_FILE, OUTPUT_CAPTURE  *
+*                   or OUTPUT_NULL                              *
+*         char *path: file for OUTPUT_FILE, unused otherwise    *
+* Return: Output*: the device, NULL on failure                  *
+*****************************************************************/
+Output *outputCreate(int sink, const char *path)
+{
+	Output *o = calloc(1, sizeof(Output));
+	if(o == NULL)
+		return NULL;
+	o->sink = sink;
+	o->fd = -1;
+
+	if(sink == OUTPUT_STDOUT)
+	{
+		o->fd = STDOUT_FILENO;
+		o->lineMode = isatty(o->fd);	// Same as stdio: a terminal sees every line
+	}
+	else if(sink == OUTPUT_FILE)
+	{
+		o->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(o->fd < 0)
+		{
+			free(o);
+			return NULL;
+		}
+	}
+	return o;
+}
+
+/****************************************************************
+* Func:   Create a device with its own buffer on the sink of    *
+*         another one, for a further CPU of the same machine    *
+* Param:  Output *o: the device, freed after the new one        *
+* Return: Output*: the device, NULL if out of memory            *
+*                                                               *
+* Both write the same file descriptor, a flush lands as one     *
+* piece; a capture device gets its own captured text            *
+*****************************************************************/
+Output *outputShare(Output *o)
+{
+	Output *copy = calloc(1, sizeof(Output));
+	if(copy == NULL)
+		return NULL;
+	copy->sink = o->sink;
+	copy->fd = o->fd;
+	copy->borrowed = 1;
+	copy->lineMode = o->lineMode;
+	return copy;
+}
+
+/****************************************************************
+* Func:   Flush and release an output device                    *
+* Param:  Output *o: the device, may be NULL                    *
+* Return: none                                                  *
+*****************************************************************/
+void outputFree(Output *o)
+{
+	if(o == NULL)
+		return;
+	outputRelease(o);
+	outputFlush(o);
+	if(o->sink == OUTPUT_FILE && !o->borrowed)
+		close(o->fd);
+	free(o->captured);
+	free(o);
+}
+
+/****************************************************************
+* Func:   Put device: write AC to the output                    *
+* Param:  void *user: Output*                                   *
+*         int port: 1 writes AC as an int, 2 as a char          *
+*         int value: AC                                         *
+* Return: none                                                  *
+*****************************************************************/
+void outputPut(void *user, int port, int value)
+{
+	Output *o = user;
+	char digits[16];
+	int n = 0;
+
+	if(o->sink == OUTPUT_NULL)
+		return;
+
+	if(port == 2)
+		appendByte(o, value);
+	else if(port == 1)
+	{
+		// Same text as printf("%d")
+		unsigned u = (value < 0) ? -(unsigned)value : value;
+		do{
+			digits[n++] = '0' + u % 10;
+			u /= 10;
+		}while(u != 0);
+		if(value < 0)
+			appendByte(o, '-');
+		while(n > 0)
+			appendByte(o, digits[--n]);
+	}
+	else
+	{
+		char text[32];
+		n = snprintf(text, sizeof(text), "Parameter error: %d\n", port);
+		outputWrite(o, text, n);
+	}
+}
+
+/****************************************************************
+* Func:   Append text to the output, e.g. a message that must   *
+*         stay in order with the program's own output           *
+* Param:  Output *o: the device                                 *
+*         char *text: the text                                  *
+*         size_t length: bytes of text                          *
+* Return: none                                                  *
+*****************************************************************/
+void outputWrite(Output *o, const char *text, size_t length)
+{
+	size_t i;
+
+	if(o->sink == OUTPUT_NULL)
+		return;
+	for(i = 0; i < length; i++)
+		appendByte(o, text[i]);
+}
+
+/****************************************************************
+* Func:   Send buffered text to the sink                        *
+* Param:  Output *o: the device                                 *
+* Return: none                                                  *
+*                                                               *
+* The buffered bytes are at most two pieces of the ring, both   *
+* go out in one writev()                                        *
+*****************************************************************/
+void outputFlush(Output *o)
+{
+	if(o == NULL || o->head == o->tail)
+		return;
+
+	struct iovec iov[2];
+	unsigned start = o->tail & RING_MASK;
+	unsigned count = o->head - o->tail;
+	int pieces = 1;
+	iov[0].iov_base = &o->ring[start];
+	iov[0].iov_len = count;
+	if(start + count > OUTPUT_RING_SIZE)
+	{
+		iov[0].iov_len = OUTPUT_RING_SIZE - start;
+		iov[1].iov_base = o->ring;
+		iov[1].iov_len = count - iov[0].iov_len;
+		pieces = 2;
+	}
+	o->tail = o->head;
+
+	if(o->sink == OUTPUT_CAPTURE || o->held)
+	{
+		if(o->length + count > o->capacity)
+		{
+			size_t capacity = (o->capacity == 0) ? OUTPUT_RING_SIZE : o->capacity;
+			while(o->length + count > capacity)
+				capacity *= 2;
+			char *more = realloc(o->captured, capacity);
+			if(more == NULL)
+				return;				// Out of memory: this chunk is lost, the text so far kept
+			o->captured = more;
+			o->capacity = capacity;
+		}
+		int i;
+		for(i = 0; i < pieces; i++)
+		{
+			memcpy(o->captured + o->length, iov[i].iov_base, iov[i].iov_len);
+			o->length += iov[i].iov_len;
+		}
+		return;
+	}
+
+	writeSink(o->fd, iov, pieces);
+}
+
+/****************************************************************
+* Func:   Hold the output back: flushes, also those of a full   *
+*         ring, collect in memory until outputRelease()         *
+* Param:  Output *o: the device, may be NULL                    *
+* Return: none                                                  *
+*                                                               *
+* Lets a scheduler decide when the text of each device reaches  *
+* a shared sink, see smpLockstep()                              *
+*****************************************************************/
+void outputHold(Output *o)
+{
+	if(o != NULL)
+		o->held = 1;
+}
+
+/****************************************************************
+* Func:   Send the held text and everything buffered to the     *
+*         sink, then stop holding                               *
+* Param:  Output *o: the device, may be NULL                    *
+* Return: none                                                  *
+*****************************************************************/
+void outputRelease(Output *o)
+{
+	if(o == NULL || !o->held)
+		return;
+	outputFlush(o);
+	o->held = 0;
+	if(o->sink == OUTPUT_CAPTURE || o->length == 0)
+		return;					// Captured text stays where it is
+
+	struct iovec iov;
+	iov.iov_base = o->captured;
+	iov.iov_len = o->length;
+	o->length = 0;
+	writeSink(o->fd, &iov, 1);
+}
+
+/****************************************************************
+* Func:   Text written to a capture device so far               *
+* Param:  Output *o: an OUTPUT_CAPTURE device                   *
+*         size_t *length: set to bytes of text                  *
+* Return: char*: the text, not 0-terminated, NULL if empty      *
+*****************************************************************/
+const char *outputCaptured(Output *o, size_t *length)
+{
+	outputFlush(o);
+	*length = o->length;
+	return o->captured;
+}
+
+
+/****************************************************************
+* Func:   Append one byte, flush if the ring is full or a line  *
+*         ends on a terminal                                    *
+* Param:  Output *o: the device                                 *
+*         char c: the byte                                      *
+* Return: none                                                  *
+*****************************************************************/
+void appendByte(Output *o, char c)
+{
+	if(o->head - o->tail == OUTPUT_RING_SIZE)
+		outputFlush(o);
+	o->ring[o->head++ & RING_MASK] = c;
+	if(c == '\n' && o->lineMode)
+		outputFlush(o);
+}
+
+/****************************************************************
+* Func:   Write pieces to a file descriptor, a short write      *
+*         continues where it stopped, an error drops the rest   *
+* Param:  int fd: the sink                                      *
+*         struct iovec *iov: the pieces, changed                *
+*         int pieces: number of pieces, 1 or 2                  *
+* Return: none                                                  *
+*****************************************************************/
+void writeSink(int fd, struct iovec *iov, int pieces)
+{
+	while(pieces > 0)
+	{
+		ssize_t n = writev(fd, iov, pieces);
+		if(n <= 0)
+			return;
+		while(pieces > 0 && (size_t)n >= iov[0].iov_len)
+		{
+			n -= iov[0].iov_len;
+			iov[0] = iov[1];
+			pieces--;
+		}
+		if(pieces > 0)
+		{
+			iov[0].iov_base = (char *)iov[0].iov_base + n;
+			iov[0].iov_len -= n;
+		}
+	}
+}
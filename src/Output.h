@@ -0,0 +1,29 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stddef.h>
+
+// Output device behind Put port: characters collect in a ring buffer and
+// reach the sink in bulk, with writev() when the ring wraps
+
+// Sink
+#define OUTPUT_STDOUT	0		// File descriptor 1, flushed per line if it is a terminal
+#define OUTPUT_FILE		1		// File named by path, truncated
+#define OUTPUT_CAPTURE	2		// In memory, see outputCaptured()
+#define OUTPUT_NULL		3		// Discard, for benchmarks
+
+#define OUTPUT_RING_SIZE 65536	// Bytes buffered before a forced flush, power of 2
+
+struct Output;
+
+struct Output *outputCreate(int sink, const char *path);
+struct Output *outputShare(struct Output *o);
+void outputFree(struct Output *o);
+void outputPut(void *user, int port, int value);
+void outputWrite(struct Output *o, const char *text, size_t length);
+void outputFlush(struct Output *o);
+void outputHold(struct Output *o);
+void outputRelease(struct Output *o);
+const char *outputCaptured(struct Output *o, size_t *length);
+
+#endif
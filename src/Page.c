@@ -0,0 +1,206 @@
+/********************************************************************************
+*********************************************************************************
+**  Sparse, paged memory backing                                               **
+**  Private memory allocates a 4 KiB page on its first write; unwritten pages  **
+**  share one zero page, so a read is two loads and no branch. Shared memory   **
+**  (-t shm) maps the whole size once before fork(), the kernel allocates its  **
+**  pages on first touch and the page table points into the mapping            **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       PageTable *pageCreate(int, int); // New memory of a size              **
+**       void pageFree(PageTable*);       // Release memory                    **
+**       int *pageAllocate(PageTable*, int); // Back the page of an address    **
+**       void pageRead(PageTable*, int, int, int*); // Copy words out          **
+**       void pageWrite(PageTable*, int, int, int*); // Copy words in          **
+**       void pageClear(PageTable*);      // Every word back to 0              **
+**       void pageClean(PageTable*);      // Forget which pages were written   **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "Page.h"
+
+
+int pageZero[PAGE_WORDS];
+
+
+/****************************************************************
+* Func:   Create memory, every word reads as 0                  *
+* Param:  int size: number of words, > 0                        *
+*         int shared: 1 to keep the words in a MAP_SHARED       *
+*                     region that survives fork()               *
+* Return: PageTable*: the memory, NULL on failure               *
+*****************************************************************/
+PageTable *pageCreate(int size, int shared)
+{
+	PageTable *pt = calloc(1, sizeof(PageTable));
+	if(pt == NULL || size <= 0)
+	{
+		free(pt);
+		return NULL;
+	}
+	pt->size = size;
+	pt->pageCount = (size + PAGE_WORDS - 1) >> PAGE_SHIFT;
+	pt->pages = malloc(pt->pageCount * sizeof(int *));
+	pt->dirty = calloc(pt->pageCount, 1);
+	if(pt->pages == NULL || pt->dirty == NULL)
+	{
+		free(pt->pages);
+		free(pt->dirty);
+		free(pt);
+		return NULL;
+	}
+
+	int i;
+	if(shared)
+	{
+		pt->sharedBytes = (size_t)pt->pageCount * PAGE_WORDS * sizeof(int);
+		void *area = mmap(NULL, pt->sharedBytes, PROT_READ | PROT_WRITE,
+		                  MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(area == MAP_FAILED)
+		{
+			free(pt->pages);
+			free(pt->dirty);
+			free(pt);
+			return NULL;
+		}
+		pt->shared = area;
+		for(i = 0; i < pt->pageCount; i++)
+			pt->pages[i] = &pt->shared[(size_t)i * PAGE_WORDS];
+		pt->allocated = pt->pageCount;
+	}
+	else
+		for(i = 0; i < pt->pageCount; i++)
+			pt->pages[i] = pageZero;
+
+	return pt;
+}
+
+/****************************************************************
+* Func:   Release memory from pageCreate()                      *
+* Param:  PageTable *pt: the memory, may be NULL                *
+* Return: none                                                  *
+*****************************************************************/
+void pageFree(PageTable *pt)
+{
+	if(pt == NULL)
+		return;
+
+	if(pt->shared != NULL)
+		munmap(pt->shared, pt->sharedBytes);
+	else
+	{
+		int i;
+		for(i = 0; i < pt->pageCount; i++)
+			if(pt->pages[i] != pageZero)
+				free(pt->pages[i]);
+	}
+	free(pt->pages);
+	free(pt->dirty);
+	free(pt);
+}
+
+/****************************************************************
+* Func:   Allocate the page that holds addr, called by          *
+*         PAGE_STORE on the first write to a page               *
+* Param:  PageTable *pt: the memory                             *
+*         int addr: an address inside memory                    *
+* Return: int*: the page, exits if out of memory                *
+*****************************************************************/
+int *pageAllocate(PageTable *pt, int addr)
+{
+	int **slot = &pt->pages[addr >> PAGE_SHIFT];
+	int *page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if(page != pageZero)
+		return page;
+
+	page = calloc(PAGE_WORDS, sizeof(int));
+	if(page == NULL)
+	{
+		printf("Out of memory\n");
+		exit(-1);
+	}
+
+	// Another CPU may have allocated it meanwhile, its page wins
+	int *expected = pageZero;
+	if(!__atomic_compare_exchange_n(slot, &expected, page, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		free(page);
+		return expected;
+	}
+	__atomic_fetch_add(&pt->allocated, 1, __ATOMIC_RELAXED);
+	return page;
+}
+
+/****************************************************************
+* Func:   Copy words out of memory, words outside memory read   *
+*         as 0                                                  *
+* Param:  PageTable *pt: the memory                             *
+*         int addr: first address                               *
+*         int count: number of words                            *
+*         int *dest: where to store the words                   *
+* Return: none                                                  *
+*****************************************************************/
+void pageRead(PageTable *pt, int addr, int count, int *dest)
+{
+	int i;
+	for(i = 0; i < count; i++, addr++)
+		dest[i] = (addr >= 0 && addr < pt->size) ? PAGE_LOAD(pt, addr) : 0;
+}
+
+/****************************************************************
+* Func:   Copy words into memory, words outside memory are      *
+*         dropped                                               *
+* Param:  PageTable *pt: the memory                             *
+*         int addr: first address                               *
+*         int count: number of words                            *
+*         int *src: the words                                   *
+* Return: none                                                  *
+*****************************************************************/
+void pageWrite(PageTable *pt, int addr, int count, const int *src)
+{
+	int i;
+	for(i = 0; i < count; i++, addr++)
+		if(addr >= 0 && addr < pt->size)
+			PAGE_STORE(pt, addr, src[i]);
+}
+
+/****************************************************************
+* Func:   Set every word back to 0 and release private pages   *
+* Param:  PageTable *pt: the memory                             *
+* Return: none                                                  *
+*****************************************************************/
+void pageClear(PageTable *pt)
+{
+	int i;
+
+	// Shared: drop the backing pages, they read as 0 afterwards
+	if(pt->shared != NULL)
+	{
+		if(madvise(pt->shared, pt->sharedBytes, MADV_REMOVE) != 0)
+			memset(pt->shared, 0, pt->sharedBytes);
+		return;
+	}
+
+	for(i = 0; i < pt->pageCount; i++)
+		if(pt->pages[i] != pageZero)
+		{
+			free(pt->pages[i]);
+			pt->pages[i] = pageZero;
+			pt->allocated--;
+		}
+}
+
+/****************************************************************
+* Func:   Forget which pages were written, the next delta       *
+*         holds only pages written after this call              *
+* Param:  PageTable *pt: the memory                             *
+* Return: none                                                  *
+*****************************************************************/
+void pageClean(PageTable *pt)
+{
+	memset(pt->dirty, 0, pt->pageCount);
+}
@@ -0,0 +1,55 @@
+#ifndef _PAGE_H_
+#define _PAGE_H_
+
+// Sparse memory: a page table of 4 KiB pages, a page is allocated on its
+// first write and reads as 0 until then, so untouched memory costs nothing
+//
+// Several CPUs may share one table, see Smp.h. Every word access is atomic:
+// loads acquire, stores release, so a word is never torn and a store is seen
+// after the stores before it (on x86 hosts these are plain moves). A page is
+// published with a compare-and-swap, the CPU that loses the race frees its copy
+
+#define PAGE_SHIFT	10
+#define PAGE_WORDS	(1 << PAGE_SHIFT)	// 1024 words = 4 KiB
+#define PAGE_MASK	(PAGE_WORDS - 1)
+
+typedef struct PageTable
+{
+	int size;					// Words
+	int pageCount;
+	int **pages;				// pageZero until the page is written
+	int *shared;				// MAP_SHARED region behind every page, or NULL
+	size_t sharedBytes;
+	int allocated;				// Pages allocated so far
+	unsigned char *dirty;		// Per page: written since the last pageClean()
+} PageTable;
+
+extern int pageZero[PAGE_WORDS];	// Stands in for unwritten pages, never written
+
+PageTable *pageCreate(int size, int shared);
+void pageFree(PageTable *pt);
+int *pageAllocate(PageTable *pt, int addr);
+void pageRead(PageTable *pt, int addr, int count, int *dest);
+void pageWrite(PageTable *pt, int addr, int count, const int *src);
+void pageClear(PageTable *pt);
+void pageClean(PageTable *pt);
+
+// Page of addr, pageZero if it was never written
+#define PAGE_OF(pt, addr) __atomic_load_n(&(pt)->pages[(addr) >> PAGE_SHIFT], __ATOMIC_ACQUIRE)
+
+// One word, addr must be inside 0 - size-1
+#define PAGE_LOAD(pt, addr) __atomic_load_n(&PAGE_OF(pt, addr)[(addr) & PAGE_MASK], __ATOMIC_ACQUIRE)
+
+// One word, addr must be inside 0 - size-1; marks the page dirty for
+// snapshot deltas
+#define PAGE_STORE(pt, addr, data)                                          \
+	do{                                                                     \
+		int *page_ = PAGE_OF(pt, addr);                                     \
+		if(page_ == pageZero)                                               \
+			page_ = pageAllocate((pt), (addr));                             \
+		__atomic_store_n(&page_[(addr) & PAGE_MASK], (data),                \
+		                 __ATOMIC_RELEASE);                                 \
+		(pt)->dirty[(addr) >> PAGE_SHIFT] = 1;                              \
+	}while(0)
+
+#endif
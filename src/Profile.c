@@ -0,0 +1,285 @@
+/********************************************************************************
+*********************************************************************************
+**  Performance counters and per-opcode profiler, built with -DPROFILE         **
+**  The engines count through the PROFILE_* macros of Profile.h; this file     **
+**  owns the counters, times the host phases and writes the JSON report.       **
+**  Without PROFILE the file is empty and the macros expand to nothing         **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Profile *profileCreate(int);     // Counters for a memory size        **
+**       void profileFree(Profile*);      // Release counters                  **
+**       void profileBegin(Profile*, int); // Start timing a phase             **
+**       void profileEnd(Profile*, int);  // Add the phase time                **
+**       void profileReport(Machine*);    // Write the JSON report             **
+**    - Internal:                                                              **
+**       void writeReport(Machine*, FILE*); // JSON of every counter           **
+**       int topSpots(Profile*, int*, int); // Most executed addresses         **
+**       void writeSymbols(Machine*, FILE*); // Counts per symbol              **
+**       int compareCounts(void*, void*); // Order symbols by count            **
+*********************************************************************************
+********************************************************************************/
+
+#ifdef PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Instruction.h"
+#include "Profile.h"
+#include "Symbol.h"
+
+
+// Instructions executed under one symbol
+typedef struct
+{
+	unsigned long long count;
+	int symbol;					// Index into m->symbols
+} SymbolCount;
+
+
+// Function declare
+static void writeReport(Machine *m, FILE *fp);
+static int topSpots(Profile *p, int *top, int count);
+static void writeSymbols(Machine *m, FILE *fp);
+static int compareCounts(const void *a, const void *b);
+
+
+static const char *const phaseName[PHASE_COUNT] = {"load", "run", "output", "snapshot"};
+
+
+/****************************************************************
+* Func:   Create the counters of a machine                      *
+* Param:  int size: words of memory, one PC counter per word    *
+* Return: Profile*: zeroed counters, NULL if out of memory      *
+*****************************************************************/
+Profile *profileCreate(int size)
+{
+	Profile *p = calloc(1, sizeof(Profile));
+	if(p == NULL)
+		return NULL;
+
+	p->hot = calloc(size, sizeof(unsigned long long));	// Untouched pages stay unbacked
+	if(p->hot == NULL)
+	{
+		free(p);
+		return NULL;
+	}
+	p->size = size;
+	return p;
+}
+
+/****************************************************************
+* Func:   Release counters from profileCreate()                 *
+* Param:  Profile *p: the counters, may be NULL                 *
+* Return: none                                                  *
+*****************************************************************/
+void profileFree(Profile *p)
+{
+	if(p == NULL)
+		return;
+	free(p->hot);
+	free(p->report);
+	free(p);
+}
+
+/****************************************************************
+* Func:   Start timing a host phase                             *
+* Param:  Profile *p: the counters                              *
+*         int phase: PHASE_*                                    *
+* Return: none                                                  *
+*****************************************************************/
+void profileBegin(Profile *p, int phase)
+{
+	clock_gettime(CLOCK_MONOTONIC, &p->start[phase]);
+}
+
+/****************************************************************
+* Func:   Add the time since profileBegin() to a host phase     *
+* Param:  Profile *p: the counters                              *
+*         int phase: PHASE_*                                    *
+* Return: none                                                  *
+*****************************************************************/
+void profileEnd(Profile *p, int phase)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	p->seconds[phase] += (now.tv_sec - p->start[phase].tv_sec)
+	                     + (now.tv_nsec - p->start[phase].tv_nsec) / 1e9;
+}
+
+/****************************************************************
+* Func:   Write the JSON report of a machine to the file set    *
+*         with machineSetProfile(), stderr if none              *
+* Param:  Machine *m: the machine                               *
+* Return: none, prints a message if the file can not be written *
+*****************************************************************/
+void profileReport(Machine *m)
+{
+	Profile *p = m->profile;
+
+	if(p->report == NULL)
+	{
+		writeReport(m, stderr);
+		return;
+	}
+	FILE *fp = fopen(p->report, "w");
+	if(fp == NULL)
+	{
+		fprintf(stderr, "Can not write profile %s\n", p->report);
+		return;
+	}
+	writeReport(m, fp);
+	fclose(fp);
+}
+
+
+/****************************************************************
+* Func:   Write every counter as one JSON object                *
+* Param:  Machine *m: the machine                               *
+*         FILE *fp: where to write                              *
+* Return: none                                                  *
+*****************************************************************/
+void writeReport(Machine *m, FILE *fp)
+{
+	Profile *p = m->profile;
+	int top[PROFILE_HOTSPOTS];
+	int i, first = 1;
+	unsigned long long total = 0, invalid = 0;
+
+	// Own total: m->instructions misses the last slice of a faulting run
+	for(i = 0; i < PROFILE_OPCODES; i++)
+		total += p->opcode[i];
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"instructions\": %llu,\n", total);
+	fprintf(fp, "  \"kernel_instructions\": %llu,\n", p->kernel);
+
+	fprintf(fp, "  \"opcodes\": {");
+	for(i = 0; i < PROFILE_OPCODES; i++)
+	{
+		const char *name = instructionName(i);
+		if(name == NULL)
+		{
+			invalid += p->opcode[i];
+			continue;
+		}
+		if(p->opcode[i] == 0)
+			continue;
+		fprintf(fp, "%s\n    \"%s\": %llu", first ? "" : ",", name, p->opcode[i]);
+		first = 0;
+	}
+	if(invalid > 0)
+		fprintf(fp, "%s\n    \"invalid\": %llu", first ? "" : ",", invalid);
+	fprintf(fp, "\n  },\n");
+
+	fprintf(fp, "  \"memory\": {\n");
+	fprintf(fp, "    \"reads\": {\"user\": %llu, \"system\": %llu},\n", p->reads[0], p->reads[1]);
+	fprintf(fp, "    \"writes\": {\"user\": %llu, \"system\": %llu}\n", p->writes[0], p->writes[1]);
+	fprintf(fp, "  },\n");
+	fprintf(fp, "  \"interrupts\": {\"timer\": %llu, \"int\": %llu},\n", p->timer, p->intr);
+
+	fprintf(fp, "  \"seconds\": {");
+	for(i = 0; i < PHASE_COUNT; i++)
+		fprintf(fp, "%s\"%s\": %.6f", i ? ", " : "", phaseName[i], p->seconds[i]);
+	fprintf(fp, "},\n");
+
+	int count = topSpots(p, top, PROFILE_HOTSPOTS);
+	fprintf(fp, "  \"hotspots\": [");
+	for(i = 0; i < count; i++)
+	{
+		char name[128];
+		fprintf(fp, "%s\n    {\"pc\": %d, \"count\": %llu", i ? "," : "", top[i], p->hot[top[i]]);
+		if(m->symbols != NULL && symbolFormat(m->symbols, top[i], name, sizeof(name)) > 0)
+			fprintf(fp, ", \"symbol\": \"%s\"", name);
+		fprintf(fp, "}");
+	}
+	fprintf(fp, "\n  ]");
+	if(m->symbols != NULL)
+		writeSymbols(m, fp);
+	fprintf(fp, "\n}\n");
+}
+
+/****************************************************************
+* Func:   Find the addresses executed most often                *
+* Param:  Profile *p: the counters                              *
+*         int *top: where to store the addresses, most first    *
+*         int count: size of top                                *
+* Return: int: addresses stored, fewer if fewer ran             *
+*****************************************************************/
+int topSpots(Profile *p, int *top, int count)
+{
+	int used = 0, pc, i;
+
+	// One pass, insertion into a short sorted list
+	for(pc = 0; pc < p->size; pc++)
+	{
+		unsigned long long n = p->hot[pc];
+		if(n == 0 || (used == count && n <= p->hot[top[count - 1]]))
+			continue;
+		i = (used < count) ? used++ : count - 1;
+		for(; i > 0 && p->hot[top[i - 1]] < n; i--)
+			top[i] = top[i - 1];
+		top[i] = pc;
+	}
+	return used;
+}
+
+/****************************************************************
+* Func:   Write the instructions executed under each symbol,    *
+*         from its address up to the next symbol, most first    *
+* Param:  Machine *m: the machine, m->symbols is set            *
+*         FILE *fp: where to write                              *
+* Return: none                                                  *
+*****************************************************************/
+void writeSymbols(Machine *m, FILE *fp)
+{
+	Profile *p = m->profile;
+	const SymbolTable *t = m->symbols;
+	int i, pc, used = 0;
+
+	SymbolCount *sum = calloc(t->count + 1, sizeof(SymbolCount));
+	if(sum == NULL)
+		return;
+
+	// Symbols are sorted, walk them along with the PCs; the last slot
+	// counts PCs below the first symbol
+	for(i = 0; i <= t->count; i++)
+		sum[i].symbol = i;
+	for(pc = 0, i = -1; pc < p->size; pc++)
+	{
+		while(i + 1 < t->count && t->symbols[i + 1].address <= pc)
+			i++;
+		sum[i < 0 ? t->count : i].count += p->hot[pc];
+	}
+	unsigned long long below = sum[t->count].count;
+	for(i = 0; i < t->count; i++)
+		if(sum[i].count > 0)
+			sum[used++] = sum[i];
+	qsort(sum, used, sizeof(SymbolCount), compareCounts);
+
+	fprintf(fp, ",\n  \"symbols\": [");
+	for(i = 0; i < used; i++)
+		fprintf(fp, "%s\n    {\"symbol\": \"%s\", \"address\": %d, \"count\": %llu}", i ? "," : "",
+		        t->symbols[sum[i].symbol].name, t->symbols[sum[i].symbol].address, sum[i].count);
+	if(below > 0)
+		fprintf(fp, "%s\n    {\"symbol\": null, \"address\": 0, \"count\": %llu}", used ? "," : "", below);
+	fprintf(fp, "\n  ]");
+	free(sum);
+}
+
+/****************************************************************
+* Func:   Order symbol counts, most first                       *
+* Param:  void *a, void *b: two SymbolCount                     *
+* Return: int: qsort() order                                    *
+*****************************************************************/
+int compareCounts(const void *a, const void *b)
+{
+	const SymbolCount *x = a, *y = b;
+
+	if(x->count != y->count)
+		return (x->count < y->count) - (x->count > y->count);
+	return x->symbol - y->symbol;
+}
+
+#endif
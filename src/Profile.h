@@ -0,0 +1,77 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "Machine.h"
+
+// Performance counters, compiled in with -DPROFILE
+//
+// Without PROFILE every PROFILE_* macro expands to nothing and the engines
+// are the same code as before. With it each machine counts instructions per
+// opcode and per PC, memory reads/writes per region, interrupts, kernel-mode
+// instructions and host time per phase, and runCPU() writes a JSON report
+// when the program stops. A run that faults inside a translated block does
+// not count the instructions of that last block
+
+#define PROFILE_OPCODES		64		// Opcodes counted, END is 50
+#define PROFILE_HOTSPOTS	20		// PCs listed in the report
+
+// Host time phases
+#define PHASE_LOAD			0		// Program or snapshot loading
+#define PHASE_RUN			1		// machineRunFor(), output flushes included
+#define PHASE_OUTPUT		2		// Output flushes
+#define PHASE_SNAPSHOT		3		// Snapshot writing
+#define PHASE_COUNT			4
+
+#ifdef PROFILE
+
+#include <time.h>
+
+typedef struct Profile
+{
+	unsigned long long opcode[PROFILE_OPCODES];	// Instructions retired per opcode
+	unsigned long long kernel;					// ... of them in kernel mode
+	unsigned long long reads[2], writes[2];		// Memory accesses, 0: user, 1: system region
+	unsigned long long timer, intr;				// Interrupts taken
+	unsigned long long *hot;					// Per address of an opcode, layout.size entries
+	int size;
+	double seconds[PHASE_COUNT];				// Host time per phase
+	struct timespec start[PHASE_COUNT];
+	char *report;								// JSON report file, NULL for stderr
+} Profile;
+
+Profile *profileCreate(int size);
+void profileFree(Profile *p);
+void profileBegin(Profile *p, int phase);
+void profileEnd(Profile *p, int phase);
+void profileReport(Machine *m);
+
+#define PROFILE_STEP(m, pc, op, kernelMode)                                 \
+	do{                                                                     \
+		Profile *p_ = (m)->profile;                                         \
+		p_->opcode[(unsigned)(op) % PROFILE_OPCODES]++;                     \
+		p_->kernel += (kernelMode);                                         \
+		if((unsigned)(pc) < (unsigned)p_->size)                             \
+			p_->hot[pc]++;                                                  \
+	}while(0)
+#define PROFILE_READ(m, addr)	((m)->profile->reads[(addr) >= (m)->layout.system]++)
+#define PROFILE_WRITE(m, addr)	((m)->profile->writes[(addr) >= (m)->layout.system]++)
+#define PROFILE_TIMER(m)		((m)->profile->timer++)
+#define PROFILE_INT(m)			((m)->profile->intr++)
+#define PROFILE_BEGIN(m, phase)	profileBegin((m)->profile, (phase))
+#define PROFILE_END(m, phase)	profileEnd((m)->profile, (phase))
+#define PROFILE_REPORT(m)		profileReport(m)
+
+#else
+
+#define PROFILE_STEP(m, pc, op, kernelMode)
+#define PROFILE_READ(m, addr)
+#define PROFILE_WRITE(m, addr)
+#define PROFILE_TIMER(m)
+#define PROFILE_INT(m)
+#define PROFILE_BEGIN(m, phase)
+#define PROFILE_END(m, phase)
+#define PROFILE_REPORT(m)
+
+#endif
+
+#endif
@@ -0,0 +1,605 @@
+/********************************************************************************
+*********************************************************************************
+**  Memory server: one memory on a Unix domain socket for many CPU processes   **
+**  An epoll loop reads the frames of every client, answers each batch with    **
+**  one write() and holds every client to the limit of its mode                **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int runServer(PageTable*, Layout*, char*, int, int); // Serve memory  **
+**       int serverConnect(char*, Layout*, int*); // Client: connect, layout   **
+**       int serverAttach(Machine*, int, int); // Client: machine on a socket  **
+**       void serverRecord(ServerLink*, long long); // Count a round trip      **
+**       void serverReport(ServerLink*, FILE*); // Latency percentiles         **
+**    - Internal:                                                              **
+**       void acceptClients(Server*);     // Take every waiting connection     **
+**       void readClient(Server*, Client*); // Handle one batch of frames      **
+**       int handleFrame(Server*, Client*, MemFrame*); // Apply one frame      **
+**       int sendReplies(Server*, Client*); // Write what the socket takes     **
+**       void closeClient(Server*, Client*); // Drop a client                  **
+**       int reserveReply(Client*, int);  // Room for more reply words         **
+**       int bucketOf(long long);         // Latency bucket of nanoseconds     **
+**       long long bucketLimit(int);      // Upper end of a latency bucket     **
+**       void onSignal(int);              // SIGINT/SIGTERM: stop serving      **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "CPU.h"
+#include "Server.h"
+
+
+#define FRAME_BATCH		256		// Most frames handled per read() of one client
+#define EVENT_BATCH		64		// Most events per epoll_wait()
+
+// One connected CPU
+typedef struct
+{
+	int fd;
+	int cpu;					// Slot, stacks of this CPU
+	int mode;					// USER_MODE or KERNEL_MODE, from the last 'm'
+	int expected;				// From the last 'x'
+	int ending;					// 'E' seen: close once the replies are out
+	int writing;				// Waiting for EPOLLOUT, reading stopped meanwhile
+	MemFrame frames[FRAME_BATCH];
+	size_t have;				// Bytes in frames[]
+	int *reply;					// Replies, length words of which sent bytes went out
+	size_t sent, length, capacity;
+} Client;
+
+// The server
+typedef struct
+{
+	PageTable *memory;
+	Layout layout;
+	int epoll;
+	int listener;
+	Client **clients;			// By CPU number, NULL for a free slot
+	int maxClients;
+	int connected;
+	long long served, frames, reads, writes, violations;
+} Server;
+
+
+// Function declare
+static void acceptClients(Server *s);
+static void readClient(Server *s, Client *c);
+static int handleFrame(Server *s, Client *c, MemFrame *f);
+static int sendReplies(Server *s, Client *c);
+static void closeClient(Server *s, Client *c);
+static int reserveReply(Client *c, int words);
+static int bucketOf(long long nanoseconds);
+static long long bucketLimit(int bucket);
+static void onSignal(int sig);
+
+
+static volatile sig_atomic_t stopping = 0;
+
+
+/****************************************************************
+* Func:   Serve a memory on a Unix domain socket until SIGINT   *
+*         or SIGTERM, or until the last client left             *
+* Param:  PageTable *memory: the memory, program loaded         *
+*         Layout *layout: layout of CPU 0                       *
+*         char *path: socket path, replaced if it exists        *
+*         int maxClients: clients at once, more are refused     *
+*         int once: return once the last client left            *
+* Return: int: 0 when done, -1 if the socket can not be set up  *
+*                                                               *
+* Prints a summary to stderr at the end, and every client that  *
+* was refused or ended by a violation                           *
+*****************************************************************/
+int runServer(PageTable *memory, const Layout *layout, const char *path, int maxClients, int once)
+{
+	Server s;
+	struct sockaddr_un address;
+	struct epoll_event event, events[EVENT_BATCH];
+
+	memset(&s, 0, sizeof(s));
+	s.memory = memory;
+	s.layout = *layout;
+	s.maxClients = maxClients;
+	s.clients = calloc(maxClients, sizeof(Client *));
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(s.clients == NULL || strlen(path) >= sizeof(address.sun_path))
+	{
+		free(s.clients);
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+
+	unlink(path);
+	s.listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	s.epoll = epoll_create1(EPOLL_CLOEXEC);
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;		// The listener
+	if(s.listener < 0 || s.epoll < 0
+	   || bind(s.listener, (struct sockaddr *)&address, sizeof(address)) != 0
+	   || listen(s.listener, SOMAXCONN) != 0
+	   || epoll_ctl(s.epoll, EPOLL_CTL_ADD, s.listener, &event) != 0)
+	{
+		if(s.listener >= 0)
+			close(s.listener);
+		if(s.epoll >= 0)
+			close(s.epoll);
+		free(s.clients);
+		return -1;
+	}
+
+	// Signals end epoll_wait() with EINTR, a dead client shows up as a failed write
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = onSignal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	while(!stopping && !(once && s.served > 0 && s.connected == 0))
+	{
+		int n = epoll_wait(s.epoll, events, EVENT_BATCH, -1);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		int i;
+		for(i = 0; i < n; i++)
+		{
+			Client *c = events[i].data.ptr;
+			if(c == NULL)
+				acceptClients(&s);
+			else if(c->writing)
+			{
+				if(events[i].events & (EPOLLERR | EPOLLHUP))
+					closeClient(&s, c);
+				else
+					sendReplies(&s, c);
+			}
+			else
+				readClient(&s, c);
+		}
+	}
+
+	int i;
+	for(i = 0; i < s.maxClients; i++)
+		if(s.clients[i] != NULL)
+			closeClient(&s, s.clients[i]);
+	close(s.listener);
+	close(s.epoll);
+	unlink(path);
+	free(s.clients);
+	fprintf(stderr, "memserver: %lld clients, %lld frames, %lld words read, %lld written, %lld violations\n",
+	        s.served, s.frames, s.reads, s.writes, s.violations);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Client: connect to a memory server and read its hello *
+* Param:  char *path: socket path                               *
+*         Layout *layout: set to the layout of this client      *
+*         int *cpu: set to the CPU number of this client        *
+* Return: int: the socket, -1 if there is no server or it       *
+*              refused the client                               *
+*****************************************************************/
+int serverConnect(const char *path, Layout *layout, int *cpu)
+{
+	struct sockaddr_un address;
+	int hello[SERVER_HELLO_WORDS];
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return -1;
+	if(connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	size_t got = 0;
+	while(got < sizeof(hello))
+	{
+		ssize_t n = read(fd, (char *)hello + got, sizeof(hello) - got);
+		if(n <= 0)
+		{
+			close(fd);				// Refused: no free CPU
+			return -1;
+		}
+		got += n;
+	}
+	if(hello[0] != 'L')
+	{
+		close(fd);
+		return -1;
+	}
+	*cpu = hello[1];
+	layout->size = hello[2];
+	layout->system = hello[3];
+	layout->userStack = hello[4];
+	layout->timerHandler = hello[5];
+	layout->intHandler = hello[6];
+	layout->systemStack = hello[7];
+	return fd;
+}
+
+/****************************************************************
+* Func:   Client: run a machine on a server connection          *
+* Param:  Machine *m: created with TRANSPORT_PIPE and the       *
+*                     layout of serverConnect()                 *
+*         int fd: the socket                                    *
+*         int cpu: the CPU number of serverConnect()            *
+* Return: int: 0 on success, -1 if out of memory                *
+*                                                               *
+* Data is read fresh from the server on every load, other       *
+* clients write it too; instructions are still read ahead       *
+*****************************************************************/
+int serverAttach(Machine *m, int fd, int cpu)
+{
+	ServerLink *link = calloc(1, sizeof(ServerLink));
+	if(link == NULL)
+		return -1;
+	link->mode = USER_MODE;			// Every client starts in user mode
+	free(m->server);
+	m->server = link;
+	m->cpu = cpu;
+	machineConnect(m, fd, fd);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Count one round trip to the server                    *
+* Param:  ServerLink *link: the connection                      *
+*         long long nanoseconds: from sending the request to    *
+*                                the last word of the reply     *
+* Return: none                                                  *
+*****************************************************************/
+void serverRecord(ServerLink *link, long long nanoseconds)
+{
+	link->trips++;
+	link->latency[bucketOf(nanoseconds)]++;
+	if(nanoseconds > link->maxLatency)
+		link->maxLatency = nanoseconds;
+}
+
+/****************************************************************
+* Func:   Print round trips and latency percentiles             *
+* Param:  ServerLink *link: the connection, may be NULL         *
+*         FILE *fp: where to print                              *
+* Return: none                                                  *
+*                                                               *
+* A percentile is the upper end of its bucket, at most 1/8 too  *
+* high                                                          *
+*****************************************************************/
+void serverReport(ServerLink *link, FILE *fp)
+{
+	static const double percent[] = {50, 90, 99, 99.9};
+	long long seen = 0;
+	int bucket = 0, i;
+
+	if(link == NULL)
+		return;
+	fprintf(fp, "server: %lld round trips", link->trips);
+	if(link->trips == 0)
+	{
+		fprintf(fp, "\n");
+		return;
+	}
+	for(i = 0; i < 4; i++)
+	{
+		long long rank = (long long)(link->trips * percent[i] / 100 + 0.5);
+		if(rank < 1)
+			rank = 1;
+		while(seen + link->latency[bucket] < rank)
+			seen += link->latency[bucket++];
+		long long limit = bucketLimit(bucket);
+		fprintf(fp, ", p%g %.1f us", percent[i],
+		        (limit < link->maxLatency ? limit : link->maxLatency) / 1000.0);
+	}
+	fprintf(fp, ", max %.1f us\n", link->maxLatency / 1000.0);
+}
+
+
+/****************************************************************
+* Func:   Accept every waiting connection, give each the lowest *
+*         free CPU and send its hello                           *
+* Param:  Server *s: the server                                 *
+* Return: none                                                  *
+*****************************************************************/
+void acceptClients(Server *s)
+{
+	int fd;
+
+	while((fd = accept(s->listener, NULL, NULL)) >= 0)
+	{
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		Layout l = s->layout;
+		int cpu = 0;
+		while(cpu < s->maxClients && s->clients[cpu] != NULL)
+			cpu++;
+		Client *c = (cpu < s->maxClients && layoutForCPU(&l, cpu) == 0) ? calloc(1, sizeof(Client)) : NULL;
+		if(c == NULL)
+		{
+			fprintf(stderr, "memserver: client refused, %d CPUs are running\n", s->connected);
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->cpu = cpu;
+		c->mode = USER_MODE;
+
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = c;
+		if(reserveReply(c, SERVER_HELLO_WORDS) != 0 || epoll_ctl(s->epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			free(c->reply);
+			free(c);
+			close(fd);
+			continue;
+		}
+		s->clients[cpu] = c;
+		s->connected++;
+		s->served++;
+
+		int *hello = &c->reply[c->length];
+		hello[0] = 'L';
+		hello[1] = cpu;
+		hello[2] = l.size;
+		hello[3] = l.system;
+		hello[4] = l.userStack;
+		hello[5] = l.timerHandler;
+		hello[6] = l.intHandler;
+		hello[7] = l.systemStack;
+		c->length += SERVER_HELLO_WORDS;
+		sendReplies(s, c);
+	}
+}
+
+/****************************************************************
+* Func:   Read what one client sent, apply its whole frames in  *
+*         order and send all replies with one write()           *
+* Param:  Server *s: the server                                 *
+*         Client *c: the client, may be closed                  *
+* Return: none                                                  *
+*                                                               *
+* One read() per event keeps a busy client from holding up the  *
+* others; the rest comes with the next epoll_wait()             *
+*****************************************************************/
+void readClient(Server *s, Client *c)
+{
+	ssize_t n = read(c->fd, (char *)c->frames + c->have, sizeof(c->frames) - c->have);
+	if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+	{
+		closeClient(s, c);			// CPU is gone
+		return;
+	}
+	if(n < 0)
+		return;
+	c->have += n;
+
+	int count = c->have / sizeof(MemFrame), i;
+	for(i = 0; i < count && !c->ending; i++)
+		if(handleFrame(s, c, &c->frames[i]) != 0)
+		{
+			s->violations++;
+			closeClient(s, c);
+			return;
+		}
+	s->frames += i;
+
+	// Keep the tail of a partially received frame
+	c->have -= count * sizeof(MemFrame);
+	memmove(c->frames, &c->frames[count], c->have);
+	if(sendReplies(s, c) == 0 && c->ending)
+		closeClient(s, c);
+}
+
+/****************************************************************
+* Func:   Apply one frame of a client                           *
+* Param:  Server *s: the server                                 *
+*         Client *c: the client                                 *
+*         MemFrame *f: the frame                                *
+* Return: int: 0 on success, -1 if it breaks the limit of the   *
+*              client's mode or is not a frame                  *
+*****************************************************************/
+int handleFrame(Server *s, Client *c, MemFrame *f)
+{
+	int limit = (c->mode == USER_MODE) ? s->layout.system : s->layout.size;
+	int addr = f->address;
+
+	switch(f->command)
+	{
+		case 'r':
+		{
+			if(addr < 0 || addr >= limit || f->data <= 0 || f->data > MAX_READ_WORDS
+			   || reserveReply(c, f->data) != 0)
+				break;
+			int inside = (f->data < limit - addr) ? f->data : limit - addr;
+			pageRead(s->memory, addr, inside, &c->reply[c->length]);
+			memset(&c->reply[c->length + inside], 0, (f->data - inside) * sizeof(int));
+			c->length += f->data;
+			s->reads += f->data;
+			return 0;
+		}
+
+		case 'w':
+			if(addr < 0 || addr >= limit)
+				break;
+			PAGE_STORE(s->memory, addr, f->data);
+			s->writes++;
+			return 0;
+
+		case 'm':
+			if(f->data != USER_MODE && f->data != KERNEL_MODE)
+				break;
+			c->mode = f->data;
+			return 0;
+
+		case 'x':
+			c->expected = f->data;
+			return 0;
+
+		case 'c':
+		case 'a':
+		{
+			if(addr < 0 || addr >= limit || reserveReply(c, 1) != 0)
+				break;
+			int old = PAGE_LOAD(s->memory, addr);
+			if(f->command == 'a')
+				PAGE_STORE(s->memory, addr, old + f->data);
+			else if(old == c->expected)
+				PAGE_STORE(s->memory, addr, f->data);
+			c->reply[c->length++] = old;
+			s->reads++;
+			s->writes++;
+			return 0;
+		}
+
+		case 'E':
+			c->ending = 1;
+			return 0;
+	}
+	fprintf(stderr, "memserver: CPU %d: bad frame '%c', address %d, data %d in %s mode, client ended\n",
+	        c->cpu, f->command, addr, f->data, c->mode == USER_MODE ? "user" : "kernel");
+	return -1;
+}
+
+/****************************************************************
+* Func:   Write the pending replies of a client, wait for       *
+*         EPOLLOUT instead of reading if the socket is full     *
+* Param:  Server *s: the server                                 *
+*         Client *c: the client, may be closed                  *
+* Return: int: 0 if all replies are out, 1 if some wait,        *
+*              -1 if the client was closed                      *
+*****************************************************************/
+int sendReplies(Server *s, Client *c)
+{
+	size_t bytes = c->length * sizeof(int);
+	while(c->sent < bytes)
+	{
+		ssize_t n = write(c->fd, (char *)c->reply + c->sent, bytes - c->sent);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n < 0 && errno == EAGAIN)
+			break;
+		if(n <= 0)
+		{
+			closeClient(s, c);
+			return -1;
+		}
+		c->sent += n;
+	}
+
+	int waiting = c->sent < bytes;
+	if(!waiting)
+		c->sent = c->length = 0;
+	if(waiting != c->writing)
+	{
+		// Backpressure: no new frames until the client took its replies
+		struct epoll_event event;
+		event.events = waiting ? EPOLLOUT : EPOLLIN;
+		event.data.ptr = c;
+		epoll_ctl(s->epoll, EPOLL_CTL_MOD, c->fd, &event);
+		c->writing = waiting;
+		if(!waiting && c->ending)
+		{
+			closeClient(s, c);
+			return -1;
+		}
+	}
+	return waiting;
+}
+
+/****************************************************************
+* Func:   Drop a client and free its CPU                        *
+* Param:  Server *s: the server                                 *
+*         Client *c: the client                                 *
+* Return: none                                                  *
+*****************************************************************/
+void closeClient(Server *s, Client *c)
+{
+	epoll_ctl(s->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	s->clients[c->cpu] = NULL;
+	s->connected--;
+	free(c->reply);
+	free(c);
+}
+
+/****************************************************************
+* Func:   Make room for more reply words                        *
+* Param:  Client *c: the client                                 *
+*         int words: words about to be added                    *
+* Return: int: 0 on success, -1 if out of memory                *
+*****************************************************************/
+int reserveReply(Client *c, int words)
+{
+	if(c->length + words <= c->capacity)
+		return 0;
+	size_t capacity = (c->capacity == 0) ? FRAME_BATCH * 4 : c->capacity;
+	while(c->length + words > capacity)
+		capacity *= 2;
+	int *reply = realloc(c->reply, capacity * sizeof(int));
+	if(reply == NULL)
+		return -1;
+	c->reply = reply;
+	c->capacity = capacity;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Latency bucket: exact below LATENCY_SUB ns, above it  *
+*         LATENCY_SUB buckets per power of 2                    *
+* Param:  long long nanoseconds: the latency                    *
+* Return: int: the bucket                                       *
+*****************************************************************/
+int bucketOf(long long nanoseconds)
+{
+	if(nanoseconds < LATENCY_SUB)
+		return nanoseconds < 0 ? 0 : nanoseconds;
+	int power = 63 - __builtin_clzll(nanoseconds);	// >= 3
+	int bucket = (power - 2) * LATENCY_SUB + ((nanoseconds >> (power - 3)) & (LATENCY_SUB - 1));
+	return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/****************************************************************
+* Func:   Largest latency that falls into a bucket              *
+* Param:  int bucket: the bucket                                *
+* Return: long long: nanoseconds                                *
+*****************************************************************/
+long long bucketLimit(int bucket)
+{
+	if(bucket < LATENCY_SUB)
+		return bucket;
+	int power = bucket / LATENCY_SUB + 2;
+	long long low = (long long)(LATENCY_SUB + bucket % LATENCY_SUB) << (power - 3);
+	return low + (1LL << (power - 3)) - 1;
+}
+
+/****************************************************************
+* Func:   Stop serving at the next event                        *
+* Param:  int sig: SIGINT or SIGTERM                            *
+* Return: none                                                  *
+*****************************************************************/
+void onSignal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
@@ -0,0 +1,53 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <stdio.h>
+#include "Machine.h"
+
+// Memory server: one memory behind a Unix domain socket, shared by many CPU
+// processes. Clients speak the frame protocol of the memory process (see
+// MemFrame) and may send many frames before they read the replies; the
+// server answers all frames of one read() with one write()
+//
+// Frames beyond those of the memory process:
+//   'm' data: mode          the frames after it are checked against the
+//                           limit of this mode, every client starts in
+//                           user mode
+//   'x' data: expected      compare value of the next 'c'
+//   'c' address, data       compare and swap, replies with the old word
+//   'a' address, data       fetch and add, replies with the old word
+// 'm' and 'x' carry address -1, so they never match a pending write
+//
+// A frame outside the limit of the client's mode ends the client, as a
+// memory violation ends the CPU. Words of an 'r' frame beyond the limit
+// read as 0: read-ahead does not see what the mode may not access
+//
+// On connect the server sends SERVER_HELLO_WORDS ints: 'L', the client's
+// CPU number, then size, system, userStack, timerHandler, intHandler and
+// systemStack of its layout; client n gets the stacks of CPU n, see
+// layoutForCPU(). Frames are handled one at a time over all clients, so
+// 'c' and 'a' are atomic for every client
+
+#define SERVER_HELLO_WORDS	8
+#define SERVER_MAX_CLIENTS	16		// Default limit of clients at once
+
+// Round-trip latency, log-linear: 8 buckets per power of 2 nanoseconds
+#define LATENCY_SUB			8
+#define LATENCY_BUCKETS		(LATENCY_SUB * 34)
+
+// Client side of a connection, see Machine.server
+typedef struct ServerLink
+{
+	int mode;						// Mode the server checks the next frame against
+	long long trips;				// Requests that waited for a reply
+	long long maxLatency;			// Nanoseconds
+	long long latency[LATENCY_BUCKETS];	// Round trips per bucket
+} ServerLink;
+
+int runServer(PageTable *memory, const Layout *layout, const char *path, int maxClients, int once);
+int serverConnect(const char *path, Layout *layout, int *cpu);
+int serverAttach(Machine *m, int fd, int cpu);
+void serverRecord(ServerLink *link, long long nanoseconds);
+void serverReport(ServerLink *link, FILE *fp);
+
+#endif
@@ -1,53 +1,501 @@
-/********************************************************************************
-*********************************************************************************
-**  Created by Yiheng Gao, 2/20/2018                                           **
-**                                                                             **
-**  Combine memory, CPU to simulate a computer                                 **
-**  Create two processes: one simulates memory, another one simulates CPU      **
-**  Using pipe to communicate                                                  **
-*********************************************************************************
-********************************************************************************/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-
-
-int main(void)
-{
-	// Create pipe
-	int rdpd[2];				// Read pipe descriptors, rdpd[0]: read - CPU, rdpd[1]: write - Memory
-	int wtpd[2];				// Write pipe descriptors, wtpd[0]: read - Memory, wtpd[1]: write - CPU
-	if(pipe(rdpd) == -1 || pipe(wtpd) == -1)  // Create pipe
-	{
-		printf("pipe() failed!\n");
-		exit(1);
-	} 
-	
-	// Create two process: CPU, Memory
-	int pid = fork();
-	switch(pid)
-	{
-		case -1:
-			/* Here pid is -1, the fork failed */
-			/* Some possible reasons are that you're */
-			/* out of process slots or virtual memory */
-			printf("The fork failed!");
-			exit(-1);	
-
-		case 0:	
-			// pid == 0 is child
-			MemoryInit();
-			runMemory(rdpd[1], wtpd[0]);	// Param:(write pd, read pd)
-			exit(0);
-			
-		default:
-			// pid > 0 is Parent
-			CPUInit();
-			runCPU(wtpd[1], rdpd[0]);		// Param:(write pd, read pd)
-			waitpid(pid, NULL, 0);			// Waiting for memory process exit
-			exit(0);
-	}
-}
\ No newline at end of file
+/********************************************************************************
+*********************************************************************************
+**  Created by Yiheng Gao, 2/20/2018                                           **
+**                                                                             **
+**  Combine memory, CPU to simulate a computer                                 **
+**  Create two processes: one simulates memory, another one simulates CPU      **
+**  Using pipe to communicate, or a shared mapping of memory (-t shm)          **
+**  With -t local there is one process, see Machine.h for the library API      **
+**                                                                             **
+**  Usage: ./a.out [-t pipe|shm|local] [-c sets,ways,words]                    **
+**                 [-e switch|threaded|block] [-O file|null]                   **
+**                 [-s seed] [-i script] [-m size,system[,int]]                **
+**                 [-k count,prefix] [-r snapshot] [-P report] [-T trace]      **
+**                 [-S symbols] [-V] [-p cpus] [-q quantum]                    **
+**                 [-I input[,handler]] [-C costs] [timer [file]]              **
+**         ./a.out -D every[,budget] [-e ...] [-m ...] [-s seed] [-V]          **
+**                 timer file                                                  **
+**         ./a.out -b manifest [-j threads] [-o dir] [-e ...] [-m ...]         **
+**         ./a.out -u socket [-e ...] [-O ...] [-s seed] [-i script] [timer]   **
+**    -c: CPU-side cache in front of the pipe transport                        **
+**    -e: execution engine, switch(IR), pre-decoded threaded dispatch or       **
+**        basic blocks of fused superinstructions                              **
+**    -O: Put output to a file, or "null" to discard it, default stdout        **
+**    -s: seed of the Get generator, the same seed replays the same numbers    **
+**    -i: Get reads whitespace separated numbers from a script first           **
+**    -m: memory size and first system address, default 2000,1000; the timer   **
+**        handler sits at the boundary, the int handler at int or halfway up   **
+**    -k: write a snapshot every count instructions to prefix.0, prefix.1, ... **
+**        (-t local or shm), a full one every 16th, deltas in between          **
+**    -r: resume from a snapshot instead of loading a program; timer, layout   **
+**        and the Get generator come from the snapshot                         **
+**    -P: JSON profile report to a file instead of stderr, needs a build       **
+**        with -DPROFILE                                                       **
+**    -S: symbol table from asm -s, names the PCs of the profile report        **
+**    -T: record every instruction into a binary trace, see tracedump          **
+**    -V: verify the program before it runs, findings to stderr; loads proven  **
+**        in bounds then skip the protection check                             **
+**    -p: cpus CPUs on one memory, each on a host thread (-t local), see Smp.h **
+**    -q: run the CPUs in lock-step, quantum instructions between barriers,    **
+**        the same program then gives the same output every time               **
+**    -u: run as one CPU of a memory server (memserver), which holds the       **
+**        program and layout; latency percentiles of its requests to stderr    **
+**    -I: GetPort 1 reads a file, or stdin for "-", filled by a host thread;   **
+**        with a handler each arrival raises IRQ_INPUT there, see Stream.h     **
+**    -C: count simulated cycles, name=cycles,... per instruction, read,       **
+**        write, cache hit and miss (geometry of -c), timer=cycles; totals     **
+**        to stderr at End, see Timing.h                                       **
+**    -D: run the switch engine and the -e engine side by side in-process,     **
+**        compare them every `every` instructions and report the first         **
+**        divergence, see Diff.h; exit status 1 if they differ                 **
+**    timer, file: skip the prompts                                            **
+**    -b: batch mode, run every job of the manifest on -j threads, output      **
+**        of job n to dir/n.out or to stdout, then print jobs/s and MIPS       **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <string.h>
+#include "CPU.h"
+#include "Memory.h"
+#include "Cache.h"
+#include "Batch.h"
+#include "Output.h"
+#include "Snapshot.h"
+#include "Verify.h"
+#include "Smp.h"
+#include "Server.h"
+#include "Diff.h"
+
+
+// Function declare
+static void startInput(Machine *m, const char *path, int handler);
+
+
+int main(int argc, char *argv[])
+{
+	// Parse command line options
+	int mode = TRANSPORT_PIPE;
+	int engine = ENGINE_SWITCH;
+	const char *cacheArg = NULL;
+	const char *manifest = NULL, *outDir = NULL;
+	const char *outputArg = NULL;
+	const char *seedArg = NULL, *scriptArg = NULL;
+	const char *resume = NULL, *checkpointArg = NULL;
+	const char *profileArg = NULL, *traceArg = NULL, *symbolArg = NULL;
+	const char *serverArg = NULL;
+	const char *inputArg = NULL;
+	const char *diffArg = NULL;
+	const char *cyclesArg = NULL;
+	int inputHandler = -1;
+	int verify = 0;
+	int cpus = 1;
+	long quantum = 0;
+	Layout layout;
+	layoutInit(&layout, MEMORY_SIZE, SYSTEM_ADDRESS, INT_ADDRESS);
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	while((opt = getopt(argc, argv, "t:c:e:b:j:o:O:s:i:m:k:r:P:T:S:Vp:q:u:I:D:C:")) != -1)
+	{
+		switch(opt)
+		{
+			case 't':
+				if(strcmp(optarg, "pipe") == 0)
+					mode = TRANSPORT_PIPE;
+				else if(strcmp(optarg, "shm") == 0)
+					mode = TRANSPORT_SHM;
+				else if(strcmp(optarg, "local") == 0)
+					mode = TRANSPORT_LOCAL;
+				else
+				{
+					printf("Unknown transport: %s\n", optarg);
+					exit(1);
+				}
+				break;
+				
+			case 'c':
+				cacheArg = optarg;		// Checked once the machine exists
+				break;
+				
+			case 'e':
+				if(strcmp(optarg, "switch") == 0)
+					engine = ENGINE_SWITCH;
+				else if(strcmp(optarg, "threaded") == 0)
+					engine = ENGINE_THREADED;
+				else if(strcmp(optarg, "block") == 0)
+					engine = ENGINE_BLOCK;
+				else
+				{
+					printf("Unknown engine: %s\n", optarg);
+					exit(1);
+				}
+				break;
+				
+			case 'b':
+				manifest = optarg;
+				break;
+
+			case 'j':
+				threads = atoi(optarg);
+				break;
+
+			case 'o':
+				outDir = optarg;
+				break;
+
+			case 'O':
+				outputArg = optarg;
+				break;
+
+			case 's':
+				seedArg = optarg;
+				break;
+
+			case 'i':
+				scriptArg = optarg;
+				break;
+
+			case 'm':
+			{
+				int size = 0, system = 0, intHandler = 0;
+				if(sscanf(optarg, "%d,%d,%d", &size, &system, &intHandler) < 2
+				   || layoutInit(&layout, size, system, intHandler) != 0)
+				{
+					printf("Invalid memory layout: %s\n", optarg);
+					printf("size: 2-%d words, system: 1 to size-1, int: system to size-1\n", MEMORY_MAX_SIZE);
+					exit(1);
+				}
+				break;
+			}
+
+			case 'k':
+				checkpointArg = optarg;
+				break;
+
+			case 'r':
+				resume = optarg;
+				break;
+
+			case 'P':
+				profileArg = optarg;
+				break;
+
+			case 'T':
+				traceArg = optarg;
+				break;
+
+			case 'S':
+				symbolArg = optarg;
+				break;
+
+			case 'V':
+				verify = 1;
+				break;
+
+			case 'p':
+				cpus = atoi(optarg);
+				if(cpus < 1 || cpus > SMP_MAX_CPUS)
+				{
+					printf("Invalid number of CPUs: %s, 1 to %d\n", optarg, SMP_MAX_CPUS);
+					exit(1);
+				}
+				break;
+
+			case 'q':
+				quantum = atol(optarg);
+				if(quantum <= 0)
+				{
+					printf("Invalid quantum: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case 'u':
+				serverArg = optarg;
+				break;
+
+			case 'I':
+			{
+				char *comma = strrchr(optarg, ','), *end = NULL;
+				inputHandler = -1;
+				if(comma != NULL)
+				{
+					inputHandler = strtol(comma + 1, &end, 10);
+					if(end == comma + 1 || *end != '\0' || inputHandler < 0)
+					{
+						printf("Invalid input port handler: %s\n", comma + 1);
+						exit(1);
+					}
+					*comma = '\0';
+				}
+				inputArg = optarg;
+				break;
+			}
+
+			case 'D':
+				diffArg = optarg;
+				break;
+
+			case 'C':
+				cyclesArg = optarg;		// Checked once the machine exists
+				break;
+				
+			default:
+				printf("Usage: %s [-t pipe|shm|local] [-c sets,ways,words] [-e switch|threaded|block] [-O file|null] [-s seed] [-i script] [-m size,system[,int]] [-k count,prefix] [-r snapshot] [-P report] [-T trace] [-S symbols] [-V] [-p cpus] [-q quantum] [-I input[,handler]] [-C costs] [timer [file]]\n", argv[0]);
+				printf("       %s -b manifest [-j threads] [-o dir] [-e switch|threaded|block] [-m size,system[,int]]\n", argv[0]);
+				printf("       %s -u socket [-e switch|threaded|block] [-O file|null] [-s seed] [-i script] [timer]\n", argv[0]);
+				printf("       %s -D every[,budget] [-e switch|threaded|block] [-m size,system[,int]] [-s seed] [-V] timer file\n", argv[0]);
+				exit(1);
+		}
+	}
+	if(manifest != NULL)
+		exit(runBatch(manifest, threads, engine, outDir, &layout));	// Every job runs in-process
+	const char *timer = (optind < argc) ? argv[optind] : NULL;
+	const char *file = (optind + 1 < argc) ? argv[optind + 1] : NULL;
+
+	// Differential run: two machines in this process, nothing else applies
+	if(diffArg != NULL)
+	{
+		long every = 0, budget = 0;
+		if(sscanf(diffArg, "%ld,%ld", &every, &budget) < 1 || every <= 0 || budget < 0)
+		{
+			printf("Invalid differential option: %s, expected every[,budget]\n", diffArg);
+			exit(1);
+		}
+		if(timer == NULL || file == NULL || atoi(timer) <= 0)
+		{
+			printf("A differential run needs the timer and file on the command line\n");
+			exit(1);
+		}
+		DiffResult result;
+		int status = diffRun(file, &layout, atoi(timer), seedArg != NULL ? strtoull(seedArg, NULL, 0) : 1,
+		                     engine, verify, every, budget, &result);
+		if(status == DIFF_ERROR)
+		{
+			printf("Error! Can not load %s\n", file);
+			exit(1);
+		}
+		diffReport(file, engine, &result, stdout);
+		exit(status == DIFF_SAME ? 0 : 1);
+	}
+	if((resume != NULL || checkpointArg != NULL) && mode == TRANSPORT_PIPE)
+	{
+		printf("Snapshots need -t local or -t shm\n");
+		exit(1);
+	}
+	if((cpus > 1 || quantum > 0) && (mode != TRANSPORT_LOCAL || resume != NULL || checkpointArg != NULL || traceArg != NULL))
+	{
+		printf("Several CPUs and lock-step need -t local, without -k, -r or -T\n");
+		exit(1);
+	}
+	if(cpus > 1 && quantum == 0 && engine != ENGINE_SWITCH)
+	{
+		printf("Several CPUs without -q need -e switch, see Smp.h\n");
+		exit(1);
+	}
+	if(serverArg != NULL && (mode != TRANSPORT_PIPE || cacheArg != NULL || resume != NULL || checkpointArg != NULL
+	                         || cpus > 1 || quantum > 0 || verify))
+	{
+		printf("A memory server client runs over its socket, without -t, -c, -k, -r, -p, -q or -V\n");
+		exit(1);
+	}
+	if(cyclesArg != NULL && (cpus > 1 || quantum > 0))
+	{
+		printf("The cycle model counts one CPU, without -p or -q\n");
+		exit(1);
+	}
+	if(inputArg != NULL && quantum > 0)
+	{
+		printf("Lock-step runs can not take input from the host\n");
+		exit(1);
+	}
+	if(inputArg != NULL && strcmp(inputArg, "-") == 0 && resume == NULL
+	   && (timer == NULL || (file == NULL && serverArg == NULL)))
+	{
+		printf("An input port on stdin needs the timer and file on the command line\n");
+		exit(1);
+	}
+	int serverFd = -1, serverCPU = 0;
+	if(serverArg != NULL && (serverFd = serverConnect(serverArg, &layout, &serverCPU)) < 0)
+	{
+		printf("No memory server at %s, or it has no free CPU\n", serverArg);
+		exit(1);
+	}
+	int result;
+	if(resume != NULL && (result = snapshotLayout(resume, &layout)) != SNAPSHOT_OK)
+	{
+		if(result == SNAPSHOT_NO_FILE)
+			printf("Error! Snapshot does not exist: %s\n", resume);
+		else
+			printf("Error! %s is not a snapshot\n", resume);
+		exit(1);
+	}
+
+	Machine *m = machineCreateLayout(mode, &layout);	// Memory must exist before fork() to be shared
+	if(m == NULL)
+	{
+		printf("Out of memory\n");
+		exit(1);
+	}
+	int sets = 0, ways = 0, words = 0;
+	if(cacheArg != NULL && (sscanf(cacheArg, "%d,%d,%d", &sets, &ways, &words) != 3
+	   || sets <= 0 || machineSetCache(m, sets, ways, words) != 0))
+	{
+		printf("Invalid cache configuration: %s\n", cacheArg);
+		printf("sets: power of 2 up to %d, ways: 1-%d, words: 1, 2, 4 or 8\n",
+		       CACHE_MAX_SETS, CACHE_MAX_WAYS);
+		exit(1);
+	}
+	if(cyclesArg != NULL && machineSetTiming(m, cyclesArg, sets, ways, words) != 0)
+	{
+		printf("Invalid cycle model: %s\n", cyclesArg);
+		printf("expected name=cycles,... with name an instruction, all, read, write, hit or miss,"
+		       " or timer=cycles\n");
+		exit(1);
+	}
+	if(mode != TRANSPORT_PIPE && m->cache != NULL && m->timing == NULL)
+		printf("Cache is only used with pipe transport\n");
+	machineSetEngine(m, engine);
+	if(outputArg != NULL && machineSetOutput(m, strcmp(outputArg, "null") == 0 ? OUTPUT_NULL : OUTPUT_FILE,
+	                                         outputArg) != 0)
+	{
+		printf("Can not open output file: %s\n", outputArg);
+		exit(1);
+	}
+	if(seedArg != NULL)
+		machineSetSeed(m, strtoull(seedArg, NULL, 0));
+	if(scriptArg != NULL && machineSetScript(m, scriptArg) != 0)
+	{
+		printf("Can not open input script: %s\n", scriptArg);
+		exit(1);
+	}
+	if(checkpointArg != NULL)
+	{
+		long every = 0;
+		int skip = 0;
+		if(sscanf(checkpointArg, "%ld,%n", &every, &skip) != 1 || skip == 0 || every <= 0
+		   || checkpointArg[skip] == '\0' || machineSetCheckpoints(m, every, checkpointArg + skip) != 0)
+		{
+			printf("Invalid checkpoint option: %s, expected count,prefix\n", checkpointArg);
+			exit(1);
+		}
+	}
+	if(profileArg != NULL && machineSetProfile(m, profileArg) != 0)
+		printf("Profiling is not built in, compile with -DPROFILE\n");
+	if(symbolArg != NULL && machineSetSymbols(m, symbolArg) != 0)
+	{
+		printf("Can not read symbol table: %s\n", symbolArg);
+		exit(1);
+	}
+	if(resume != NULL && machineRestore(m, resume) != SNAPSHOT_OK)	// Before fork(), memory is shared
+	{
+		printf("Error! %s\n", m->loadError);
+		exit(1);
+	}
+	if(traceArg != NULL && machineSetTrace(m, traceArg) != 0)	// The CPU process records it
+	{
+		printf("Can not write trace: %s\n", traceArg);
+		exit(1);
+	}
+	m->verify = verify && mode != TRANSPORT_PIPE;	// With pipes the memory process verifies
+
+	// CPU of a memory server: the program is already loaded there
+	if(serverArg != NULL)
+	{
+		if(serverAttach(m, serverFd, serverCPU) != 0)
+		{
+			printf("Out of memory\n");
+			exit(1);
+		}
+		signal(SIGPIPE, SIG_IGN);		// A dead server shows up as a failed write
+		CPUInit(m, timer);
+		startInput(m, inputArg, inputHandler);
+		runCPU(m);
+		serverReport(m->server, stderr);
+		machineDestroy(m);
+		exit(0);
+	}
+
+	// Single process: CPU owns the memory
+	if(mode == TRANSPORT_LOCAL)
+	{
+		if(resume == NULL)
+		{
+			CPUInit(m, timer);
+			MemoryInit(m, file);
+		}
+		startInput(m, inputArg, inputHandler);		// After the prompts and the snapshot
+		if(cpus > 1 || quantum > 0)
+			runSMP(m, cpus, quantum);
+		else
+			runCPU(m);
+		machineDestroy(m);
+		exit(0);
+	}
+	
+	// Create pipe
+	int rdpd[2];				// Read pipe descriptors, rdpd[0]: read - CPU, rdpd[1]: write - Memory
+	int wtpd[2];				// Write pipe descriptors, wtpd[0]: read - Memory, wtpd[1]: write - CPU
+	if(pipe(rdpd) == -1 || pipe(wtpd) == -1)  // Create pipe
+	{
+		printf("pipe() failed!\n");
+		exit(1);
+	} 
+	
+	// Create two process: CPU, Memory
+	int pid = fork();
+	switch(pid)
+	{
+		case -1:
+			/* Here pid is -1, the fork failed */
+			/* Some possible reasons are that you're */
+			/* out of process slots or virtual memory */
+			printf("The fork failed!");
+			exit(-1);	
+
+		case 0:	
+			// pid == 0 is child
+			close(rdpd[0]);					// CPU ends, so each side sees EOF when the other exits
+			close(wtpd[1]);
+			if(resume == NULL)
+				MemoryInit(m, file);
+			if(verify && mode == TRANSPORT_PIPE && verifyProgram(m, stderr) < 0)
+				fprintf(stderr, "verify: out of memory\n");
+			runMemory(m->memory, mode, rdpd[1], wtpd[0]);	// Param:(write pd, read pd)
+			exit(0);
+			
+		default:
+			// pid > 0 is Parent
+			close(rdpd[1]);					// Memory ends
+			close(wtpd[0]);
+			signal(SIGPIPE, SIG_IGN);		// A dead memory process shows up as a failed write
+			if(resume == NULL)
+				CPUInit(m, timer);
+			machineConnect(m, wtpd[1], rdpd[0]);	// Param:(write pd, read pd)
+			startInput(m, inputArg, inputHandler);	// Its thread lives in the CPU process
+			runCPU(m);
+			waitpid(pid, NULL, 0);			// Waiting for memory process exit
+			exit(0);
+	}
+}
+
+/****************************************************************
+* Func:   Start the input port of option -I, if given           *
+* Param:  Machine *m: the machine, prompts done                 *
+*         char *path: file, "-" for stdin, or NULL              *
+*         int handler: IRQ_INPUT handler, -1 to poll only       *
+* Return: none, exits if it can not be opened                   *
+*****************************************************************/
+static void startInput(Machine *m, const char *path, int handler)
+{
+	if(path != NULL && machineSetStream(m, path, handler) != 0)
+	{
+		printf("Can not open input port: %s\n", path);
+		exit(1);
+	}
+}
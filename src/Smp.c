@@ -0,0 +1,515 @@
+/********************************************************************************
+*********************************************************************************
+**  Multiprocessor: several CPUs sharing one memory                            **
+**  Each CPU is a Machine of its own on a host thread; they share the page     **
+**  table of CPU 0 and synchronise only through memory, with CompareSwap and   **
+**  FetchAdd for atomic updates. A fault on one CPU stops the others           **
+**  Lock-step mode runs the CPUs in quanta between barriers with buffered      **
+**  stores, so every run of a program is the same                              **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int smpRun(Machine**, int);      // Run CPUs until every one stops    **
+**       int smpLockstep(Machine**, int, long); // Run CPUs in lock-step       **
+**       int smpLoad(Machine*, int);      // Lock-step: load a word            **
+**       void smpStore(Machine*, int, int); // Lock-step: buffer a store       **
+**       int smpAtomic(Machine*, int, int, int, int); // Lock-step: atomic     **
+**       void runSMP(Machine*, int, long); // Simulator: create CPUs and run   **
+**    - Internal:                                                              **
+**       void *cpuThread(void*);          // Thread: run one CPU in slices     **
+**       void *lockstepThread(void*);     // Thread: run one CPU in quanta     **
+**       int arrive(Lockstep*, int);      // Wait at the barrier               **
+**       void commit(Lockstep*);          // Stores and atomics in CPU order   **
+**       int findSlot(StoreBuffer*, int); // Slot of an address                **
+**       void growBuffer(StoreBuffer*);   // Double the slots                  **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Output.h"
+#include "Smp.h"
+#include "Profile.h"
+#include "Verify.h"
+
+
+// Argument of one CPU thread
+typedef struct
+{
+	Machine *m;
+	int *stop;				// Set once a CPU faults, the others leave at their next slice
+} Context;
+
+// CPUs running in lock-step, shared by their threads
+typedef struct Lockstep
+{
+	pthread_mutex_t lock;
+	pthread_cond_t passed;		// Broadcast when a barrier is passed
+	Machine *const *cpus;
+	int count;
+	long quantum;				// Instructions of a CPU between barriers
+	int running;				// CPUs that still come to barriers
+	int arrived;				// CPUs waiting at the barrier
+	unsigned long barriers;		// Barriers passed
+	int stop;					// A CPU failed, the rest leave at the barrier
+} Lockstep;
+
+// One buffered store
+typedef struct
+{
+	int address;				// -1 for a free slot
+	int data;
+} StoreSlot;
+
+// Stores of one CPU in the running quantum: open addressing on the address,
+// one slot per address however often it was written
+typedef struct StoreBuffer
+{
+	Machine *m;					// CPU whose stores these are
+	Lockstep *group;
+	StoreSlot *slots;
+	int *used;					// Slots in use, in the order they were taken
+	int count;					// Slots in use
+	int bits;					// 1 << bits slots
+	int opcode;					// COMPARE_SWAP or FETCH_ADD waiting for the barrier, else 0
+	int address, expected, data, result;	// Its operands and the word it found
+} StoreBuffer;
+
+
+#define STORE_BITS		10		// Slots of a new store buffer: 1 << STORE_BITS
+
+// Slot where the search for addr starts, Fibonacci hashing keeps a run of
+// stack addresses apart
+#define STORE_HASH(b, addr)	(((unsigned)(addr) * 0x9E3779B1u) >> (32 - (b)->bits))
+
+
+// Function declare
+static void *cpuThread(void *arg);
+static void *lockstepThread(void *arg);
+static int arrive(Lockstep *g, int leaving);
+static void commit(Lockstep *g);
+static int findSlot(StoreBuffer *b, int addr);
+static void growBuffer(StoreBuffer *b);
+
+
+/****************************************************************
+* Func:   Run CPUs that share memory in parallel, CPU 0 on the  *
+*         calling thread, until each one ended, or one faulted  *
+* Param:  Machine **cpus: CPU 0 and the CPUs created on it      *
+*         int count: number of CPUs, at most SMP_MAX_CPUS       *
+* Return: int: the first CPU that faulted or ran an invalid     *
+*              instruction, -1 if every CPU ended               *
+*                                                               *
+* CPUs stopped because another faulted stay MACHINE_RUNNING     *
+*****************************************************************/
+int smpRun(Machine *const *cpus, int count)
+{
+	pthread_t threads[SMP_MAX_CPUS];
+	Context contexts[SMP_MAX_CPUS];
+	int stop = 0, i;
+
+	for(i = 0; i < count; i++)
+	{
+		contexts[i].m = cpus[i];
+		contexts[i].stop = &stop;
+	}
+	for(i = 1; i < count; i++)
+		if(pthread_create(&threads[i], NULL, cpuThread, &contexts[i]) != 0)
+		{
+			printf("Can not start a thread for CPU %d\n", i);
+			exit(-1);
+		}
+	cpuThread(&contexts[0]);
+	for(i = 1; i < count; i++)
+		pthread_join(threads[i], NULL);
+
+	for(i = 0; i < count; i++)
+		if(cpus[i]->status == MACHINE_FAULT || cpus[i]->status == MACHINE_INVALID)
+			return i;
+	return -1;
+}
+
+/****************************************************************
+* Func:   Run CPUs that share memory in lock-step: quantum      *
+*         instructions each, in parallel, then a barrier where  *
+*         the buffered stores, atomics and output of every CPU  *
+*         take effect in CPU order                              *
+* Param:  Machine **cpus: CPU 0 and the CPUs created on it      *
+*         int count: number of CPUs, at most SMP_MAX_CPUS       *
+*         long quantum: instructions between barriers, > 0      *
+* Return: int: the first CPU that faulted or ran an invalid     *
+*              instruction, -1 if every CPU ended               *
+*                                                               *
+* The run depends only on the program, the quantum and the      *
+* devices, not on how the host schedules the threads. A fault   *
+* stops the other CPUs at the barrier after it                  *
+*****************************************************************/
+int smpLockstep(Machine *const *cpus, int count, long quantum)
+{
+	pthread_t threads[SMP_MAX_CPUS];
+	StoreBuffer buffers[SMP_MAX_CPUS];
+	Lockstep g;
+	int i, j;
+
+	pthread_mutex_init(&g.lock, NULL);
+	pthread_cond_init(&g.passed, NULL);
+	g.cpus = cpus;
+	g.count = g.running = count;
+	g.quantum = quantum;
+	g.arrived = 0;
+	g.barriers = 0;
+	g.stop = 0;
+	for(i = 0; i < count; i++)
+	{
+		StoreBuffer *b = &buffers[i];
+		b->m = cpus[i];
+		b->group = &g;
+		b->bits = STORE_BITS;
+		b->slots = malloc(sizeof(StoreSlot) << b->bits);
+		b->used = malloc(sizeof(int) << b->bits);
+		if(b->slots == NULL || b->used == NULL)
+		{
+			printf("Out of memory\n");
+			exit(-1);
+		}
+		for(j = 0; j < 1 << b->bits; j++)
+			b->slots[j].address = -1;
+		b->count = 0;
+		b->opcode = 0;
+		cpus[i]->stores = b;
+		outputHold(cpus[i]->output);
+	}
+
+	for(i = 1; i < count; i++)
+		if(pthread_create(&threads[i], NULL, lockstepThread, &buffers[i]) != 0)
+		{
+			printf("Can not start a thread for CPU %d\n", i);
+			exit(-1);
+		}
+	lockstepThread(&buffers[0]);
+	for(i = 1; i < count; i++)
+		pthread_join(threads[i], NULL);
+
+	int failed = -1;
+	for(i = 0; i < count; i++)
+	{
+		outputRelease(cpus[i]->output);		// Flushed once the CPU stopped
+		cpus[i]->stores = NULL;
+		free(buffers[i].slots);
+		free(buffers[i].used);
+		if(failed < 0 && (cpus[i]->status == MACHINE_FAULT || cpus[i]->status == MACHINE_INVALID))
+			failed = i;
+	}
+	pthread_cond_destroy(&g.passed);
+	pthread_mutex_destroy(&g.lock);
+	return failed;
+}
+
+/****************************************************************
+* Func:   Lock-step: load a word, this CPU's stores of the      *
+*         quantum first, else memory as of the last barrier     *
+* Param:  Machine *m: the machine, m->stores set                *
+*         int addr: the address, checked                        *
+* Return: int: the word                                         *
+*****************************************************************/
+int smpLoad(Machine *m, int addr)
+{
+	StoreBuffer *b = m->stores;
+	if(b->count > 0)
+	{
+		StoreSlot *slot = &b->slots[findSlot(b, addr)];
+		if(slot->address == addr)
+			return slot->data;
+	}
+	return PAGE_LOAD(m->memory, addr);
+}
+
+/****************************************************************
+* Func:   Lock-step: buffer a store until the next barrier      *
+* Param:  Machine *m: the machine, m->stores set                *
+*         int addr: the address, checked                        *
+*         int data: the word                                    *
+* Return: none                                                  *
+*****************************************************************/
+void smpStore(Machine *m, int addr, int data)
+{
+	StoreBuffer *b = m->stores;
+	if((b->count + 1) * 2 > 1 << b->bits)
+		growBuffer(b);		// At most half full keeps the searches short
+
+	int i = findSlot(b, addr);
+	if(b->slots[i].address != addr)
+	{
+		b->slots[i].address = addr;
+		b->used[b->count++] = i;
+	}
+	b->slots[i].data = data;
+}
+
+/****************************************************************
+* Func:   Lock-step: CompareSwap or FetchAdd, waits for the     *
+*         barrier that runs it after the stores of every CPU    *
+* Param:  Machine *m: the machine, m->stores set                *
+*         int opcode: COMPARE_SWAP or FETCH_ADD                 *
+*         int addr: the address, checked                        *
+*         int expected: CompareSwap: the value the word must    *
+*                       have                                    *
+*         int data: CompareSwap: the new value, FetchAdd: added *
+* Return: int: the word before; leaves the running instruction  *
+*              if another CPU failed meanwhile                  *
+*****************************************************************/
+int smpAtomic(Machine *m, int opcode, int addr, int expected, int data)
+{
+	StoreBuffer *b = m->stores;
+	b->opcode = opcode;
+	b->address = addr;
+	b->expected = expected;
+	b->data = data;
+	if(arrive(b->group, 0))
+		longjmp(m->fault, 1);	// Stopped, status stays MACHINE_RUNNING
+	return b->result;
+}
+
+/****************************************************************
+* Func:   Run a loaded program on several CPUs, the counterpart *
+*         of runCPU() for -t local                              *
+* Param:  Machine *boot: CPU 0, program loaded, timer set       *
+*         int count: number of CPUs, 1 to SMP_MAX_CPUS          *
+*         long quantum: lock-step quantum, 0 to run freely      *
+* Return: none, exits on a fault, invalid instruction or if a   *
+*         CPU can not be created                                *
+*****************************************************************/
+void runSMP(Machine *boot, int count, long quantum)
+{
+	Machine *cpus[SMP_MAX_CPUS];
+	char text[128];
+	int i;
+
+	cpus[0] = boot;
+	for(i = 1; i < count; i++)
+		if((cpus[i] = machineCreateCPU(boot)) == NULL)
+		{
+			printf("Can not create CPU %d: its stacks would run into the handlers, see -m\n", i);
+			exit(1);
+		}
+#ifdef PROFILE
+	// One report per CPU: report.1, report.2, ... next to CPU 0's
+	for(i = 1; i < count && boot->profile->report != NULL; i++)
+	{
+		snprintf(text, sizeof(text), "%s.%d", boot->profile->report, i);
+		machineSetProfile(cpus[i], text);
+	}
+#endif
+
+	fflush(stdout);		// Prompts go out before the program's own output
+	if(boot->verify && verifyProgram(boot, stderr) < 0)
+		fprintf(stderr, "verify: out of memory\n");
+
+	int failed = (quantum > 0) ? smpLockstep(cpus, count, quantum) : smpRun(cpus, count);
+	for(i = 0; i < count; i++)
+	{
+		machineFlush(cpus[i]);		// CPUs stopped by another's fault
+		PROFILE_REPORT(cpus[i]);
+	}
+	if(failed >= 0 && machineStatusText(cpus[failed], text, sizeof(text)) > 0)
+	{
+		printf("CPU %d: %s", failed, text);	// Memory violation or invalid instruction
+		exit(-1);
+	}
+	for(i = count - 1; i > 0; i--)
+		machineDestroy(cpus[i]);
+}
+
+
+/****************************************************************
+* Func:   Thread of one CPU: run it in slices until it ends, or *
+*         until it or another CPU fails                         *
+* Param:  void *arg: Context*                                   *
+* Return: void*: NULL                                           *
+*****************************************************************/
+void *cpuThread(void *arg)
+{
+	Context *c = arg;
+
+	while(!__atomic_load_n(c->stop, __ATOMIC_RELAXED))
+	{
+		int status = machineRunFor(c->m, SMP_SLICE);
+		if(status == MACHINE_RUNNING)
+			continue;
+		if(status != MACHINE_END)
+			__atomic_store_n(c->stop, 1, __ATOMIC_RELAXED);
+		break;
+	}
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Thread of one CPU in lock-step: a quantum, then the   *
+*         barrier, until it ends or a CPU failed                *
+* Param:  void *arg: StoreBuffer* of the CPU                    *
+* Return: void*: NULL                                           *
+*****************************************************************/
+void *lockstepThread(void *arg)
+{
+	StoreBuffer *b = arg;
+	Lockstep *g = b->group;
+	Machine *m = b->m;
+
+	for(;;)
+	{
+		int status = machineRunFor(m, g->quantum);
+		if(arrive(g, status != MACHINE_RUNNING) || status != MACHINE_RUNNING)
+			break;
+	}
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Barrier: the last CPU to arrive commits the quantum   *
+*         and lets the others go on                             *
+* Param:  Lockstep *g: the CPUs                                 *
+*         int leaving: the CPU stopped, it commits its last     *
+*                      stores but does not wait                 *
+* Return: int: nonzero if the CPUs must stop                    *
+*****************************************************************/
+int arrive(Lockstep *g, int leaving)
+{
+	pthread_mutex_lock(&g->lock);
+	if(leaving)
+		g->running--;
+	else
+		g->arrived++;
+
+	if(g->arrived == g->running)
+	{
+		commit(g);
+		g->arrived = 0;
+		g->barriers++;
+		pthread_cond_broadcast(&g->passed);
+	}
+	else if(!leaving)
+	{
+		unsigned long barrier = g->barriers;
+		while(g->barriers == barrier)
+			pthread_cond_wait(&g->passed, &g->lock);
+	}
+	int stop = g->stop;
+	pthread_mutex_unlock(&g->lock);
+	return stop;
+}
+
+/****************************************************************
+* Func:   End a quantum: stores of CPU 0, 1, ... into memory,   *
+*         then their atomics in the same order, then their      *
+*         output; every CPU waits at the barrier meanwhile      *
+* Param:  Lockstep *g: the CPUs                                 *
+* Return: none                                                  *
+*                                                               *
+* A word written by CPU i drops the decoded instructions of     *
+* every other CPU that cover it; CPU i dropped its own already  *
+*****************************************************************/
+void commit(Lockstep *g)
+{
+	PageTable *memory = g->cpus[0]->memory;
+	int i, j, k;
+
+	for(i = 0; i < g->count; i++)
+	{
+		StoreBuffer *b = g->cpus[i]->stores;
+		for(k = 0; k < b->count; k++)
+		{
+			StoreSlot *slot = &b->slots[b->used[k]];
+			PAGE_STORE(memory, slot->address, slot->data);
+			for(j = 0; j < g->count; j++)
+				if(j != i)
+				{
+					threadedInvalidate(g->cpus[j], slot->address);
+					blockInvalidate(g->cpus[j], slot->address);
+				}
+			slot->address = -1;
+		}
+		b->count = 0;
+	}
+
+	for(i = 0; i < g->count; i++)
+	{
+		StoreBuffer *b = g->cpus[i]->stores;
+		if(b->opcode == 0)
+			continue;
+		int old = PAGE_LOAD(memory, b->address);
+		if(b->opcode == FETCH_ADD)
+			PAGE_STORE(memory, b->address, old + b->data);
+		else if(old == b->expected)
+			PAGE_STORE(memory, b->address, b->data);
+		for(j = 0; j < g->count; j++)
+			if(j != i)
+			{
+				threadedInvalidate(g->cpus[j], b->address);
+				blockInvalidate(g->cpus[j], b->address);
+			}
+		b->result = old;
+		b->opcode = 0;
+	}
+
+	for(i = 0; i < g->count; i++)
+	{
+		Machine *m = g->cpus[i];
+		outputRelease(m->output);
+		outputHold(m->output);
+		if(m->status == MACHINE_FAULT || m->status == MACHINE_INVALID)
+			g->stop = 1;
+	}
+}
+
+/****************************************************************
+* Func:   Find the slot of an address, or the free slot where   *
+*         it would go                                           *
+* Param:  StoreBuffer *b: the buffer, never full                *
+*         int addr: the address                                 *
+* Return: int: index of the slot                                *
+*****************************************************************/
+int findSlot(StoreBuffer *b, int addr)
+{
+	unsigned mask = (1u << b->bits) - 1;
+	unsigned i = STORE_HASH(b, addr);
+
+	while(b->slots[i].address != addr && b->slots[i].address != -1)
+		i = (i + 1) & mask;
+	return i;
+}
+
+/****************************************************************
+* Func:   Double the slots of a store buffer, its stores move   *
+*         along in the order they were taken                    *
+* Param:  StoreBuffer *b: the buffer                            *
+* Return: none, exits if out of memory                          *
+*****************************************************************/
+void growBuffer(StoreBuffer *b)
+{
+	StoreSlot *old = b->slots;
+	int *oldUsed = b->used;
+	int count = b->count, i;
+
+	b->bits++;
+	b->slots = malloc(sizeof(StoreSlot) << b->bits);
+	b->used = malloc(sizeof(int) << b->bits);
+	if(b->slots == NULL || b->used == NULL)
+	{
+		printf("Out of memory\n");
+		exit(-1);
+	}
+	for(i = 0; i < 1 << b->bits; i++)
+		b->slots[i].address = -1;
+	b->count = 0;
+	for(i = 0; i < count; i++)
+	{
+		StoreSlot *from = &old[oldUsed[i]];
+		int slot = findSlot(b, from->address);
+		b->slots[slot] = *from;
+		b->used[b->count++] = slot;
+	}
+	free(old);
+	free(oldUsed);
+}
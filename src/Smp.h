@@ -0,0 +1,51 @@
+#ifndef _SMP_H_
+#define _SMP_H_
+
+#include "Machine.h"
+
+// Several CPUs on one memory: CPU 0 is a TRANSPORT_LOCAL machine, CPU 1 to
+// n-1 come from machineCreateCPU() and share its page table. Every CPU runs
+// on its own host thread; nothing is locked, CPUs meet only in memory
+//
+// Memory ordering:
+//   Loads, stores, pushes, ...  one word each, never torn; loads acquire and
+//                               stores release, so a CPU that sees a store
+//                               of another also sees the stores before it
+//   CompareSwap addr            if the word equals X it becomes AC; AC gets
+//                               the word as it was (AC == X: swapped)
+//   FetchAdd addr               the word grows by AC; AC gets the old word
+//   Both atomics are sequentially consistent, a full fence on every CPU
+//
+// Per CPU: registers (AC starts with the CPU number), timers and interrupt
+// controller, user and system stacks, Get generator and Put buffer. The
+// threaded and block engines decode per CPU and, in smpRun(), see code
+// written by another CPU late or never: a CPU waiting for code another one
+// patches may spin forever. Give smpRun() ENGINE_SWITCH CPUs, the simulator
+// rejects -p with another engine unless -q is given. In smpLockstep() the
+// barrier drops every CPU's decoded copy of a stored word
+//
+// Lock-step (smpLockstep(), -q): the same program gives the same run every
+// time. Every CPU runs quantum instructions, then waits at a barrier for the
+// others. Its stores of the quantum stay in its own store buffer, so they
+// are visible only to itself. At the barrier they reach memory CPU by CPU in
+// CPU order, so on a conflict the higher CPU wins.
+//   CompareSwap, FetchAdd   end the CPU's part of the quantum early; they run
+//                           at the barrier after the stores, in CPU order,
+//                           and the rest of the quantum follows it
+//   Put                     output of each CPU is held back and written at
+//                           the barrier in CPU order
+//   Code                    a committed store drops the decoded copies of
+//                           every CPU, all engines see it after the barrier
+// A small quantum interleaves the CPUs finely, a large one waits less often
+
+#define SMP_MAX_CPUS	16
+#define SMP_SLICE		65536	// Instructions between looks at whether another CPU failed
+
+int smpRun(Machine *const *cpus, int count);
+int smpLockstep(Machine *const *cpus, int count, long quantum);
+int smpLoad(Machine *m, int addr);
+void smpStore(Machine *m, int addr, int data);
+int smpAtomic(Machine *m, int opcode, int addr, int expected, int data);
+void runSMP(Machine *boot, int count, long quantum);
+
+#endif
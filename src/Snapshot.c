@@ -0,0 +1,273 @@
+/********************************************************************************
+*********************************************************************************
+**  Save and restore the complete state of a machine                           **
+**  Registers, timer, mode, run state, Get generator and memory pages go into  **
+**  one file. Dirty page bits of the page table make a delta hold only pages   **
+**  written since the previous snapshot; restore walks the chain of deltas     **
+**  back to a full snapshot and applies them oldest first                      **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int snapshotSave(Machine*, char*, char*); // Full or delta snapshot   **
+**       int snapshotRestore(Machine*, char*, char*); // Load a snapshot       **
+**       int snapshotLayout(char*, Layout*); // Memory layout of a snapshot    **
+**    - Internal:                                                              **
+**       int readHeader(char*, SnapshotHeader*, char*); // Open and check      **
+**       int applyPages(Machine*, char*, char*); // Copy pages of one file     **
+**       int zeroPage(int*);              // Page holds only zeros             **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Snapshot.h"
+#include "CPU.h"
+
+
+// Function declare
+static int readHeader(const char *path, SnapshotHeader *h, char *error);
+static int applyPages(Machine *m, const char *path, char *error);
+static int zeroPage(const int *page);
+
+
+/****************************************************************
+* Func:   Write a snapshot of the machine                       *
+* Param:  Machine *m: the machine, TRANSPORT_LOCAL or           *
+*                     TRANSPORT_SHM                             *
+*         char *path: the snapshot file                         *
+*         char *parent: NULL for a full snapshot, else the last *
+*                       snapshot of this machine; only pages    *
+*                       written since then are saved            *
+* Return: int: 0 on success, -1 if the file can not be written  *
+*              or memory lives in another process               *
+*                                                               *
+* On success the dirty bits are cleared, the next delta starts *
+* from here                                                     *
+*****************************************************************/
+int snapshotSave(Machine *m, const char *path, const char *parent)
+{
+	PageTable *pt = m->memory;
+	SnapshotHeader h;
+
+	if(m->transport == TRANSPORT_PIPE || (parent != NULL && strlen(parent) >= SNAPSHOT_PATH_SIZE))
+		return -1;
+	FILE *fp = fopen(path, "wb");
+	if(fp == NULL)
+		return -1;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+	h.version = SNAPSHOT_VERSION;
+	h.kind = (parent != NULL) ? SNAPSHOT_DELTA : SNAPSHOT_FULL;
+	if(parent != NULL)
+		strcpy(h.parent, parent);
+	h.layout = m->layout;
+	h.PC = m->PC;
+	h.SP = m->SP;
+	h.IR = m->IR;
+	h.AC = m->AC;
+	h.X = m->X;
+	h.Y = m->Y;
+	h.mode = m->mode;
+	h.status = m->status;
+	h.faultAddress = m->faultAddress;
+	h.instructions = m->instructions;
+	inputSave(m->input, &h.input);
+	h.irq = m->irq;
+	fwrite(&h, sizeof(h), 1, fp);   // Page count is filled in at the end
+
+	// Full: every page with data; delta: every page written since the parent
+	int i, ok = 1;
+	for(i = 0; i < pt->pageCount && ok; i++)
+	{
+		if(parent != NULL ? !pt->dirty[i] : (pt->pages[i] == pageZero || zeroPage(pt->pages[i])))
+			continue;
+		uint32_t index = i;
+		ok = fwrite(&index, sizeof(index), 1, fp) == 1
+		     && fwrite(pt->pages[i], PAGE_WORDS * sizeof(int32_t), 1, fp) == 1;
+		h.pages++;
+	}
+
+	rewind(fp);
+	ok = ok && fwrite(&h, sizeof(h), 1, fp) == 1;
+	if(fclose(fp) != 0 || !ok)
+		return -1;
+	pageClean(pt);
+	return 0;
+}
+
+/****************************************************************
+* Func:   Load a snapshot into the machine, deltas bring their  *
+*         parents along                                         *
+* Param:  Machine *m: a machine with the layout of the snapshot *
+*         char *path: the snapshot file                         *
+*         char *error: IMAGE_ERROR_SIZE bytes for the message   *
+* Return: int: SNAPSHOT_OK, SNAPSHOT_NO_FILE or SNAPSHOT_BAD;   *
+*              on failure memory may hold part of the snapshot  *
+*****************************************************************/
+int snapshotRestore(Machine *m, const char *path, char *error)
+{
+	SnapshotHeader h, newest;
+	int result;
+
+	// Walk back to the full snapshot
+	char (*chain)[SNAPSHOT_PATH_SIZE] = malloc(SNAPSHOT_MAX_CHAIN * SNAPSHOT_PATH_SIZE);
+	if(chain == NULL)
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "out of memory");
+		return SNAPSHOT_BAD;
+	}
+	int count = 0;
+	snprintf(chain[0], SNAPSHOT_PATH_SIZE, "%s", path);
+	while(1)
+	{
+		if((result = readHeader(chain[count], &h, error)) != SNAPSHOT_OK)
+		{
+			free(chain);
+			return result;
+		}
+		if(count == 0)
+			newest = h;
+		if(memcmp(&h.layout, &m->layout, sizeof(Layout)) != 0)
+		{
+			snprintf(error, IMAGE_ERROR_SIZE, "%s: made for another memory layout", chain[count]);
+			free(chain);
+			return SNAPSHOT_BAD;
+		}
+		count++;
+		if(h.kind == SNAPSHOT_FULL)
+			break;
+		if(count == SNAPSHOT_MAX_CHAIN)
+		{
+			snprintf(error, IMAGE_ERROR_SIZE, "more than %d deltas", SNAPSHOT_MAX_CHAIN);
+			free(chain);
+			return SNAPSHOT_BAD;
+		}
+		memcpy(chain[count], h.parent, SNAPSHOT_PATH_SIZE);
+		chain[count][SNAPSHOT_PATH_SIZE - 1] = '\0';
+	}
+
+	// Memory: full snapshot first, then every delta
+	pageClear(m->memory);
+	while(count-- > 0)
+		if((result = applyPages(m, chain[count], error)) != SNAPSHOT_OK)
+		{
+			free(chain);
+			return result;
+		}
+	free(chain);
+	pageClean(m->memory);
+
+	m->PC = newest.PC;
+	m->SP = newest.SP;
+	m->IR = newest.IR;
+	m->AC = newest.AC;
+	m->X = newest.X;
+	m->Y = newest.Y;
+	m->mode = newest.mode;
+	m->status = newest.status;
+	m->faultAddress = newest.faultAddress;
+	m->instructions = newest.instructions;
+	inputRestore(m->input, &newest.input);
+	m->irq = newest.irq;
+	return SNAPSHOT_OK;
+}
+
+/****************************************************************
+* Func:   Read the memory layout a snapshot was made with, so a *
+*         machine can be created for it                         *
+* Param:  char *path: the snapshot file                         *
+*         Layout *layout: where to store the layout             *
+* Return: int: SNAPSHOT_OK, SNAPSHOT_NO_FILE or SNAPSHOT_BAD    *
+*****************************************************************/
+int snapshotLayout(const char *path, Layout *layout)
+{
+	SnapshotHeader h;
+	char error[IMAGE_ERROR_SIZE];
+	int result = readHeader(path, &h, error);
+
+	if(result == SNAPSHOT_OK)
+		*layout = h.layout;
+	return result;
+}
+
+
+/****************************************************************
+* Func:   Read and check the header of a snapshot               *
+* Param:  char *path: the snapshot file                         *
+*         SnapshotHeader *h: where to store the header          *
+*         char *error: IMAGE_ERROR_SIZE bytes for the message   *
+* Return: int: SNAPSHOT_OK, SNAPSHOT_NO_FILE or SNAPSHOT_BAD    *
+*****************************************************************/
+int readHeader(const char *path, SnapshotHeader *h, char *error)
+{
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL)
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "%s: can not open", path);
+		return SNAPSHOT_NO_FILE;
+	}
+	size_t got = fread(h, sizeof(*h), 1, fp);
+	fclose(fp);
+
+	if(got != 1 || memcmp(h->magic, SNAPSHOT_MAGIC, 4) != 0 || h->version != SNAPSHOT_VERSION
+	   || h->kind > SNAPSHOT_DELTA)
+	{
+		snprintf(error, IMAGE_ERROR_SIZE, "%s: not a snapshot", path);
+		return SNAPSHOT_BAD;
+	}
+	return SNAPSHOT_OK;
+}
+
+/****************************************************************
+* Func:   Copy the pages of one snapshot file into memory       *
+* Param:  Machine *m: the machine                               *
+*         char *path: the snapshot file                         *
+*         char *error: IMAGE_ERROR_SIZE bytes for the message   *
+* Return: int: SNAPSHOT_OK or SNAPSHOT_BAD                      *
+*****************************************************************/
+int applyPages(Machine *m, const char *path, char *error)
+{
+	PageTable *pt = m->memory;
+	SnapshotHeader h;
+	SnapshotPage record;
+
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL || fread(&h, sizeof(h), 1, fp) != 1)
+	{
+		if(fp != NULL)
+			fclose(fp);
+		snprintf(error, IMAGE_ERROR_SIZE, "%s: can not read", path);
+		return SNAPSHOT_BAD;
+	}
+
+	uint32_t i;
+	for(i = 0; i < h.pages; i++)
+	{
+		if(fread(&record.index, sizeof(record.index), 1, fp) != 1
+		   || fread(record.words, sizeof(record.words), 1, fp) != 1
+		   || record.index >= (uint32_t)pt->pageCount)
+		{
+			fclose(fp);
+			snprintf(error, IMAGE_ERROR_SIZE, "%s: truncated or bad page %u", path, i);
+			return SNAPSHOT_BAD;
+		}
+		pageWrite(pt, record.index << PAGE_SHIFT, PAGE_WORDS, record.words);  // Last page may be partial
+	}
+	fclose(fp);
+	return SNAPSHOT_OK;
+}
+
+/****************************************************************
+* Func:   Check if a page holds only zeros                      *
+* Param:  int *page: PAGE_WORDS words                           *
+* Return: int: 1 if every word is 0                             *
+*****************************************************************/
+int zeroPage(const int *page)
+{
+	int i;
+	for(i = 0; i < PAGE_WORDS; i++)
+		if(page[i] != 0)
+			return 0;
+	return 1;
+}
@@ -0,0 +1,60 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include "Machine.h"
+#include "Input.h"
+
+// Snapshot: the complete state of a machine, to resume a run later
+//
+// Layout, host byte order:
+//   SnapshotHeader
+//   SnapshotPage[pages]
+// A full snapshot holds every page that is not all zero. A delta holds only
+// the pages written since the snapshot named in parent and is restored on
+// top of it, so frequent checkpoints cost the pages a program touched
+
+#define SNAPSHOT_MAGIC		"CPUS"
+#define SNAPSHOT_VERSION	2
+
+#define SNAPSHOT_FULL		0
+#define SNAPSHOT_DELTA		1
+
+#define SNAPSHOT_PATH_SIZE	256
+#define SNAPSHOT_MAX_CHAIN	1024	// Deltas followed back to a full snapshot
+#define SNAPSHOT_FULL_EVERY	16		// Checkpoints: one full snapshot, then deltas
+
+// Result of snapshotRestore, the same values as IMAGE_*
+#define SNAPSHOT_OK			0
+#define SNAPSHOT_NO_FILE	-1		// File can not be opened
+#define SNAPSHOT_BAD		-2		// Damaged, or made for another layout
+
+typedef struct
+{
+	char magic[4];				// SNAPSHOT_MAGIC
+	uint16_t version;			// SNAPSHOT_VERSION
+	uint16_t kind;				// SNAPSHOT_FULL or SNAPSHOT_DELTA
+	uint32_t pages;				// SnapshotPage records that follow
+	uint32_t reserved;			// 0
+	char parent[SNAPSHOT_PATH_SIZE];	// Delta: the snapshot it applies to
+
+	Layout layout;
+	int32_t PC, SP, IR, AC, X, Y;
+	int32_t mode;
+	int32_t status, faultAddress;
+	int64_t instructions;
+	InputState input;			// Get generator and script position
+	InterruptController irq;	// Clock, timers, pending lines, vectors
+} SnapshotHeader;
+
+typedef struct
+{
+	uint32_t index;				// Page number, address >> PAGE_SHIFT
+	int32_t words[PAGE_WORDS];
+} SnapshotPage;
+
+int snapshotSave(Machine *m, const char *path, const char *parent);
+int snapshotRestore(Machine *m, const char *path, char *error);
+int snapshotLayout(const char *path, Layout *layout);
+
+#endif
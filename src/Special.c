@@ -0,0 +1,393 @@
+/********************************************************************************
+*********************************************************************************
+**  Specialised switch engine                                                  **
+**  One interpreter loop, inlined into a variant per memory layout so the      **
+**  protection limits of the standard layout are constants, run up to the      **
+**  interrupt horizon without a timer compare, see Special.h                   **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       void specialRun(Machine*, long); // Switch engine, best loop for m    **
+**    - Internal:                                                              **
+**       Loop pickLoop(Machine*);         // Variant for m, NULL for generic   **
+**       long standardLayout(Machine*, long); // 2000 words, system at 1000    **
+**       long anyLayout(Machine*, long);  // Limits from the machine           **
+**       long loop(Machine*, long, unsigned, unsigned); // The loop itself     **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Memory.h"
+#include "Verify.h"
+#include "Diff.h"
+#include "Special.h"
+
+
+// A specialised loop: runs up to limit instructions, returns how many ran
+typedef long (*Loop)(Machine *m, long limit);
+
+
+// Function declare
+static Loop pickLoop(Machine *m);
+static long standardLayout(Machine *m, long limit);
+static long anyLayout(Machine *m, long limit);
+static inline long loop(Machine *m, long limit, unsigned userLimit, unsigned kernelLimit)
+	__attribute__((always_inline));
+
+
+// Registers back into the machine, the running instruction counted, before
+// anything that may leave through machineFault() and at the end of a run
+#define SYNC_OUT()                                                          \
+	do{                                                                     \
+		m->PC = pc; m->SP = sp; m->AC = ac; m->X = x; m->Y = y;             \
+		m->IR = ir; m->mode = mode; m->irq.clock = clock;                   \
+		m->instructions = base + executed;                                  \
+	}while(0)
+
+#define FAULT(status, addr)                                                 \
+	do{                                                                     \
+		SYNC_OUT();                                                         \
+		machineFault(m, status, addr);                                      \
+	}while(0)
+
+// One protection compare per access, as readWord() and writeMemory()
+#define READ(dest, addr)                                                    \
+	do{                                                                     \
+		int a_ = (addr);                                                    \
+		if((unsigned)a_ >= bound)                                           \
+			FAULT(MACHINE_FAULT, a_);                                       \
+		dest = PAGE_LOAD(pt, a_);                                           \
+	}while(0)
+
+#define WRITE(addr, data)                                                   \
+	do{                                                                     \
+		int a_ = (addr), d_ = (data);                                       \
+		if((unsigned)a_ >= bound)                                           \
+			FAULT(MACHINE_FAULT, a_);                                       \
+		DIFF_WRITE(m, a_, d_);                                              \
+		VERIFY_INVALIDATE(m, a_);                                           \
+		PAGE_STORE(pt, a_, d_);                                             \
+	}while(0)
+
+// Next word at PC, PC moves on first as in fetch()
+#define FETCH(dest)                                                         \
+	do{                                                                     \
+		pc++;                                                               \
+		READ(dest, pc - 1);                                                 \
+	}while(0)
+
+
+/****************************************************************
+* Func:   Run the switch engine: the specialised loop up to     *
+*         each interrupt horizon, the instruction that reaches  *
+*         a deadline, and everything if no loop applies, in     *
+*         stepCPU()                                             *
+* Param:  Machine *m: the machine                               *
+*         long count: most instructions to run                  *
+* Return: none, m->instructions counts what ran                 *
+*****************************************************************/
+void specialRun(Machine *m, long count)
+{
+	Loop run = pickLoop(m);
+
+	while(count > 0 && m->status == MACHINE_RUNNING)
+	{
+		// User mode instructions that can not reach the earliest deadline
+		long long room = IRQ_NEXT(&m->irq) - m->irq.clock - 1;
+		if(run != NULL && room > 0)
+		{
+			count -= run(m, (room < count) ? (long)room : count);
+			continue;
+		}
+		m->instructions++;
+		stepCPU(m);
+		count--;
+	}
+}
+
+/****************************************************************
+* Func:   Pick the specialised loop for a machine               *
+* Param:  Machine *m: the machine                               *
+* Return: Loop: the variant, NULL if only the generic loop      *
+*               keeps the semantics, see Special.h              *
+*****************************************************************/
+static Loop pickLoop(Machine *m)
+{
+	if(m->generic || m->transport == TRANSPORT_PIPE || m->stores != NULL || m->trace != NULL
+	   || m->profile != NULL || m->timing != NULL || (m->stream != NULL && m->irq.vector[IRQ_INPUT] >= 0))
+		return NULL;
+	if(m->limit[USER_MODE] == SYSTEM_ADDRESS && m->limit[KERNEL_MODE] == MEMORY_SIZE)
+		return standardLayout;
+	return anyLayout;
+}
+
+/****************************************************************
+* Func:   Loop for the standard layout, limits are constants    *
+* Param:  Machine *m: the machine                               *
+*         long limit: instructions, none reaches a deadline     *
+* Return: long: instructions run                                *
+*****************************************************************/
+static long standardLayout(Machine *m, long limit)
+{
+	return loop(m, limit, SYSTEM_ADDRESS, MEMORY_SIZE);
+}
+
+/****************************************************************
+* Func:   Loop for any other layout                             *
+* Param:  Machine *m: the machine                               *
+*         long limit: instructions, none reaches a deadline     *
+* Return: long: instructions run                                *
+*****************************************************************/
+static long anyLayout(Machine *m, long limit)
+{
+	return loop(m, limit, m->limit[USER_MODE], m->limit[KERNEL_MODE]);
+}
+
+/****************************************************************
+* Func:   The interpreter loop, exeInstruction() with the       *
+*         registers in locals; inlined into every variant       *
+* Param:  Machine *m: the machine                               *
+*         long limit: instructions, none reaches a deadline     *
+*         unsigned userLimit, kernelLimit: m->limit per mode    *
+* Return: long: instructions run, fewer than limit after End    *
+*****************************************************************/
+static inline long loop(Machine *m, long limit, unsigned userLimit, unsigned kernelLimit)
+{
+	PageTable *pt = m->memory;
+	int pc = m->PC, sp = m->SP, ac = m->AC, x = m->X, y = m->Y, ir = m->IR;
+	Boolean mode = m->mode;
+	unsigned bound = (mode == USER_MODE) ? userLimit : kernelLimit;
+	long long clock = m->irq.clock, base = m->instructions;
+	long executed = 0;
+
+	while(executed < limit)
+	{
+		executed++;
+		if(mode == USER_MODE)		// Timer works only if in user mode
+			clock++;
+		FETCH(ir);
+
+		switch(ir)
+		{
+			case LOAD_VALUE:
+				FETCH(ac);
+				break;
+
+			case LOAD_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				READ(ac, addr);
+				break;
+			}
+
+			case LOAD_IND_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				READ(addr, addr);
+				READ(ac, addr);
+				break;
+			}
+
+			case LOAD_IDX_X_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				READ(ac, addr + x);
+				break;
+			}
+
+			case LOAD_IDX_Y_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				READ(ac, addr + y);
+				break;
+			}
+
+			case LOAD_SP_X:
+				READ(ac, sp + x);
+				break;
+
+			case STORE_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				WRITE(addr, ac);
+				break;
+			}
+
+			case GET:
+				ac = m->get(m->getData);
+				break;
+
+			case GET_PORT:
+			{
+				int port;
+				FETCH(port);
+				ac = readPort(m, port);
+				break;
+			}
+
+			case PUT_PORT:
+			{
+				int port;
+				FETCH(port);
+				m->put(m->putData, (Boolean)port, ac);
+				break;
+			}
+
+			case ADD_X:
+				ac += x;
+				break;
+
+			case ADD_Y:
+				ac += y;
+				break;
+
+			case SUB_X:
+				ac -= x;
+				break;
+
+			case SUB_Y:
+				ac -= y;
+				break;
+
+			case COPY_TO_X:
+				x = ac;
+				break;
+
+			case COPY_FROM_X:
+				ac = x;
+				break;
+
+			case COPY_TO_Y:
+				y = ac;
+				break;
+
+			case COPY_FROM_Y:
+				ac = y;
+				break;
+
+			case COPY_TO_SP:
+				sp = ac;
+				break;
+
+			case COPY_FROM_SP:
+				ac = sp;
+				break;
+
+			case JUMP_ADDR:
+				FETCH(pc);
+				break;
+
+			case JUMP_IF_EQUAL_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				if(ac == 0)
+					pc = addr;
+				break;
+			}
+
+			case JUMP_IF_NOT_EQUAL_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				if(ac != 0)
+					pc = addr;
+				break;
+			}
+
+			case CALL_ADDR:
+			{
+				int addr;
+				FETCH(addr);
+				sp--;
+				WRITE(sp, pc);				// Push return address onto stack
+				pc = addr;
+				break;
+			}
+
+			case RET:
+				READ(pc, sp);
+				sp++;
+				break;
+
+			case INC_X:
+				x++;
+				break;
+
+			case DEC_X:
+				x--;
+				break;
+
+			case PUSH:
+				sp--;
+				WRITE(sp, ac);
+				break;
+
+			case POP:
+				READ(ac, sp);
+				sp++;
+				break;
+
+			// Int enters kernel mode as interrupt() does
+			case INT:
+				if(mode == USER_MODE)
+				{
+					int tmp = sp;
+					mode = KERNEL_MODE;
+					bound = kernelLimit;
+					sp = m->layout.systemStack;
+					sp--;
+					WRITE(sp, tmp);			// Save user SP into system stack
+					sp--;
+					WRITE(sp, pc);			// Save current PC into system stack
+					pc = m->irq.vector[IRQ_INT];
+					break;
+				}
+				// Int in kernel mode falls through to IRet, same as switch(IR)
+
+			case I_RET:
+				READ(pc, sp);				// Pop PC, SP
+				sp++;
+				READ(sp, sp);
+				mode = USER_MODE;
+				bound = userLimit;
+				break;
+
+			// The atomics check and write memory themselves
+			case COMPARE_SWAP:
+			{
+				int addr;
+				FETCH(addr);
+				SYNC_OUT();
+				ac = compareSwap(m, addr, x, ac);
+				break;
+			}
+
+			case FETCH_ADD:
+			{
+				int addr;
+				FETCH(addr);
+				SYNC_OUT();
+				ac = fetchAdd(m, addr, ac);
+				break;
+			}
+
+			case END:
+				m->status = MACHINE_END;	// Caller ends memory process
+				SYNC_OUT();
+				return executed;
+
+			default:
+				FAULT(MACHINE_INVALID, pc - 1);
+				break;
+		}
+	}
+	SYNC_OUT();
+	return executed;
+}
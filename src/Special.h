@@ -0,0 +1,25 @@
+#ifndef _SPECIAL_H_
+#define _SPECIAL_H_
+
+#include "Machine.h"
+
+// Specialised switch engine. stepCPU() goes through fetch(), readWord() and
+// writeMemory() for every word, and checks the transport, the trace and the
+// interrupt deadline on every instruction. Where none of that applies the
+// switch engine runs a specialised loop instead:
+//   - registers live in host registers, memory is read and written straight
+//     through the page table with one protection compare per access
+//   - standard layout (2000 words, system from 1000): both limits are
+//     compile-time constants; any other layout loads them once per run
+//   - no timer compare: a run is cut at the interrupt horizon, the last
+//     instruction before the earliest deadline, and the instruction that
+//     reaches it runs in stepCPU(); with no timer running the horizon is
+//     never and the loop runs to the budget
+// The generic loop stays for the pipe transport and the memory server,
+// lock-step stores, traces, -DPROFILE builds, the cycle model, an input port
+// with an interrupt handler (it moves the deadline from another thread), and
+// machines with generic set, such as the reference of a differential run
+
+void specialRun(Machine *m, long count);
+
+#endif
@@ -0,0 +1,180 @@
+/********************************************************************************
+*********************************************************************************
+**  Input port for GetPort                                                     **
+**  A background thread reads a file or stdin into a lock-free ring, the CPU   **
+**  takes bytes out of it without ever waiting, see Stream.h                   **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Stream *streamOpen(char*, int64_t*); // Start reading a file or stdin **
+**       void streamClose(Stream*);       // Stop the reader, free the port    **
+**       int streamGet(Stream*);          // Next byte, or EMPTY/END           **
+**       int streamArrived(Stream*, int); // Data came since the last clear    **
+**    - Internal:                                                              **
+**       void *readerThread(void*);       // Fill the ring from the file       **
+**       void notify(Stream*);            // Tell the CPU that data came       **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "Stream.h"
+
+
+// One input port
+typedef struct Stream
+{
+	unsigned char ring[STREAM_RING_SIZE];
+	uint32_t head;				// Bytes written, the reader advances it
+	uint32_t tail;				// Bytes taken, the CPU advances it
+	int ended;					// The reader saw end of file or an error
+	int arrived;				// Data or end came since the CPU cleared it
+	int64_t *wake;				// Interrupt controller's next, or NULL to poll only
+	int fd;
+	pthread_t reader;
+} Stream;
+
+
+// Function declare
+static void *readerThread(void *arg);
+static void notify(Stream *s);
+
+
+#define FULL_WAIT_NS	100000	// Reader's nap while the CPU has not taken anything
+
+
+/****************************************************************
+* Func:   Open an input port and start its reader thread        *
+* Param:  char *path: file to read, "-" for stdin               *
+*         int64_t *wake: set to 0 when data comes, NULL if the  *
+*         port raises no interrupt                              *
+* Return: Stream*: the port, NULL on failure                    *
+*****************************************************************/
+Stream *streamOpen(const char *path, int64_t *wake)
+{
+	Stream *s = calloc(1, sizeof(Stream));
+	if(s == NULL)
+		return NULL;
+	s->wake = wake;
+	s->fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY);
+	if(s->fd < 0)
+	{
+		free(s);
+		return NULL;
+	}
+	if(pthread_create(&s->reader, NULL, readerThread, s) != 0)
+	{
+		if(s->fd != STDIN_FILENO)
+			close(s->fd);
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+/****************************************************************
+* Func:   Stop the reader thread and free the port              *
+* Param:  Stream *s: the port, may be NULL                      *
+* Return: none                                                  *
+*****************************************************************/
+void streamClose(Stream *s)
+{
+	if(s == NULL)
+		return;
+	pthread_cancel(s->reader);		// It may wait in read() for a terminal
+	pthread_join(s->reader, NULL);
+	if(s->fd != STDIN_FILENO)
+		close(s->fd);
+	free(s);
+}
+
+/****************************************************************
+* Func:   Take the next byte, never waits                       *
+* Param:  Stream *s: the port                                   *
+* Return: int: the byte 0..255, STREAM_EMPTY if none came yet,  *
+*         STREAM_END once the input ended and all was taken     *
+*****************************************************************/
+int streamGet(Stream *s)
+{
+	uint32_t tail = s->tail;
+	uint32_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+	if(tail == head)
+	{
+		if(!__atomic_load_n(&s->ended, __ATOMIC_ACQUIRE))
+			return STREAM_EMPTY;
+		head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);	// Bytes of the last read come first
+		if(tail == head)
+			return STREAM_END;
+	}
+	int byte = s->ring[tail & (STREAM_RING_SIZE - 1)];
+	__atomic_store_n(&s->tail, tail + 1, __ATOMIC_RELEASE);	// Frees the slot for the reader
+	return byte;
+}
+
+/****************************************************************
+* Func:   Did data or the end come since the last clear         *
+* Param:  Stream *s: the port                                   *
+*         int clear: 1 to clear the flag, 0 to only look        *
+* Return: int: 1 if it did, else 0                              *
+*****************************************************************/
+int streamArrived(Stream *s, int clear)
+{
+	if(clear)
+		return __atomic_exchange_n(&s->arrived, 0, __ATOMIC_ACQ_REL);
+	return __atomic_load_n(&s->arrived, __ATOMIC_ACQUIRE);
+}
+
+/****************************************************************
+* Func:   Reader thread: fill the free part of the ring, nap    *
+*         while it is full, stop at end of file                 *
+* Param:  void *arg: the port                                   *
+* Return: void*: NULL                                           *
+*****************************************************************/
+static void *readerThread(void *arg)
+{
+	Stream *s = arg;
+	struct timespec nap = {0, FULL_WAIT_NS};
+
+	for(;;)
+	{
+		uint32_t head = s->head;
+		uint32_t room = STREAM_RING_SIZE - (head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE));
+		if(room == 0)
+		{
+			nanosleep(&nap, NULL);
+			continue;
+		}
+		uint32_t at = head & (STREAM_RING_SIZE - 1);
+		if(room > STREAM_RING_SIZE - at)
+			room = STREAM_RING_SIZE - at;	// Up to the end of the ring, the rest next time
+
+		ssize_t got = read(s->fd, s->ring + at, room);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+		{
+			__atomic_store_n(&s->ended, 1, __ATOMIC_RELEASE);
+			notify(s);
+			return NULL;
+		}
+		__atomic_store_n(&s->head, head + (uint32_t)got, __ATOMIC_RELEASE);
+		notify(s);
+	}
+}
+
+/****************************************************************
+* Func:   Tell the CPU that data or the end came: set arrived,  *
+*         then pull the interrupt deadline down to now          *
+* Param:  Stream *s: the port                                   *
+* Return: none                                                  *
+*****************************************************************/
+static void notify(Stream *s)
+{
+	__atomic_store_n(&s->arrived, 1, __ATOMIC_RELEASE);
+	if(s->wake != NULL)
+		__atomic_store_n(s->wake, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,30 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+// Input port behind GetPort: a background thread reads a file or stdin into a
+// single-producer/single-consumer ring, so GetPort never waits for the host.
+// The reader only advances head and the CPU only advances tail, each with a
+// release store the other side pairs with an acquire load; no lock is taken
+//
+// When a read brings data the reader sets arrived and, if the port has an
+// interrupt handler, pulls the interrupt controller's next down to 0, so the
+// engine calls takeInterrupt() at its next check. takeInterrupt() turns
+// arrived into IRQ_INPUT. Input is as timed as the host makes it: a run that
+// takes IRQ_INPUT is not replayed by the same seed
+
+#include <stdint.h>
+
+#define STREAM_RING_SIZE	4096	// Bytes, power of 2
+
+// GetPort results beside a byte 0..255
+#define STREAM_EMPTY		-1		// Nothing read yet, try again later
+#define STREAM_END			-2		// End of the input, or no input port
+
+struct Stream;
+
+struct Stream *streamOpen(const char *path, int64_t *wake);
+void streamClose(struct Stream *s);
+int streamGet(struct Stream *s);
+int streamArrived(struct Stream *s, int clear);
+
+#endif
@@ -0,0 +1,196 @@
+/********************************************************************************
+*********************************************************************************
+**  Symbol table of an assembled program                                       **
+**  The assembler writes every label with its address; the profiler and the    **
+**  trace decoder read the file back to show name+offset instead of a bare PC  **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       SymbolTable *symbolLoad(char*);  // Read a symbol file                **
+**       void symbolFree(SymbolTable*);   // Release a table                   **
+**       int symbolWrite(FILE*, Symbol*, int); // Sort and write symbols       **
+**       int symbolFind(SymbolTable*, int); // Symbol an address belongs to    **
+**       int symbolFormat(SymbolTable*, int, char*, int); // "name+offset"     **
+**    - Internal:                                                              **
+**       int compareSymbols(void*, void*); // Order by address, then name      **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Symbol.h"
+
+
+// Function declare
+static int compareSymbols(const void *a, const void *b);
+
+
+#define LINE_BUFFER_SIZE 512
+
+
+/****************************************************************
+* Func:   Read a symbol file                                    *
+* Param:  char *path: the file, "address name" per line         *
+* Return: SymbolTable*: the table, NULL if the file can not be  *
+*                       read or a line is not a symbol          *
+*****************************************************************/
+SymbolTable *symbolLoad(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL)
+		return NULL;
+
+	// Names are kept in one block, offsets until it stops growing
+	SymbolTable *t = calloc(1, sizeof(SymbolTable));
+	size_t used = 0, room = 4096;
+	int capacity = 256, ok = 1;
+	char line[LINE_BUFFER_SIZE], name[LINE_BUFFER_SIZE];
+	if(t != NULL)
+	{
+		t->symbols = malloc(capacity * sizeof(Symbol));
+		t->names = malloc(room);
+	}
+	if(t == NULL || t->symbols == NULL || t->names == NULL)
+		ok = 0;
+	while(ok && fgets(line, sizeof(line), fp) != NULL)
+	{
+		int address;
+		if(sscanf(line, "%d %511s", &address, name) != 2)
+		{
+			ok = (line[strspn(line, " \t\r\n")] == '\0');	// Blank lines are fine
+			continue;
+		}
+		size_t length = strlen(name) + 1;
+		if(used + length > room)
+		{
+			char *bigger = realloc(t->names, 2 * room + length);
+			if(bigger == NULL)
+			{
+				ok = 0;
+				break;
+			}
+			t->names = bigger;
+			room = 2 * room + length;
+		}
+		if(t->count == capacity)
+		{
+			Symbol *more = realloc(t->symbols, 2 * capacity * sizeof(Symbol));
+			if(more == NULL)
+			{
+				ok = 0;
+				break;
+			}
+			t->symbols = more;
+			capacity *= 2;
+		}
+		memcpy(t->names + used, name, length);
+		t->symbols[t->count].address = address;
+		t->symbols[t->count].name = (const char *)used;
+		t->count++;
+		used += length;
+	}
+	fclose(fp);
+	if(!ok)
+	{
+		symbolFree(t);
+		return NULL;
+	}
+
+	int i;
+	for(i = 0; i < t->count; i++)
+		t->symbols[i].name = t->names + (size_t)t->symbols[i].name;
+	qsort(t->symbols, t->count, sizeof(Symbol), compareSymbols);
+	return t;
+}
+
+/****************************************************************
+* Func:   Release a table from symbolLoad()                     *
+* Param:  SymbolTable *t: the table, may be NULL                *
+* Return: none                                                  *
+*****************************************************************/
+void symbolFree(SymbolTable *t)
+{
+	if(t == NULL)
+		return;
+	free(t->symbols);
+	free(t->names);
+	free(t);
+}
+
+/****************************************************************
+* Func:   Sort symbols by address and write them as a symbol    *
+*         file                                                  *
+* Param:  FILE *fp: where to write                              *
+*         Symbol *symbols: the symbols, sorted in place         *
+*         int count: number of symbols                          *
+* Return: int: 0 on success, -1 if writing failed               *
+*****************************************************************/
+int symbolWrite(FILE *fp, Symbol *symbols, int count)
+{
+	int i;
+
+	qsort(symbols, count, sizeof(Symbol), compareSymbols);
+	for(i = 0; i < count; i++)
+		fprintf(fp, "%d %s\n", symbols[i].address, symbols[i].name);
+	return ferror(fp) ? -1 : 0;
+}
+
+/****************************************************************
+* Func:   Find the symbol an address belongs to: the last one   *
+*         at or below it                                        *
+* Param:  SymbolTable *t: the table                             *
+*         int address: the address                              *
+* Return: int: index into t->symbols, -1 if none is at or below *
+*****************************************************************/
+int symbolFind(const SymbolTable *t, int address)
+{
+	int low = 0, high = t->count;
+
+	// First symbol above address, binary search
+	while(low < high)
+	{
+		int mid = low + (high - low) / 2;
+		if(t->symbols[mid].address <= address)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low - 1;
+}
+
+/****************************************************************
+* Func:   Name an address as "name" or "name+offset"            *
+* Param:  SymbolTable *t: the table                             *
+*         int address: the address                              *
+*         char *text: where to store the name                   *
+*         int size: size of text                                *
+* Return: int: length of the name, 0 if no symbol is at or      *
+*              below the address                                *
+*****************************************************************/
+int symbolFormat(const SymbolTable *t, int address, char *text, int size)
+{
+	int i = symbolFind(t, address);
+	if(i < 0)
+	{
+		text[0] = '\0';
+		return 0;
+	}
+	if(address == t->symbols[i].address)
+		return snprintf(text, size, "%s", t->symbols[i].name);
+	return snprintf(text, size, "%s+%d", t->symbols[i].name, address - t->symbols[i].address);
+}
+
+
+/****************************************************************
+* Func:   Order symbols by address, then name                   *
+* Param:  void *a, void *b: two Symbol                          *
+* Return: int: qsort() order                                    *
+*****************************************************************/
+int compareSymbols(const void *a, const void *b)
+{
+	const Symbol *x = a, *y = b;
+
+	if(x->address != y->address)
+		return (x->address > y->address) - (x->address < y->address);
+	return strcmp(x->name, y->name);
+}
@@ -0,0 +1,29 @@
+#ifndef _SYMBOL_H_
+#define _SYMBOL_H_
+
+#include <stdio.h>
+
+// Symbol table written by the assembler, one label per line:
+//   address name
+// sorted by address. The profiler and tracedump use it to name PCs
+
+typedef struct
+{
+	int address;
+	const char *name;
+} Symbol;
+
+typedef struct SymbolTable
+{
+	Symbol *symbols;			// Sorted by address
+	int count;
+	char *names;				// Storage of every name
+} SymbolTable;
+
+SymbolTable *symbolLoad(const char *path);
+void symbolFree(SymbolTable *t);
+int symbolWrite(FILE *fp, Symbol *symbols, int count);
+int symbolFind(const SymbolTable *t, int address);
+int symbolFormat(const SymbolTable *t, int address, char *text, int size);
+
+#endif
@@ -0,0 +1,444 @@
+/********************************************************************************
+*********************************************************************************
+**  Simulate CPU with a pre-decoded instruction stream                         **
+**  Each instruction is decoded once into {handler, operand, length}, keyed    **
+**  by PC, and dispatched with computed goto instead of switch(IR)             **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       long runThreaded(Machine*, long); // Run up to a number of instr.     **
+**       void threadedInvalidate(Machine*, int); // Drop decoded words         **
+**       void threadedFree(Machine*);     // Free decoded instructions         **
+**    - Internal:                                                              **
+**       Decoded *decode(Machine*, int, void**); // Decode instruction at PC   **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "Verify.h"
+
+
+// One pre-decoded instruction
+typedef struct
+{
+	void *handler;		// Address of handler label, NULL if not decoded yet
+	int operand;		// Operand word, if the instruction has one
+	short length;		// Words in memory: 1 or 2
+	short opcode;		// Value for IR
+} Decoded;
+
+// Per-machine engine state
+struct ThreadedState
+{
+	int size;						// Entries of decoded[], words of memory
+	Decoded scratch;				// Instruction outside memory, never kept
+	Decoded decoded[];				// Indexed by address of the opcode word,
+									// calloc() leaves untouched pages unbacked
+};
+
+
+// Function declare
+static Decoded *decode(Machine *m, int pc, void **table);
+
+
+#define MAX_OPCODE END
+
+// Handlers beyond the opcodes: loads the verifier proved in bounds
+#define SAFE_LOAD_ADDR		(MAX_OPCODE + 1)
+#define SAFE_LOAD_IND_ADDR	(MAX_OPCODE + 2)
+#define HANDLER_COUNT		(MAX_OPCODE + 3)
+
+
+/****************************************************************
+* Func:   Drop pre-decoded instructions that cover addr, the    *
+*         word may be an opcode or the operand of addr - 1      *
+* Param:  Machine *m: the machine                               *
+*         int addr: the address written                         *
+* Return: none                                                  *
+*****************************************************************/
+void threadedInvalidate(Machine *m, int addr)
+{
+	struct ThreadedState *t = m->threaded;
+	if(t == NULL)
+		return;
+	if(addr >= 0 && addr < t->size)
+		t->decoded[addr].handler = NULL;
+	if(addr >= 1 && addr <= t->size)
+		t->decoded[addr - 1].handler = NULL;
+}
+
+/****************************************************************
+* Func:   Free pre-decoded instructions, they are rebuilt on    *
+*         the next run                                          *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void threadedFree(Machine *m)
+{
+	free(m->threaded);
+	m->threaded = NULL;
+}
+
+/****************************************************************
+* Func:   Decode the instruction at pc, reading through the     *
+*         normal memory path so protection still applies        *
+* Param:  Machine *m: the machine                               *
+*         int pc: address of the opcode                         *
+*         void **table: handler label of each opcode            *
+* Return: Decoded*: the decoded instruction                     *
+*****************************************************************/
+Decoded *decode(Machine *m, int pc, void **table)
+{
+	struct ThreadedState *t = m->threaded;
+	Decoded *d = (pc >= 0 && pc < t->size) ? &t->decoded[pc] : &t->scratch;
+
+	int opcode = readCode(m, pc);
+	if(opcode < 0 || opcode > MAX_OPCODE || table[opcode] == NULL)
+	{
+		d->handler = table[0];		// Invalid instruction
+		d->opcode = 0;
+		d->length = 1;
+		return d;
+	}
+
+	d->opcode = opcode;
+	switch(opcode)
+	{
+		// Instructions with an operand
+		case LOAD_VALUE: case LOAD_ADDR: case LOAD_IND_ADDR:
+		case LOAD_IDX_X_ADDR: case LOAD_IDX_Y_ADDR: case STORE_ADDR:
+		case PUT_PORT: case JUMP_ADDR: case JUMP_IF_EQUAL_ADDR:
+		case JUMP_IF_NOT_EQUAL_ADDR: case CALL_ADDR:
+		case COMPARE_SWAP: case FETCH_ADD: case GET_PORT:
+			d->operand = readCode(m, pc + 1);
+			d->length = 2;
+			break;
+
+		default:
+			d->operand = 0;
+			d->length = 1;
+			break;
+	}
+	d->handler = table[opcode];
+
+	// Verified: the address can not fault, read it without the check
+	if(m->transport != TRANSPORT_PIPE && pc >= 0 && pc < t->size && VERIFIED_SAFE(m, pc))
+	{
+		if(opcode == LOAD_ADDR)
+			d->handler = table[SAFE_LOAD_ADDR];
+		else if(opcode == LOAD_IND_ADDR)
+			d->handler = table[SAFE_LOAD_IND_ADDR];
+	}
+	return d;
+}
+
+/****************************************************************
+* Func:   Run the program with the threaded engine, same        *
+*         semantics as the fetch/execute loop in stepCPU()      *
+* Param:  Machine *m: the machine                               *
+*         long limit: most instructions to run                  *
+* Return: long: instructions executed, stops early at End       *
+*****************************************************************/
+long runThreaded(Machine *m, long limit)
+{
+	static void *table[HANDLER_COUNT] = {
+		[0]                      = &&invalid,
+		[LOAD_VALUE]             = &&load_value,
+		[LOAD_ADDR]              = &&load_addr,
+		[LOAD_IND_ADDR]          = &&load_ind_addr,
+		[LOAD_IDX_X_ADDR]        = &&load_idx_x_addr,
+		[LOAD_IDX_Y_ADDR]        = &&load_idx_y_addr,
+		[LOAD_SP_X]              = &&load_sp_x,
+		[STORE_ADDR]             = &&store_addr,
+		[GET]                    = &&get,
+		[PUT_PORT]               = &&put_port,
+		[ADD_X]                  = &&add_x,
+		[ADD_Y]                  = &&add_y,
+		[SUB_X]                  = &&sub_x,
+		[SUB_Y]                  = &&sub_y,
+		[COPY_TO_X]              = &&copy_to_x,
+		[COPY_FROM_X]            = &&copy_from_x,
+		[COPY_TO_Y]              = &&copy_to_y,
+		[COPY_FROM_Y]            = &&copy_from_y,
+		[COPY_TO_SP]             = &&copy_to_sp,
+		[COPY_FROM_SP]           = &&copy_from_sp,
+		[JUMP_ADDR]              = &&jump_addr,
+		[JUMP_IF_EQUAL_ADDR]     = &&jump_if_equal_addr,
+		[JUMP_IF_NOT_EQUAL_ADDR] = &&jump_if_not_equal_addr,
+		[CALL_ADDR]              = &&call_addr,
+		[RET]                    = &&ret,
+		[INC_X]                  = &&inc_x,
+		[DEC_X]                  = &&dec_x,
+		[PUSH]                   = &&push,
+		[POP]                    = &&pop,
+		[INT]                    = &&int_,
+		[I_RET]                  = &&i_ret,
+		[COMPARE_SWAP]           = &&compare_swap,
+		[FETCH_ADD]              = &&fetch_add,
+		[GET_PORT]               = &&get_port,
+		[END]                    = &&end,
+		[SAFE_LOAD_ADDR]         = &&safe_load_addr,
+		[SAFE_LOAD_IND_ADDR]     = &&safe_load_ind_addr,
+	};
+	Decoded *d;
+
+	if(m->threaded == NULL)
+	{
+		size_t size = m->layout.size;
+		m->threaded = calloc(1, sizeof(struct ThreadedState) + size * sizeof(Decoded));
+		if(m->threaded == NULL)
+		{
+			printf("Out of memory\n");
+			exit(-1);
+		}
+		m->threaded->size = size;
+	}
+	Decoded *decoded = m->threaded->decoded;
+	const unsigned size = m->layout.size;
+	const int system = m->layout.system;
+
+	// Registers live in locals while the engine runs, the machine is
+	// synchronised around interrupt entry and when the engine returns
+	int pc = m->PC, sp = m->SP, ac = m->AC, x = m->X, y = m->Y;
+	long long clock = m->irq.clock;
+	long left = limit;
+	struct Trace *const trace = m->trace;
+
+	// Fetch: a decoded instruction is reused while its words are unchanged,
+	// user mode must still not execute words at or above the system boundary
+	#define DISPATCH()                                                          \
+		do{                                                                     \
+			if(left-- == 0)                                                     \
+				goto out;				/* Budget used up */                    \
+			d = ((unsigned)pc < size && decoded[pc].handler != NULL)            \
+			    ? &decoded[pc] : decode(m, pc, table);                          \
+			if(m->mode == USER_MODE)                                            \
+			{                                                                   \
+				clock++;				/* Timer works only if in user mode */  \
+				if(pc + d->length > system)                                     \
+					readMemory(m, pc > system ? pc : system);                   \
+			}                                                                   \
+			PROFILE_STEP(m, pc, d->opcode, m->mode == KERNEL_MODE);             \
+			if(trace != NULL)                                                   \
+				traceStep(trace, pc, d->opcode, d->operand,                     \
+				          ac, x, y, sp, m->mode);                               \
+			m->IR = d->opcode;                                                  \
+			pc += d->length;                                                    \
+			goto *d->handler;                                                   \
+		}while(0)
+
+	// Enter kernel mode through the same path as switch(IR)
+	#define ENTER(handler)                                                      \
+		do{                                                                     \
+			m->PC = pc;                                                         \
+			m->SP = sp;                                                         \
+			interrupt(m, handler);                                              \
+			pc = m->PC;                                                         \
+			sp = m->SP;                                                         \
+		}while(0)
+
+	// Check the next event, then next instruction
+	#define NEXT()                                                              \
+		do{                                                                     \
+			if(m->mode == USER_MODE && clock >= IRQ_NEXT(&m->irq))              \
+			{                                                                   \
+				m->PC = pc;                                                     \
+				m->SP = sp;                                                     \
+				m->irq.clock = clock;                                           \
+				takeInterrupt(m);                                               \
+				pc = m->PC;                                                     \
+				sp = m->SP;                                                     \
+			}                                                                   \
+			DISPATCH();                                                         \
+		}while(0)
+
+	DISPATCH();
+
+	load_value:
+		ac = d->operand;
+		NEXT();
+
+	load_addr:
+		ac = readMemory(m, d->operand);
+		NEXT();
+
+	load_ind_addr:
+		ac = readMemory(m, readMemory(m, d->operand));
+		NEXT();
+
+	safe_load_addr:
+		ac = PAGE_LOAD(m->memory, d->operand);
+		PROFILE_READ(m, d->operand);
+		NEXT();
+
+	safe_load_ind_addr:
+		PROFILE_READ(m, d->operand);
+		ac = readMemory(m, PAGE_LOAD(m->memory, d->operand));
+		NEXT();
+
+	load_idx_x_addr:
+		ac = readMemory(m, d->operand + x);
+		NEXT();
+
+	load_idx_y_addr:
+		ac = readMemory(m, d->operand + y);
+		NEXT();
+
+	load_sp_x:
+		ac = readMemory(m, sp + x);
+		NEXT();
+
+	store_addr:
+		writeMemory(m, d->operand, ac);
+		NEXT();
+
+	get:
+		ac = m->get(m->getData);
+		NEXT();
+
+	put_port:
+		m->put(m->putData, (Boolean)d->operand, ac);
+		NEXT();
+
+	add_x:
+		ac += x;
+		NEXT();
+
+	add_y:
+		ac += y;
+		NEXT();
+
+	sub_x:
+		ac -= x;
+		NEXT();
+
+	sub_y:
+		ac -= y;
+		NEXT();
+
+	copy_to_x:
+		x = ac;
+		NEXT();
+
+	copy_from_x:
+		ac = x;
+		NEXT();
+
+	copy_to_y:
+		y = ac;
+		NEXT();
+
+	copy_from_y:
+		ac = y;
+		NEXT();
+
+	copy_to_sp:
+		sp = ac;
+		NEXT();
+
+	copy_from_sp:
+		ac = sp;
+		NEXT();
+
+	jump_addr:
+		pc = d->operand;
+		NEXT();
+
+	jump_if_equal_addr:
+		if(ac == 0)
+			pc = d->operand;
+		NEXT();
+
+	jump_if_not_equal_addr:
+		if(ac != 0)
+			pc = d->operand;
+		NEXT();
+
+	call_addr:
+		sp--;							// Stack is grow down
+		writeMemory(m, sp, pc);      // Push return address onto stack
+		pc = d->operand;
+		NEXT();
+
+	ret:
+		pc = readMemory(m, sp);
+		sp++;
+		NEXT();
+
+	inc_x:
+		x++;
+		NEXT();
+
+	dec_x:
+		x--;
+		NEXT();
+
+	push:
+		sp--;
+		writeMemory(m, sp, ac);
+		NEXT();
+
+	pop:
+		ac = readMemory(m, sp);
+		sp++;
+		NEXT();
+
+	int_:
+		if(m->mode == USER_MODE)
+		{
+			PROFILE_INT(m);
+			ENTER(m->irq.vector[IRQ_INT]);
+			NEXT();
+		}
+		// Int in kernel mode falls through to IRet, same as switch(IR)
+
+	i_ret:
+		pc = readMemory(m, sp); // Pop pc, sp
+		sp++;
+		sp = readMemory(m, sp);
+		m->mode = USER_MODE;
+		NEXT();
+
+	compare_swap:
+		ac = compareSwap(m, d->operand, x, ac);
+		NEXT();
+
+	fetch_add:
+		ac = fetchAdd(m, d->operand, ac);
+		NEXT();
+
+	get_port:
+		ac = readPort(m, d->operand);
+		NEXT();
+
+	end:
+		m->status = MACHINE_END;         // Caller ends memory process
+		left--;                          // Out takes off one DISPATCH too many
+		goto out;
+
+	invalid:
+		m->PC = pc;
+		m->SP = sp;
+		m->AC = ac;
+		m->X = x;
+		m->Y = y;
+		m->irq.clock = clock;
+		machineFault(m, MACHINE_INVALID, pc - 1);
+
+	out:
+		m->PC = pc;
+		m->SP = sp;
+		m->AC = ac;
+		m->X = x;
+		m->Y = y;
+		m->irq.clock = clock;
+		return limit - left - 1;         // DISPATCH counted one more
+
+	#undef NEXT
+	#undef ENTER
+	#undef DISPATCH
+}
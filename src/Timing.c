@@ -0,0 +1,216 @@
+/********************************************************************************
+*********************************************************************************
+**  Cycle model: simulated cycles per opcode and per memory word, optionally   **
+**  through a modelled cache, see Timing.h                                     **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Timing *timingCreate(char*);     // Model from "name=cycles,..."      **
+**       void timingFree(Timing*);        // Release a model                   **
+**       void timingRead(Timing*, int, int); // Cost of one word read          **
+**       void timingStep(Machine*, int, uint64_t); // Cost of the instruction  **
+**       void timingReport(Timing*, long long, FILE*); // Cycle totals         **
+**    - Internal:                                                              **
+**       int setCost(Timing*, char*, char*); // One name=cycles of the spec    **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Cache.h"
+#include "Timing.h"
+
+
+// Default model: one cycle per instruction and per word, ten per cache miss
+#define DEFAULT_OPCODE	1
+#define DEFAULT_ACCESS	1
+#define DEFAULT_MISS	10
+
+
+// Function declare
+static int setCost(Timing *t, const char *name, const char *value);
+
+
+/****************************************************************
+* Func:   Create a cycle model                                  *
+* Param:  char *spec: comma-separated name=cycles overriding    *
+*                     the defaults; a name is an instruction    *
+*                     (eg LoadInd), all for every instruction,  *
+*                     read, write, hit or miss; timer=cycles    *
+*                     makes the timer count cycles; "" or       *
+*                     default keeps the defaults                *
+* Return: Timing*: the model, no cache yet, NULL on an invalid  *
+*                  spec or out of memory                        *
+*****************************************************************/
+Timing *timingCreate(const char *spec)
+{
+	Timing *t = calloc(1, sizeof(Timing));
+	char *copy = strdup(spec);
+	if(t == NULL || copy == NULL)
+	{
+		free(t);
+		free(copy);
+		return NULL;
+	}
+
+	int op;
+	for(op = 0; op < TIMING_OPCODES; op++)
+		t->opcode[op] = DEFAULT_OPCODE;
+	t->read = t->write = t->hit = DEFAULT_ACCESS;
+	t->miss = DEFAULT_MISS;
+
+	char *save = NULL, *item;
+	for(item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+	{
+		char *equal = strchr(item, '=');
+		if(equal == NULL && strcmp(item, "default") == 0)
+			continue;
+		if(equal == NULL)
+			break;
+		*equal = '\0';
+		if(setCost(t, item, equal + 1) != 0)
+			break;
+	}
+	free(copy);
+	if(item != NULL)
+	{
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+/****************************************************************
+* Func:   Release a cycle model and its cache                   *
+* Param:  Timing *t: the model, or NULL                         *
+* Return: none                                                  *
+*****************************************************************/
+void timingFree(Timing *t)
+{
+	if(t == NULL)
+		return;
+	cacheFree(t->cache);
+	free(t);
+}
+
+/****************************************************************
+* Func:   Count one word read: a hit or a miss of the modelled  *
+*         cache, a miss fills the line                          *
+* Param:  Timing *t: the model                                  *
+*         int addr: the word, passed protection                 *
+*         int mode: USER_MODE or KERNEL_MODE                    *
+* Return: none                                                  *
+*****************************************************************/
+void timingRead(Timing *t, int addr, int mode)
+{
+	t->reads[mode]++;
+	if(t->cache == NULL)
+	{
+		t->cycles[mode] += t->read;
+		return;
+	}
+	if(cacheLookup(t->cache, addr) != NULL)
+	{
+		t->hits[mode]++;
+		t->cycles[mode] += t->hit;
+		return;
+	}
+
+	int base, count;
+	cacheAllocate(t->cache, addr, &base, &count);	// Tags only, the words are not read
+	t->misses[mode]++;
+	t->cycles[mode] += t->miss;
+}
+
+/****************************************************************
+* Func:   Count the instruction that just ran in stepCPU(),     *
+*         move the timer on by its cycles if it counts them     *
+* Param:  Machine *m: the machine, IR holds the instruction     *
+*         int user: the instruction started in user mode        *
+*         uint64_t start: TIMING_TOTAL() before its fetch       *
+* Return: none                                                  *
+*****************************************************************/
+void timingStep(Machine *m, int user, uint64_t start)
+{
+	Timing *t = m->timing;
+
+	t->cycles[user ? USER_MODE : KERNEL_MODE] += t->opcode[(unsigned)m->IR % TIMING_OPCODES];
+	if(user && t->timerCycles)
+		m->irq.clock += TIMING_TOTAL(t) - start;
+}
+
+/****************************************************************
+* Func:   Print cycle totals, per mode of the access            *
+* Param:  Timing *t: the model                                  *
+*         long long instructions: instructions run              *
+*         FILE *fp: where the report goes                       *
+* Return: none                                                  *
+*****************************************************************/
+void timingReport(const Timing *t, long long instructions, FILE *fp)
+{
+	const char *name[2] = {"user", "kernel"};
+	uint64_t total = TIMING_TOTAL(t);
+
+	fprintf(fp, "\nCycles: %llu, %.2f per instruction, timer counts %s\n", (unsigned long long)total,
+	        instructions > 0 ? (double)total / instructions : 0.0, t->timerCycles ? "cycles" : "instructions");
+	int r;
+	for(r = 0; r < 2; r++)
+	{
+		fprintf(fp, "  %-6s cycles %llu, reads %llu, writes %llu", name[r], (unsigned long long)t->cycles[r],
+		        (unsigned long long)t->reads[r], (unsigned long long)t->writes[r]);
+		if(t->cache != NULL)
+			fprintf(fp, ", hits %llu, misses %llu", (unsigned long long)t->hits[r],
+			        (unsigned long long)t->misses[r]);
+		fprintf(fp, "\n");
+	}
+}
+
+/****************************************************************
+* Func:   Set one cost of a spec                                *
+* Param:  Timing *t: the model                                  *
+*         char *name: instruction, all, read, write, hit, miss  *
+*                     or timer                                  *
+*         char *value: cycles, 0 or more; cycles or             *
+*                      instructions for timer                   *
+* Return: int: 0 on success, -1 on an unknown name or value     *
+*****************************************************************/
+static int setCost(Timing *t, const char *name, const char *value)
+{
+	if(strcmp(name, "timer") == 0)
+	{
+		if(strcmp(value, "cycles") != 0 && strcmp(value, "instructions") != 0)
+			return -1;
+		t->timerCycles = strcmp(value, "cycles") == 0;
+		return 0;
+	}
+
+	char *end = NULL;
+	long cycles = strtol(value, &end, 10);
+	if(end == value || *end != '\0' || cycles < 0 || cycles > 1000000)
+		return -1;
+
+	int op;
+	if(strcmp(name, "all") == 0)
+		for(op = 0; op < TIMING_OPCODES; op++)
+			t->opcode[op] = cycles;
+	else if(strcmp(name, "read") == 0)
+		t->read = cycles;
+	else if(strcmp(name, "write") == 0)
+		t->write = cycles;
+	else if(strcmp(name, "hit") == 0)
+		t->hit = cycles;
+	else if(strcmp(name, "miss") == 0)
+		t->miss = cycles;
+	else
+	{
+		for(op = 0; op <= END; op++)
+			if(instructionName(op) != NULL && strcmp(instructionName(op), name) == 0)
+				break;
+		if(op > END)
+			return -1;
+		t->opcode[op] = cycles;
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Machine.h"
+
+// Cycle model: simulated cycles instead of host time, for a rough estimate
+// of how a guest program would perform. Each instruction costs its opcode's
+// cycles plus those of every memory word it touches, the fetch of its own
+// words included: read and write per word, or with a modelled cache hit or
+// miss per word read. The cache has the geometry of -c, holds tags only and
+// is write-through without write-allocate as Cache.c, under any transport
+//
+// With timerCycles the timer counts user mode cycles instead of user mode
+// instructions, so the period of machineSetTimer() is in cycles
+//
+// Counted in the generic loop only: with a model set every engine runs
+// stepCPU(), see machineRunFor(). Totals count from machineSetTiming(), a
+// snapshot does not keep them
+
+#define TIMING_OPCODES		64		// Opcodes costed, END is 50
+
+typedef struct Timing
+{
+	int opcode[TIMING_OPCODES];	// Cycles per instruction, its memory words apart
+	int read, write;			// Cycles per word read or written
+	int hit, miss;				// Cycles per word read with the cache model
+	Boolean timerCycles;		// Timer counts cycles, not instructions
+	struct Cache *cache;		// Modelled cache, tags only, or NULL
+
+	// Totals, per mode of the access
+	uint64_t cycles[2];
+	uint64_t reads[2], writes[2];
+	uint64_t hits[2], misses[2];
+} Timing;
+
+Timing *timingCreate(const char *spec);
+void timingFree(Timing *t);
+void timingRead(Timing *t, int addr, int mode);
+void timingStep(Machine *m, int user, uint64_t start);
+void timingReport(const Timing *t, long long instructions, FILE *fp);
+
+// Cycles so far in both modes
+#define TIMING_TOTAL(t)	((t)->cycles[0] + (t)->cycles[1])
+
+#define TIMING_READ(m, addr)                                                \
+	do{                                                                     \
+		if((m)->timing != NULL)                                             \
+			timingRead((m)->timing, addr, (m)->mode);                       \
+	}while(0)
+
+#define TIMING_WRITE(m)                                                     \
+	do{                                                                     \
+		Timing *t_ = (m)->timing;                                           \
+		if(t_ != NULL)                                                      \
+		{                                                                   \
+			t_->cycles[(int)(m)->mode] += t_->write;                        \
+			t_->writes[(int)(m)->mode]++;                                   \
+		}                                                                   \
+	}while(0)
+
+#endif
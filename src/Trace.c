@@ -0,0 +1,384 @@
+/********************************************************************************
+*********************************************************************************
+**  Binary execution trace                                                     **
+**  The CPU delta-encodes one record per instruction into a ring of buffers;   **
+**  a writer thread sends full buffers to the file, so the CPU only waits when **
+**  every buffer is full. The reader decodes a trace for the dump tool         **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       Trace *traceCreate(char*);       // Start a trace file                **
+**       int traceClose(Trace*);          // Write the rest and stop           **
+**       void traceStep(Trace*, ...);     // Record one instruction            **
+**       int traceOpen(TraceReader*, char*); // Open a trace to decode         **
+**       int traceNext(TraceReader*, TraceStep*); // Decode the next record    **
+**       void traceDone(TraceReader*);    // Close a trace                     **
+**    - Internal:                                                              **
+**       void *writer(void*);             // Thread: write full buffers        **
+**       void submit(Trace*);             // Queue the buffer the CPU filled   **
+**       unsigned char *putVarint(unsigned char*, int, int); // Encode a field **
+**       int getVarint(FILE*, int, int*); // Decode a field                    **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "Trace.h"
+#include "Instruction.h"
+
+
+// Writer: the CPU fills one buffer while a thread writes the full ones
+typedef struct Trace
+{
+	unsigned char *chunk[TRACE_CHUNKS];
+	size_t length[TRACE_CHUNKS];
+	unsigned char *pos, *end;	// Fill position in chunk[head], a record fits up to end
+	int head;					// Buffer the CPU fills
+	int tail;					// Next buffer for the thread
+	int queued;					// Full buffers not written yet
+	int stop;					// Thread writes what is queued and exits
+	int error;					// A write failed, the rest is dropped
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		// Buffer queued or stop
+	pthread_cond_t room;		// Buffer written
+	TraceStep last;				// Previous record
+	int next;					// Address after the previous instruction
+} Trace;
+
+
+// Function declare
+static void *writer(void *arg);
+static void submit(Trace *t);
+static unsigned char *putVarint(unsigned char *p, int value, int last);
+static int getVarint(FILE *fp, int last, int *value);
+
+
+/****************************************************************
+* Func:   Start a trace file and its writer thread              *
+* Param:  char *path: the trace file, truncated                 *
+* Return: Trace*: the trace, NULL on failure                    *
+*****************************************************************/
+Trace *traceCreate(const char *path)
+{
+	Trace *t = calloc(1, sizeof(Trace));
+	if(t == NULL)
+		return NULL;
+
+	int i, ok = 1;
+	for(i = 0; i < TRACE_CHUNKS; i++)
+		ok = ok && (t->chunk[i] = malloc(TRACE_CHUNK_SIZE)) != NULL;
+
+	TraceHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TRACE_MAGIC, 4);
+	h.version = TRACE_VERSION;
+	t->fd = ok ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+	if(t->fd < 0 || write(t->fd, &h, sizeof(h)) != sizeof(h))
+	{
+		if(t->fd >= 0)
+			close(t->fd);
+		for(i = 0; i < TRACE_CHUNKS; i++)
+			free(t->chunk[i]);
+		free(t);
+		return NULL;
+	}
+
+	t->pos = t->chunk[0];
+	t->end = t->chunk[0] + TRACE_CHUNK_SIZE - TRACE_RECORD_MAX;
+	t->next = 1;				// Fall-through of the all-zero record before the first
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->wake, NULL);
+	pthread_cond_init(&t->room, NULL);
+	pthread_create(&t->thread, NULL, writer, t);
+	return t;
+}
+
+/****************************************************************
+* Func:   Write every record so far, stop the thread, close     *
+* Param:  Trace *t: the trace, may be NULL                      *
+* Return: int: 0 on success, -1 if a write failed               *
+*****************************************************************/
+int traceClose(Trace *t)
+{
+	if(t == NULL)
+		return 0;
+
+	if(t->pos > t->chunk[t->head])
+		submit(t);
+	pthread_mutex_lock(&t->lock);
+	t->stop = 1;
+	pthread_cond_signal(&t->wake);
+	pthread_mutex_unlock(&t->lock);
+	pthread_join(t->thread, NULL);
+
+	int result = (close(t->fd) != 0 || t->error) ? -1 : 0;
+	int i;
+	for(i = 0; i < TRACE_CHUNKS; i++)
+		free(t->chunk[i]);
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->wake);
+	pthread_cond_destroy(&t->room);
+	free(t);
+	return result;
+}
+
+/****************************************************************
+* Func:   Record an instruction with the state it starts in     *
+* Param:  Trace *t: the trace                                   *
+*         int pc: address of the opcode                         *
+*         int ir: the opcode                                    *
+*         int operand: operand word, 0 if it has none           *
+*         int ac, x, y, sp: registers before it runs            *
+*         int mode: USER_MODE or KERNEL_MODE                    *
+* Return: none                                                  *
+*****************************************************************/
+void traceStep(Trace *t, int pc, int ir, int operand, int ac, int x, int y, int sp, int mode)
+{
+	if(t->pos > t->end)
+		submit(t);
+
+	// Work on a copy: stores through the byte pointer would make the
+	// compiler reload every field of t after each byte
+	TraceStep last = t->last;
+	unsigned char *p = t->pos + 1;
+	unsigned flags = 0;
+
+	if(pc != t->next)
+	{
+		flags |= TRACE_PC;
+		p = putVarint(p, pc, t->next);
+	}
+	if(ir != last.ir)
+	{
+		flags |= TRACE_IR;
+		p = putVarint(p, ir, last.ir);
+	}
+	if(operand != last.operand)
+	{
+		flags |= TRACE_OPERAND;
+		p = putVarint(p, operand, last.operand);
+	}
+	if(ac != last.ac)
+	{
+		flags |= TRACE_AC;
+		p = putVarint(p, ac, last.ac);
+	}
+	if(x != last.x)
+	{
+		flags |= TRACE_X;
+		p = putVarint(p, x, last.x);
+	}
+	if(y != last.y)
+	{
+		flags |= TRACE_Y;
+		p = putVarint(p, y, last.y);
+	}
+	if(sp != last.sp)
+	{
+		flags |= TRACE_SP;
+		p = putVarint(p, sp, last.sp);
+	}
+	if(mode != last.mode)
+		flags |= TRACE_MODE;
+	*t->pos = (unsigned char)flags;
+	t->pos = p;
+
+	t->last = (TraceStep){pc, ir, operand, ac, x, y, sp, mode};
+	t->next = pc + (HAS_OPERAND(ir) ? 2 : 1);
+}
+
+/****************************************************************
+* Func:   Open a trace to decode                                *
+* Param:  TraceReader *r: the reader to set up                  *
+*         char *path: the trace file                            *
+* Return: int: 0 on success, -1 if the file can not be opened   *
+*              or is not a trace                                *
+*****************************************************************/
+int traceOpen(TraceReader *r, const char *path)
+{
+	TraceHeader h;
+
+	memset(r, 0, sizeof(*r));
+	r->fp = fopen(path, "rb");
+	if(r->fp == NULL)
+		return -1;
+	if(fread(&h, sizeof(h), 1, r->fp) != 1 || memcmp(h.magic, TRACE_MAGIC, 4) != 0
+	   || h.version != TRACE_VERSION)
+	{
+		fclose(r->fp);
+		r->fp = NULL;
+		return -1;
+	}
+	r->next = 1;
+	return 0;
+}
+
+/****************************************************************
+* Func:   Decode the next record                                *
+* Param:  TraceReader *r: an open reader                        *
+*         TraceStep *step: where to store the step              *
+* Return: int: 1 for a step, 0 at the end of the trace, -1 if   *
+*              the last record is cut off                       *
+*****************************************************************/
+int traceNext(TraceReader *r, TraceStep *step)
+{
+	TraceStep *l = &r->last;
+	int flags = getc(r->fp);
+	int ok = 1;
+
+	if(flags == EOF)
+		return 0;
+	l->pc = r->next;
+	if(flags & TRACE_PC)
+		ok = ok && getVarint(r->fp, r->next, &l->pc) == 0;
+	if(flags & TRACE_IR)
+		ok = ok && getVarint(r->fp, l->ir, &l->ir) == 0;
+	if(flags & TRACE_OPERAND)
+		ok = ok && getVarint(r->fp, l->operand, &l->operand) == 0;
+	if(flags & TRACE_AC)
+		ok = ok && getVarint(r->fp, l->ac, &l->ac) == 0;
+	if(flags & TRACE_X)
+		ok = ok && getVarint(r->fp, l->x, &l->x) == 0;
+	if(flags & TRACE_Y)
+		ok = ok && getVarint(r->fp, l->y, &l->y) == 0;
+	if(flags & TRACE_SP)
+		ok = ok && getVarint(r->fp, l->sp, &l->sp) == 0;
+	if(flags & TRACE_MODE)
+		l->mode = !l->mode;
+	if(!ok)
+		return -1;
+
+	r->next = l->pc + (HAS_OPERAND(l->ir) ? 2 : 1);
+	r->records++;
+	*step = *l;
+	return 1;
+}
+
+/****************************************************************
+* Func:   Close a trace opened with traceOpen()                 *
+* Param:  TraceReader *r: the reader                            *
+* Return: none                                                  *
+*****************************************************************/
+void traceDone(TraceReader *r)
+{
+	if(r->fp != NULL)
+		fclose(r->fp);
+	r->fp = NULL;
+}
+
+
+/****************************************************************
+* Func:   Writer thread: write queued buffers in order until    *
+*         stopped and nothing is queued                         *
+* Param:  void *arg: the trace                                  *
+* Return: void*: NULL                                           *
+*****************************************************************/
+void *writer(void *arg)
+{
+	Trace *t = arg;
+
+	pthread_mutex_lock(&t->lock);
+	while(1)
+	{
+		while(t->queued == 0 && !t->stop)
+			pthread_cond_wait(&t->wake, &t->lock);
+		if(t->queued == 0)
+			break;				// Stopped, everything written
+		int i = t->tail;
+		pthread_mutex_unlock(&t->lock);
+
+		// The CPU does not touch a queued buffer, no lock while writing
+		size_t done = 0;
+		while(!t->error && done < t->length[i])
+		{
+			ssize_t n = write(t->fd, t->chunk[i] + done, t->length[i] - done);
+			if(n <= 0)
+				t->error = 1;
+			else
+				done += n;
+		}
+
+		pthread_mutex_lock(&t->lock);
+		t->tail = (t->tail + 1) % TRACE_CHUNKS;
+		t->queued--;
+		pthread_cond_signal(&t->room);
+	}
+	pthread_mutex_unlock(&t->lock);
+	return NULL;
+}
+
+/****************************************************************
+* Func:   Queue the buffer the CPU filled and move on to the    *
+*         next one, waits only if every buffer is queued        *
+* Param:  Trace *t: the trace                                   *
+* Return: none                                                  *
+*****************************************************************/
+void submit(Trace *t)
+{
+	t->length[t->head] = t->pos - t->chunk[t->head];
+
+	pthread_mutex_lock(&t->lock);
+	t->queued++;
+	pthread_cond_signal(&t->wake);
+	t->head = (t->head + 1) % TRACE_CHUNKS;
+	while(t->queued == TRACE_CHUNKS)	// Buffer at head is still queued
+		pthread_cond_wait(&t->room, &t->lock);
+	pthread_mutex_unlock(&t->lock);
+
+	t->pos = t->chunk[t->head];
+	t->end = t->chunk[t->head] + TRACE_CHUNK_SIZE - TRACE_RECORD_MAX;
+}
+
+/****************************************************************
+* Func:   Append the zigzag varint of value - last              *
+* Param:  unsigned char *p: where to write, up to 5 bytes       *
+*         int value: the field                                  *
+*         int last: the field in the record before              *
+* Return: unsigned char*: the byte after the varint             *
+*****************************************************************/
+unsigned char *putVarint(unsigned char *p, int value, int last)
+{
+	uint32_t delta = (uint32_t)value - (uint32_t)last;		// Wraps, no overflow
+	uint32_t v = (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+
+	while(v >= 0x80)
+	{
+		*p++ = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (unsigned char)v;
+	return p;
+}
+
+/****************************************************************
+* Func:   Read a zigzag varint and add it to last               *
+* Param:  FILE *fp: the trace                                   *
+*         int last: the field in the record before              *
+*         int *value: where to store the field                  *
+* Return: int: 0 on success, -1 at the end of the file or if    *
+*              the varint is longer than 5 bytes                *
+*****************************************************************/
+int getVarint(FILE *fp, int last, int *value)
+{
+	uint32_t v = 0;
+	int shift, c;
+
+	for(shift = 0; shift < 35; shift += 7)
+	{
+		if((c = getc(fp)) == EOF)
+			return -1;
+		v |= (uint32_t)(c & 0x7f) << shift;
+		if(!(c & 0x80))
+		{
+			uint32_t delta = (v >> 1) ^ (0 - (v & 1));
+			*value = (int)((uint32_t)last + delta);
+			return 0;
+		}
+	}
+	return -1;
+}
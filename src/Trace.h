@@ -0,0 +1,70 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Binary execution trace: one record per instruction with the state it
+// started in, see traceStep()
+//
+// Layout:
+//   TraceHeader
+//   records, each a flags byte and then, in this order, a varint for every
+//   flag set: PC, IR, operand, AC, X, Y, SP
+// A varint holds the zigzag encoded difference to the same field of the
+// record before, 7 bits per byte, low bits first; for PC the difference to
+// the address after the previous instruction. Fields that did not change
+// are left out, so a straight-line step takes 2-4 bytes. Every field starts
+// from 0, mode from user mode
+
+#define TRACE_MAGIC			"CPUT"
+#define TRACE_VERSION		1
+
+// Record flags
+#define TRACE_PC			0x01	// PC does not follow the previous instruction
+#define TRACE_IR			0x02
+#define TRACE_OPERAND		0x04
+#define TRACE_AC			0x08
+#define TRACE_X				0x10
+#define TRACE_Y				0x20
+#define TRACE_SP			0x40
+#define TRACE_MODE			0x80	// Mode toggled, no varint
+
+#define TRACE_RECORD_MAX	(1 + 7 * 5)	// Flags and 7 varints of up to 5 bytes
+#define TRACE_CHUNK_SIZE	(1 << 16)	// Bytes per buffer
+#define TRACE_CHUNKS		8			// Buffers in the ring
+
+typedef struct
+{
+	char magic[4];				// TRACE_MAGIC
+	uint16_t version;			// TRACE_VERSION
+	uint16_t reserved;			// 0
+} TraceHeader;
+
+// One decoded step
+typedef struct
+{
+	int pc, ir, operand;
+	int ac, x, y, sp;
+	int mode;					// USER_MODE or KERNEL_MODE
+} TraceStep;
+
+struct Trace;
+
+// Reader for the decoder
+typedef struct
+{
+	FILE *fp;
+	TraceStep last;				// Previous record
+	int next;					// Address after the previous instruction
+	long long records;			// Records decoded
+} TraceReader;
+
+struct Trace *traceCreate(const char *path);
+int traceClose(struct Trace *t);
+void traceStep(struct Trace *t, int pc, int ir, int operand, int ac, int x, int y, int sp, int mode);
+int traceOpen(TraceReader *r, const char *path);
+int traceNext(TraceReader *r, TraceStep *step);
+void traceDone(TraceReader *r);
+
+#endif
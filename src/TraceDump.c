@@ -0,0 +1,133 @@
+/********************************************************************************
+*********************************************************************************
+**  Print an execution trace written with the simulator's -T option            **
+**  One line per instruction: step, mode, PC, instruction and operand, then    **
+**  the registers it started with                                              **
+**                                                                             **
+**  Usage: ./tracedump [-p low,high] [-o opcode] [-n count] [-s symbols]       **
+**                     trace.bin                                               **
+**         -p: only instructions at addresses low to high                      **
+**         -o: only one instruction, by number or name, eg -o Int              **
+**         -n: stop after count printed lines                                  **
+**         -s: symbol table from asm -s, adds the PC as label+offset           **
+**  Build: gcc -pthread -o tracedump TraceDump.c Trace.c Instruction.c         **
+**         Symbol.c                                                            **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+#include "Trace.h"
+#include "Instruction.h"
+#include "Symbol.h"
+
+
+#define USAGE "Usage: %s [-p low,high] [-o opcode] [-n count] [-s symbols] trace.bin\n"
+
+
+int main(int argc, char *argv[])
+{
+	int low = INT_MIN, high = INT_MAX;
+	int opcode = -1;
+	long long count = -1;
+	SymbolTable *symbols = NULL;
+	int opt;
+
+	while((opt = getopt(argc, argv, "p:o:n:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'p':
+				if(sscanf(optarg, "%d,%d", &low, &high) != 2 || low > high)
+				{
+					printf("Invalid address range: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case 'o':
+			{
+				char *rest;
+				opcode = strtol(optarg, &rest, 10);
+				if(*rest != '\0')		// Not a number, look the name up
+					for(opcode = END; opcode >= 0; opcode--)
+						if(instructionName(opcode) != NULL && strcasecmp(instructionName(opcode), optarg) == 0)
+							break;
+				if(instructionName(opcode) == NULL)
+				{
+					printf("Unknown instruction: %s\n", optarg);
+					exit(1);
+				}
+				break;
+			}
+
+			case 'n':
+				count = atoll(optarg);
+				break;
+
+			case 's':
+				if((symbols = symbolLoad(optarg)) == NULL)
+				{
+					printf("Can not read symbol table: %s\n", optarg);
+					exit(1);
+				}
+				break;
+
+			default:
+				printf(USAGE, argv[0]);
+				exit(1);
+		}
+	}
+	if(argc - optind != 1)
+	{
+		printf(USAGE, argv[0]);
+		exit(1);
+	}
+
+	TraceReader r;
+	if(traceOpen(&r, argv[optind]) != 0)
+	{
+		printf("Error! %s is not a trace\n", argv[optind]);
+		exit(1);
+	}
+
+	TraceStep s;
+	int result = 0;
+	printf("%12s %-6s %6s  ", "step", "mode", "pc");
+	if(symbols != NULL)
+		printf("%-24s ", "symbol");
+	printf("%-22s %11s %11s %11s %11s\n", "instruction", "ac", "x", "y", "sp");
+	while(count != 0 && (result = traceNext(&r, &s)) == 1)
+	{
+		if(s.pc < low || s.pc > high || (opcode >= 0 && s.ir != opcode))
+			continue;
+
+		char text[32];
+		const char *name = instructionName(s.ir);
+		if(name == NULL)
+			snprintf(text, sizeof(text), "invalid %d", s.ir);
+		else if(HAS_OPERAND(s.ir))
+			snprintf(text, sizeof(text), "%s %d", name, s.operand);
+		else
+			snprintf(text, sizeof(text), "%s", name);
+		printf("%12lld %-6s %6d  ", r.records - 1, s.mode ? "kernel" : "user", s.pc);
+		if(symbols != NULL)
+		{
+			char where[64];
+			symbolFormat(symbols, s.pc, where, sizeof(where));
+			printf("%-24s ", where);
+		}
+		printf("%-22s %11d %11d %11d %11d\n", text, s.ac, s.x, s.y, s.sp);
+		if(count > 0)
+			count--;
+	}
+	if(count != 0 && result < 0)
+		printf("Trace is cut off after %lld records\n", r.records);
+	traceDone(&r);
+	symbolFree(symbols);
+	exit(0);
+}
@@ -0,0 +1,420 @@
+/********************************************************************************
+*********************************************************************************
+**  Load-time verifier                                                         **
+**  Builds the control-flow graph of the loaded program from the user entry    **
+**  and the interrupt vectors, reports undefined opcodes, jumps into operand   **
+**  slots, statically known protection violations and words that never run,    **
+**  and marks loads proven in bounds so the engines can skip their check       **
+**  Function:                                                                  **
+**    - External:                                                              **
+**       int verifyProgram(Machine*, FILE*); // Verify, mark safe loads        **
+**       void verifyFree(Machine*);       // Drop the safe marks               **
+**    - Internal:                                                              **
+**       void queue(Verifier*, int, int, int, char*); // Add a CFG edge        **
+**       void follow(Verifier*, int, int); // Decode one reached instruction   **
+**       void checkAccess(Verifier*, int, int, int, int); // Direct address    **
+**       void checkWords(Verifier*);      // Overlaps, stores, unused words    **
+**       void unusedWords(Verifier*, int, int, int); // Words that never run   **
+**       void finding(Verifier*, int, int, char*, ...); // Record a finding    **
+**       int compareFindings(void*, void*); // Order by address                **
+*********************************************************************************
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "Instruction.h"
+#include "CPU.h"
+#include "Verify.h"
+
+
+// Marks per word
+#define MARK_USER		0x01	// Instruction reached in user mode
+#define MARK_KERNEL		0x02	// Instruction reached in kernel mode
+#define MARK_OPERAND	0x04	// Operand word of a reached instruction
+#define MARK_DATA		0x08	// Address of a direct access or an indexed base
+#define MARK_CODE		(MARK_USER | MARK_KERNEL)
+
+#define FINDING_SIZE	96
+
+// One diagnostic
+typedef struct
+{
+	int addr;
+	int severity;				// VERIFY_*
+	char text[FINDING_SIZE];
+} Finding;
+
+// State of one verification
+typedef struct
+{
+	Machine *m;
+	unsigned char *mark;		// MARK_* per word, calloc() leaves untouched pages unbacked
+	int *work;					// Pending (address, mode) pairs
+	int pending, workSize;
+	Finding *findings;
+	int count, capacity;
+} Verifier;
+
+
+// Function declare
+static void queue(Verifier *v, int from, int addr, int mode, const char *how);
+static void follow(Verifier *v, int addr, int mode);
+static void checkAccess(Verifier *v, int addr, int opcode, int target, int mode);
+static void checkWords(Verifier *v);
+static void unusedWords(Verifier *v, int start, int end, int data);
+static void finding(Verifier *v, int addr, int severity, const char *format, ...);
+static int compareFindings(const void *a, const void *b);
+
+
+static const char *const severityName[] = {"error", "warning", "note"};
+static const char *const modeName[] = {"user", "kernel"};
+
+
+/****************************************************************
+* Func:   Verify the program in the machine's memory and print  *
+*         the findings, marks loads proven in bounds            *
+* Param:  Machine *m: the machine, program loaded               *
+*         FILE *report: where findings go, NULL for none        *
+* Return: int: number of errors, -1 if out of memory            *
+*                                                               *
+* With TRANSPORT_PIPE the engines never read memory directly,   *
+* and with several CPUs another one may rewrite the code:       *
+* nothing is marked                                             *
+*****************************************************************/
+int verifyProgram(Machine *m, FILE *report)
+{
+	Verifier v;
+	int i, line;
+
+	memset(&v, 0, sizeof(v));
+	v.m = m;
+	v.mark = calloc(m->layout.size, 1);
+	v.workSize = 256;
+	v.work = malloc(v.workSize * 2 * sizeof(int));
+	if(v.mark == NULL || v.work == NULL)
+	{
+		free(v.mark);
+		free(v.work);
+		return -1;
+	}
+
+	// Entries: where the machine is, the user program, the vector of every
+	// line a timer raises and that of the input port; the Int vector is
+	// reached from Int instructions
+	queue(&v, -1, m->PC, m->mode, NULL);
+	queue(&v, -1, USER_ADDRESS, USER_MODE, NULL);
+	for(i = 0; i < IRQ_TIMERS; i++)
+	{
+		line = m->irq.timer[i].line;
+		int vector = m->irq.vector[line];
+		if(m->irq.timer[i].deadline == IRQ_NEVER || vector < 0)
+			continue;
+		if((unsigned)vector < (unsigned)m->layout.size && PAGE_LOAD(m->memory, vector) == 0)
+			finding(&v, vector, VERIFY_WARNING, "handler of line %d is empty, a timer raises it", line);
+		else
+			queue(&v, -1, vector, KERNEL_MODE, NULL);
+	}
+	if(m->irq.vector[IRQ_INPUT] >= 0)		// The input port raises it, see Stream.h
+		queue(&v, -1, m->irq.vector[IRQ_INPUT], KERNEL_MODE, NULL);
+	while(v.pending > 0)
+	{
+		v.pending--;
+		follow(&v, v.work[2 * v.pending], v.work[2 * v.pending + 1]);
+	}
+
+	verifyFree(m);
+	if(m->transport != TRANSPORT_PIPE && m->cpus <= 1)	// Another CPU's writes would not drop marks
+		m->safe = calloc(m->layout.size, 1);
+	checkWords(&v);
+
+	int counted[3] = {0, 0, 0};
+	qsort(v.findings, v.count, sizeof(Finding), compareFindings);
+	for(i = 0; i < v.count; i++)
+	{
+		counted[v.findings[i].severity]++;
+		if(report != NULL)
+			fprintf(report, "verify: %d: %s: %s\n", v.findings[i].addr,
+			        severityName[v.findings[i].severity], v.findings[i].text);
+	}
+	if(report != NULL)
+		fprintf(report, "verify: %d error(s), %d warning(s), %d note(s)\n", counted[VERIFY_ERROR],
+		        counted[VERIFY_WARNING], counted[VERIFY_NOTE]);
+
+	free(v.mark);
+	free(v.work);
+	free(v.findings);
+	return counted[VERIFY_ERROR];
+}
+
+/****************************************************************
+* Func:   Drop the marks of verifyProgram(), every load is      *
+*         checked again                                         *
+* Param:  Machine *m: the machine                               *
+* Return: none                                                  *
+*****************************************************************/
+void verifyFree(Machine *m)
+{
+	free(m->safe);
+	m->safe = NULL;
+}
+
+
+/****************************************************************
+* Func:   Add an edge of the control-flow graph: the target is  *
+*         checked against what the mode may fetch and queued    *
+* Param:  Verifier *v: the verification                         *
+*         int from: instruction of the edge, -1 for an entry    *
+*         int addr: target                                      *
+*         int mode: USER_MODE or KERNEL_MODE at the target      *
+*         char *how: what leads there, for the message          *
+* Return: none                                                  *
+*****************************************************************/
+void queue(Verifier *v, int from, int addr, int mode, const char *how)
+{
+	if(addr < 0 || addr >= v->m->limit[mode])
+	{
+		if(from < 0)
+			finding(v, addr, VERIFY_ERROR, "entry outside %s memory", modeName[mode]);
+		else
+			finding(v, from, VERIFY_ERROR, "%s to %d, outside %s memory", how, addr, modeName[mode]);
+		return;
+	}
+	if(v->mark[addr] & (mode == USER_MODE ? MARK_USER : MARK_KERNEL))
+		return;						// Already followed in this mode
+
+	if(v->pending == v->workSize)
+	{
+		int *bigger = realloc(v->work, v->workSize * 4 * sizeof(int));
+		if(bigger == NULL)
+			return;					// Verification stays partial
+		v->work = bigger;
+		v->workSize *= 2;
+	}
+	v->work[2 * v->pending] = addr;
+	v->work[2 * v->pending + 1] = mode;
+	v->pending++;
+}
+
+/****************************************************************
+* Func:   Decode one reached instruction and queue where it     *
+*         may continue                                          *
+* Param:  Verifier *v: the verification                         *
+*         int addr: the instruction, inside the mode's memory   *
+*         int mode: USER_MODE or KERNEL_MODE                    *
+* Return: none                                                  *
+*****************************************************************/
+void follow(Verifier *v, int addr, int mode)
+{
+	Machine *m = v->m;
+	unsigned char bit = (mode == USER_MODE) ? MARK_USER : MARK_KERNEL;
+
+	if(v->mark[addr] & bit)
+		return;
+	v->mark[addr] |= bit;
+
+	int opcode = PAGE_LOAD(m->memory, addr);
+	const char *name = instructionName(opcode);
+	if(name == NULL)
+	{
+		finding(v, addr, VERIFY_ERROR, "undefined opcode %d in %s mode", opcode, modeName[mode]);
+		return;
+	}
+
+	int operand = 0, next = addr + 1;
+	if(HAS_OPERAND(opcode))
+	{
+		if(next >= m->limit[mode])
+		{
+			finding(v, addr, VERIFY_ERROR, "operand of %s outside %s memory", name, modeName[mode]);
+			return;
+		}
+		operand = PAGE_LOAD(m->memory, next);
+		v->mark[next] |= MARK_OPERAND;
+		next++;
+	}
+
+	switch(opcode)
+	{
+		case LOAD_ADDR: case LOAD_IND_ADDR: case STORE_ADDR:
+		case LOAD_IDX_X_ADDR: case LOAD_IDX_Y_ADDR:
+		case COMPARE_SWAP: case FETCH_ADD:
+			checkAccess(v, addr, opcode, operand, mode);
+			break;
+
+		case JUMP_ADDR:
+			queue(v, addr, operand, mode, name);
+			return;
+
+		case JUMP_IF_EQUAL_ADDR: case JUMP_IF_NOT_EQUAL_ADDR: case CALL_ADDR:
+			queue(v, addr, operand, mode, name);
+			break;					// Not taken, or back from the call
+
+		case INT:
+			if(mode == USER_MODE)
+			{
+				int vector = m->irq.vector[IRQ_INT];
+				if((unsigned)vector < (unsigned)m->layout.size && PAGE_LOAD(m->memory, vector) == 0)
+					finding(v, addr, VERIFY_ERROR, "Int, but the handler at %d is empty", vector);
+				else
+					queue(v, addr, vector, KERNEL_MODE, name);
+				break;				// Back from the handler
+			}
+			return;					// Int in kernel mode acts as IRet
+
+		case RET: case I_RET: case END:
+			return;					// Target known only at runtime, or none
+	}
+	queue(v, addr, next, mode, "execution continues");
+}
+
+/****************************************************************
+* Func:   Check a direct address against what the mode may      *
+*         access, mark loads that can not fault                 *
+* Param:  Verifier *v: the verification                         *
+*         int addr: the instruction                             *
+*         int opcode: LoadAddr, LoadInd, Store, LoadIdx* or an  *
+*                     atomic                                    *
+*         int target: the operand                               *
+*         int mode: USER_MODE or KERNEL_MODE                    *
+* Return: none                                                  *
+*****************************************************************/
+void checkAccess(Verifier *v, int addr, int opcode, int target, int mode)
+{
+	Machine *m = v->m;
+
+	if((unsigned)target < (unsigned)m->layout.size)
+		v->mark[target] |= MARK_DATA;
+	if(opcode == LOAD_IDX_X_ADDR || opcode == LOAD_IDX_Y_ADDR)
+		return;						// X and Y are known only at runtime
+	if((unsigned)target >= (unsigned)m->limit[mode])
+		finding(v, addr, VERIFY_ERROR, "%s %d, outside %s memory", instructionName(opcode),
+		        target, modeName[mode]);
+}
+
+/****************************************************************
+* Func:   Look at every word once the graph is complete: jumps  *
+*         into operands, stores into code, words that never     *
+*         run, and the loads that are safe in every mode        *
+* Param:  Verifier *v: the verification                         *
+* Return: none                                                  *
+*****************************************************************/
+void checkWords(Verifier *v)
+{
+	Machine *m = v->m;
+	PageTable *pt = m->memory;
+	int page, addr, start = -1, data = 0;
+
+	for(page = 0; page <= pt->pageCount; page++)
+	{
+		// A reached instruction on an unwritten page is opcode 0, already reported
+		int low = page << PAGE_SHIFT, high = low + PAGE_WORDS;
+		if(page == pt->pageCount || pt->pages[page] == pageZero)
+			high = low;
+		else if(high > m->layout.size)
+			high = m->layout.size;
+		if(high == low && start >= 0)
+		{
+			unusedWords(v, start, low, data);
+			start = -1;
+		}
+
+		for(addr = low; addr < high; addr++)
+		{
+			int word = PAGE_LOAD(pt, addr);
+			unsigned char mark = v->mark[addr];
+
+			// Nonzero words that never run, one finding per run of them
+			if(word != 0 && !(mark & (MARK_CODE | MARK_OPERAND)))
+			{
+				if(start < 0)
+				{
+					start = addr;
+					data = 0;
+				}
+				data |= mark & MARK_DATA;
+				continue;
+			}
+			if(start >= 0)
+			{
+				unusedWords(v, start, addr, data);
+				start = -1;
+			}
+			if(!(mark & MARK_CODE))
+				continue;
+
+			if(mark & MARK_OPERAND)
+				finding(v, addr, VERIFY_WARNING, "instruction is also the operand of another one");
+			int operand = (addr + 1 < m->layout.size) ? PAGE_LOAD(pt, addr + 1) : 0;
+			if((word == STORE_ADDR || word == COMPARE_SWAP || word == FETCH_ADD)
+			   && (unsigned)operand < (unsigned)m->layout.size
+			   && (v->mark[operand] & (MARK_CODE | MARK_OPERAND)))
+				finding(v, addr, VERIFY_NOTE, "%s %d writes code (self-modifying)", instructionName(word),
+				        operand);
+
+			// Safe in every mode that may fetch it: user mode below the boundary
+			int limit = (addr < m->layout.system) ? m->layout.system : m->layout.size;
+			if(m->safe != NULL && (word == LOAD_ADDR || word == LOAD_IND_ADDR)
+			   && operand >= 0 && operand < limit)
+				m->safe[addr] = 1;
+		}
+	}
+}
+
+/****************************************************************
+* Func:   Report a run of nonzero words that never run          *
+* Param:  Verifier *v: the verification                         *
+*         int start: first word                                 *
+*         int end: word after the last                          *
+*         int data: a direct access or indexed base points in   *
+* Return: none                                                  *
+*****************************************************************/
+void unusedWords(Verifier *v, int start, int end, int data)
+{
+	finding(v, start, VERIFY_NOTE, "%d word(s) up to %d never run (%s)", end - start, end - 1,
+	        data ? "data" : "unreachable code or data");
+}
+
+/****************************************************************
+* Func:   Record a finding                                      *
+* Param:  Verifier *v: the verification                         *
+*         int addr: where it is                                 *
+*         int severity: VERIFY_*                                *
+*         char *format: printf() format of the text             *
+* Return: none, dropped if out of memory                        *
+*****************************************************************/
+void finding(Verifier *v, int addr, int severity, const char *format, ...)
+{
+	if(v->count == v->capacity)
+	{
+		int capacity = v->capacity ? 2 * v->capacity : 64;
+		Finding *bigger = realloc(v->findings, capacity * sizeof(Finding));
+		if(bigger == NULL)
+			return;
+		v->findings = bigger;
+		v->capacity = capacity;
+	}
+
+	Finding *f = &v->findings[v->count++];
+	f->addr = addr;
+	f->severity = severity;
+	va_list args;
+	va_start(args, format);
+	vsnprintf(f->text, sizeof(f->text), format, args);
+	va_end(args);
+}
+
+/****************************************************************
+* Func:   Order findings by address, then severity              *
+* Param:  void *a, void *b: two Finding                         *
+* Return: int: qsort() order                                    *
+*****************************************************************/
+int compareFindings(const void *a, const void *b)
+{
+	const Finding *x = a, *y = b;
+
+	if(x->addr != y->addr)
+		return (x->addr > y->addr) - (x->addr < y->addr);
+	return x->severity - y->severity;
+}
@@ -0,0 +1,43 @@
+#ifndef _VERIFY_H_
+#define _VERIFY_H_
+
+#include <stdio.h>
+#include "Machine.h"
+
+// Load-time verifier: follows the control flow of the loaded program from
+// the user entry and every interrupt vector, and reports what would only
+// show up at runtime:
+//   error    undefined opcode on a reachable path, a jump or a direct
+//            LoadAddr/LoadInd/Store outside what the mode may access
+//   warning  a jump into the operand slot of another instruction
+//   note     self-modifying stores, words never executed (data or dead code)
+// Ret, IRet and indexed accesses depend on runtime values and are not
+// followed or checked
+//
+// LoadAddr and LoadInd whose address is in bounds for every mode that may
+// fetch them are marked in m->safe; the threaded and block engines then
+// read those words without the protection check. A write to a marked word
+// or its operand clears the mark, see VERIFY_INVALIDATE
+
+#define VERIFY_ERROR	0
+#define VERIFY_WARNING	1
+#define VERIFY_NOTE		2
+
+// Loads at addr were proven in bounds, the code is unchanged since
+#define VERIFIED_SAFE(m, addr)	((m)->safe != NULL && (m)->safe[addr])
+
+// A write to addr may change the instruction at addr or addr - 1
+#define VERIFY_INVALIDATE(m, addr)                                          \
+	do{                                                                     \
+		if((m)->safe != NULL)                                               \
+		{                                                                   \
+			(m)->safe[addr] = 0;                                            \
+			if((addr) > 0)                                                  \
+				(m)->safe[(addr) - 1] = 0;                                  \
+		}                                                                   \
+	}while(0)
+
+int verifyProgram(Machine *m, FILE *report);
+void verifyFree(Machine *m);
+
+#endif